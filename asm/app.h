@@ -29,6 +29,7 @@
 #define _APPLICATION_H
 
 #include <limits.h>
+#include <setjmp.h>
 /* */
 #include <app_common.h>
 #include "assembler.h"
@@ -36,9 +37,27 @@
 struct app_context_t {
     char inputfile[PATH_MAX];
     char outputfile[PATH_MAX];
+    char listingfile[PATH_MAX];
     int printresult; /* print assembled info */
     int noprint;     /* suppress print directive */
 
+    /* constants given with "-D", applied to each new assembler context */
+#define DEFINES_MAX     64
+    char *defines[DEFINES_MAX];
+    int ndefines;
+
+    /* variants, assembled from same source with different constants */
+#define VARIANTS_MAX    64
+    struct {
+        char *name;
+        char *defs; /* comma separated list of <symbol>=<value> */
+    } variants[VARIANTS_MAX];
+    int nvariants;
+    int jobs;        /* number of variants assembled in parallel */
+
+    int watch;       /* rebuild on change of sources */
+    jmp_buf *watchjmp; /* return point of failed rebuild in watch mode */
+
     struct asm_context_t *asmcontext;
 };
 
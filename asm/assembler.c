@@ -40,6 +40,8 @@
     #define PRINTF(...)
 #endif
 
+static void _add_file(struct asm_context_t *ctx, char *fname);
+
 /*
  *
  */
@@ -58,11 +60,16 @@ void assembler_init()
 
     ctx->pass     = 0;
     ctx->dbendian = DB_ENDIAN_BIG;
+    ctx->expand   = 0;
+    ctx->nexpand  = 0;
+    ctx->listing  = NULL;
+    ctx->files    = NULL;
 
     tokens_init(&ctx->tokens);
     symbols_init(&ctx->symbols);
     sections_init(&ctx->sections);
     relocations_init(&ctx->relocations);
+    macros_init(&ctx->macros);
 
     ctx->section = section_select(&ctx->sections, "text");
 }
@@ -78,10 +85,14 @@ void assembler_destroy()
     if (!ctx)
         return;
 
+    /* pending line of listing refers to section */
+    listing_close(ctx);
     tokens_destroy(&ctx->tokens);
     symbols_destroy(&ctx->symbols);
     sections_destroy(&ctx->sections);
     relocations_destroy(&ctx->relocations);
+    macros_destroy(&ctx->macros);
+    llist_destroy(ctx->files);
 
     free(ctx);
     app.asmcontext = NULL;
@@ -97,12 +108,63 @@ int assembler(struct asm_context_t *ctx, char *infile)
 
     token = token_new(&ctx->tokens);
     token_prepare(token, infile);
+    _add_file(ctx, infile);
+
+    symbols_set_scope(&ctx->symbols, NULL);
+
+    error = assembler_parse(ctx, token);
+    if (error)
+        debug_emsgf("Error in file", "%s" NL, infile);
+
+    token_remove(&ctx->tokens, token);
+    return error;
+}
 
-    symbol_drop(&ctx->symbols, SYMBOL_CURRENT_LABEL);
+/*
+ * Remember name of source file, used to watch sources for changes.
+ */
+static void _add_file(struct asm_context_t *ctx, char *fname)
+{
+    struct llist_t *ll;
+    char *name;
+
+    for (ll = ctx->files; ll; ll = ll->next)
+    {
+        if (strcmp(ll->p, fname) == 0)
+            return;
+    }
+
+    name = malloc(strlen(fname) + 1);
+    if (!name)
+        goto error;
+    strcpy(name, fname);
 
+    ll = llist_add(ctx->files, name, free, name);
+    if (!ll)
+    {
+        free(name);
+        goto error;
+    }
+    ctx->files = ll;
+    return;
+error:
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * Parse program from token until end of file.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int assembler_parse(struct asm_context_t *ctx, struct token_t *token)
+{
     while (1)
     {
         token_drop(token);
+        if (ctx->listing && listing_line(ctx, token) < 0)
+            goto error;
         if (lang_eof(token) == 0)
             break;
         if (lang_comment(token) == 0)
@@ -113,9 +175,13 @@ int assembler(struct asm_context_t *ctx, char *infile)
         {
             if (lang_directive(ctx, token) == 0)
                 continue;
+            if (lang_macro(ctx, token) == 0)
+                continue;
             if (lang_instruction(ctx, token) == 0)
                 continue;
         } else {
+            if (lang_skip_block(token) == 0)
+                continue;
             if (token_get(token, TOKEN_TYPE_LINE, TOKEN_CURRENT))
                 continue;
         }
@@ -124,15 +190,10 @@ int assembler(struct asm_context_t *ctx, char *infile)
         goto error;
     }
 
-    error = 0;
-    goto noerror;
+    return 0;
 error:
-    error = -1;
     token_print_rollback(token);
-    debug_emsgf("Error in file", "%s" NL, infile);
-noerror:
-    token_remove(&ctx->tokens, token);
-    return error;
+    return -1;
 }
 
 /*
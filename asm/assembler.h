@@ -33,6 +33,9 @@
 #include <symbol.h>
 #include <section.h>
 #include <relocation.h>
+/* */
+#include "macro.h"
+#include "listing.h"
 
 struct asm_context_t {
     int pass;                    /* pass number */
@@ -47,10 +50,16 @@ struct asm_context_t {
     struct sections_t sections;       /* sections list */
     struct relocations_t relocations; /* relocations list */
     struct section_t *section;        /* current section */
+    struct macros_t macros;           /* macro definitions */
+    int expand;                       /* depth of macro/repeat expansion */
+    int nexpand;                      /* expansions with labels, names their scopes */
+    struct listing_t *listing;        /* listing output, NULL if not requested */
+    struct llist_t *files;            /* names of source files read */
 };
 
 void assembler_init();
 int assembler(struct asm_context_t *ctx, char *infile);
+int assembler_parse(struct asm_context_t *ctx, struct token_t *token);
 void assembler_print_result();
 void assembler_destroy();
 #endif
@@ -35,8 +35,18 @@
 #include "lang.h"
 #include "assembler.h"
 #include "section.h"
+#include "bmem.h"
 
+#define TABLE_INDEX_SYMBOL    "INDEX"
+#define EXPAND_DEPTH_MAX      64
+
+static int _lang_dwidth(char *name);
 static int _lang_db(struct asm_context_t *ctx, struct token_t *token, int width);
+static int _lang_table(struct asm_context_t *ctx, struct token_t *token);
+static int _lang_block(struct token_t *token, char *end, struct macro_t *m);
+static int _lang_macro_define(struct asm_context_t *ctx, struct token_t *token);
+static int _lang_rept(struct asm_context_t *ctx, struct token_t *token);
+static int _lang_expand(struct asm_context_t *ctx, struct macro_expand_t *e, int64_t cnt);
 static void _dot_print(const char *fmt, ...);
 
 /*
@@ -79,10 +89,8 @@ int lang_label(struct asm_context_t *ctx, struct token_t *token)
     strcpy(name, tname);
     if (*name == '?')
         islocal = 1;
-    if (lang_util_question_expand(&ctx->symbols, name) < 0)
-        goto error;
 
-    s = symbol_find(&ctx->symbols, name);
+    s = symbol_find_scope(&ctx->symbols, name);
     if (s)
     {
         if ((s->type == SYMBOL_TYPE_LABEL && ctx->pass == 0) ||
@@ -121,7 +129,7 @@ int lang_label(struct asm_context_t *ctx, struct token_t *token)
         if (*attr)
             symbol_set_width(s, attr);
     } else {
-        s = symbol_find(&ctx->symbols, name);
+        s = symbol_find_scope(&ctx->symbols, name);
         if (!s || s->type != SYMBOL_TYPE_LABEL)
         {
             /* NOTREACHED */
@@ -131,6 +139,9 @@ int lang_label(struct asm_context_t *ctx, struct token_t *token)
 
         s->val64 = ctx->section->length;
         symbol_set_section(s, ctx->section->name);
+
+        if (ctx->listing && !islocal)
+            listing_label(ctx, s->name);
     }
 
     if (lang_comment(token) < 0)
@@ -140,17 +151,7 @@ int lang_label(struct asm_context_t *ctx, struct token_t *token)
     }
 
     if (!islocal)
-    {
-        struct symbol_t *slabel;
-
-        slabel = symbol_find(&ctx->symbols, SYMBOL_CURRENT_LABEL);
-        if (!slabel)
-        {
-            slabel = symbols_add(&ctx->symbols, SYMBOL_CURRENT_LABEL);
-            slabel->type = SYMBOL_TYPE_NONE;
-        }
-        symbol_set_attr(slabel, "value", name);
-    }
+        symbols_set_scope(&ctx->symbols, s);
 
     return 0;
 error:
@@ -193,8 +194,6 @@ int lang_directive(struct asm_context_t *ctx, struct token_t *token)
             goto error;
         }
         strcpy(name, tname);
-        if (lang_util_question_expand(&ctx->symbols, name) < 0)
-            goto error;
 
         if (symbol_find(&ctx->symbols, name))
         {
@@ -432,34 +431,16 @@ int lang_directive(struct asm_context_t *ctx, struct token_t *token)
             debug_emsg("Invalid endian value should be \"big\" or \"little\"");
             goto error;
         }
-    } else if (
-            strcmp(tname, "d8") == 0 ||
-            strcmp(tname, "d16") == 0 ||
-            strcmp(tname, "d24") == 0 ||
-            strcmp(tname, "d32") == 0 ||
-            strcmp(tname, "d64") == 0)
-    {
-        int width;
-
-        if (strcmp(tname, "d8") == 0)
-            width = 1;
-        else if (strcmp(tname, "d16") == 0)
-            width = 2;
-        else if (strcmp(tname, "d24") == 0)
-            width = 3;
-        else if (strcmp(tname, "d32") == 0)
-            width = 4;
-        else if (strcmp(tname, "d64") == 0)
-            width = 8;
-        else {
-            /* NOTREACHED */
-            debug_emsg("Unsupported .dX");
+    } else if (_lang_dwidth(tname) > 0) {
+        if (_lang_db(ctx, token, _lang_dwidth(tname)) < 0)
+        {
+            debug_emsg("Error in \".dX\" directive");
             goto error;
         }
-
-        if (_lang_db(ctx, token, width) < 0)
+    } else if (strcmp(tname, "table") == 0) {
+        if (_lang_table(ctx, token) < 0)
         {
-            debug_emsg("Error in \".dX\" directive");
+            debug_emsg("Error in \".table\" directive");
             goto error;
         }
     } else if (strcmp(tname, "fill") == 0) {
@@ -566,6 +547,23 @@ int lang_directive(struct asm_context_t *ctx, struct token_t *token)
         }
     } else if (strcmp(tname, "endif") == 0) {
 
+    } else if (strcmp(tname, "macro") == 0) {
+        if (_lang_macro_define(ctx, token) < 0)
+        {
+            debug_emsg("Error in \".macro\" directive");
+            goto error;
+        }
+        return 0;
+    } else if (strcmp(tname, "rept") == 0) {
+        if (_lang_rept(ctx, token) < 0)
+        {
+            debug_emsg("Error in \".rept\" directive");
+            goto error;
+        }
+        return 0;
+    } else if (strcmp(tname, "endm") == 0 || strcmp(tname, "endr") == 0) {
+        debug_emsgf("Unexpected directive", "\".%s\"" NL, tname);
+        goto error;
     } else {
         debug_emsgf("Unknown directive", "\"%s\"" NL, tname);
         goto error;
@@ -584,6 +582,139 @@ error:
     return -1;
 }
 
+/*
+ * Expand macro if current symbol is name of macro.
+ */
+int lang_macro(struct asm_context_t *ctx, struct token_t *token)
+{
+    char *tname;
+    struct macro_t *m;
+    struct macro_expand_t e;
+    char line[TOKEN_STRING_MAX];
+    char *p;
+    int narg;
+
+    if (!(tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_CURRENT)))
+        return -1;
+    if (!(m = macro_find(&ctx->macros, tname)))
+        return -1;
+
+    *line = 0;
+    if ((tname = token_get(token, TOKEN_TYPE_LINE, TOKEN_NEXT)))
+        strcpy(line, tname);
+
+    macro_expand_init(&e, m);
+
+    /*
+     * Split arguments by commas, skip commas inside brackets, strings and
+     * chars.
+     */
+    narg = 0;
+    p    = line;
+    while (1)
+    {
+        char *start, *end;
+        int depth;
+
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+        if (narg == 0 && (*p == ';' || *p == '\n' || *p == 0))
+            break;
+
+        start = p;
+        depth = 0;
+        while (*p && *p != '\n' && !(depth == 0 && (*p == ',' || *p == ';')))
+        {
+            if (*p == '(' || *p == '[' || *p == '{')
+            {
+                depth++;
+            } else if (*p == ')' || *p == ']' || *p == '}') {
+                depth--;
+            } else if (*p == '"' || *p == '\'') {
+                char q;
+
+                q = *p++;
+                while (*p && *p != q && *p != '\n')
+                {
+                    if (*p == '\\' && p[1])
+                        p++;
+                    p++;
+                }
+                if (*p != q)
+                    break;
+            }
+            p++;
+        }
+
+        end = p;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+            end--;
+
+        if (narg >= MACRO_ARGS_MAX)
+        {
+            debug_emsgf("Too much macro arguments", SQ NL, m->name);
+            goto error;
+        }
+        e.args[narg]   = start;
+        e.arglen[narg] = end - start;
+        narg++;
+
+        if (*p != ',')
+            break;
+        p++;
+    }
+
+    if (narg != m->nparams)
+    {
+        debug_emsgf("Wrong number of macro arguments", SQ ", %d given, %d expected" NL,
+                m->name, narg, m->nparams);
+        goto error;
+    }
+
+    if (_lang_expand(ctx, &e, 1) < 0)
+    {
+        debug_emsgf("Error in expansion of macro", SQ NL, m->name);
+        goto error;
+    }
+
+    return 0;
+error:
+    token_print_rollback(token);
+    app_close(APP_EXITCODE_ERROR);
+    return -1;
+}
+
+/*
+ * Skip body of ".macro" or ".rept" block. Used in first pass, where blocks are
+ * not expanded.
+ */
+int lang_skip_block(struct token_t *token)
+{
+    char *tname;
+    char *end;
+
+    if (!token_get(token, TOKEN_TYPE_DOT, TOKEN_CURRENT))
+        return -1;
+    if (!(tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT)))
+        return -1;
+
+    if (strcmp(tname, "macro") == 0)
+        end = "endm";
+    else if (strcmp(tname, "rept") == 0)
+        end = "endr";
+    else
+        return -1;
+
+    if (!token_get(token, TOKEN_TYPE_LINE, TOKEN_NEXT) ||
+            _lang_block(token, end, NULL) < 0)
+    {
+        token_print_rollback(token);
+        app_close(APP_EXITCODE_ERROR);
+    }
+
+    return 0;
+}
+
 /*
  *
  */
@@ -601,6 +732,26 @@ static void _cutvalue(struct asm_context_t *ctx, uint64_t *value, int width)
         *value = host_tole64(*value);
 }
 
+/*
+ * RETURN
+ *     width of data in bytes for ".dX" name, -1 if name is not ".dX"
+ */
+static int _lang_dwidth(char *name)
+{
+    if (strcmp(name, "d8") == 0)
+        return 1;
+    else if (strcmp(name, "d16") == 0)
+        return 2;
+    else if (strcmp(name, "d24") == 0)
+        return 3;
+    else if (strcmp(name, "d32") == 0)
+        return 4;
+    else if (strcmp(name, "d64") == 0)
+        return 8;
+
+    return -1;
+}
+
 /*
  *
  */
@@ -702,6 +853,100 @@ next:
     return -1;
 }
 
+/*
+ * Generate table of data.
+ *
+ *     .table dX, COUNT, {EXPR}
+ *
+ * Expression is evaluated for each index from 0 to COUNT - 1, value of index
+ * is accessible in expression by TABLE_INDEX_SYMBOL. Expression is read from
+ * source once, for following indexes it is replayed from trace buffer of token.
+ */
+static int _lang_table(struct asm_context_t *ctx, struct token_t *token)
+{
+    char *tname;
+    int width;
+    int64_t cnt, i;
+    int64_t value;
+    unsigned long mark;
+    struct symbol_t *sindex;
+    struct bmem_t bmem;
+    uint8_t *pbuf;
+
+    tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT);
+    if (!tname || (width = _lang_dwidth(tname)) < 0)
+    {
+        debug_emsg("Data width (d8, d16, d24, d32 or d64) missing in \".table\" directive");
+        return -1;
+    }
+    token_get(token, TOKEN_TYPE_COMMA, TOKEN_NEXT);
+
+    if (lang_constexpr(&ctx->symbols, token, &value) == 0)
+    {
+        cnt = value;
+    } else if ((tname = token_get(token, TOKEN_TYPE_NUMBER, TOKEN_NEXT))) {
+        if (lang_util_str2num(tname, &cnt) < 0)
+            return -1;
+    } else {
+        debug_emsg("Missing count of data in \".table\" directive");
+        return -1;
+    }
+    if (cnt < 0 || cnt > UINT32_MAX / width)
+    {
+        debug_emsgf("Invalid count of data in \".table\" directive", "%lld" NL, (long long int)cnt);
+        return -1;
+    }
+    token_get(token, TOKEN_TYPE_COMMA, TOKEN_NEXT);
+
+    if (symbol_find(&ctx->symbols, TABLE_INDEX_SYMBOL))
+    {
+        debug_emsgf("Symbol already exists", SQ NL, TABLE_INDEX_SYMBOL);
+        return -1;
+    }
+    sindex = symbols_add(&ctx->symbols, TABLE_INDEX_SYMBOL);
+    symbol_set_const(sindex, 0);
+
+    bmem_init(&bmem);
+    if (bmem_alloc(&bmem, cnt * width) < 0)
+        goto error;
+    pbuf = bmem.buf;
+
+    mark = token_mark(token);
+    /* NOTE expression should be consumed even if table is empty */
+    for (i = 0; i < cnt || i == 0; i++)
+    {
+        if (i && token_rewind(token, mark) < 0)
+        {
+            debug_emsg("Expression too long in \".table\" directive");
+            goto error;
+        }
+
+        sindex->val64 = i;
+        if (lang_constexpr(&ctx->symbols, token, &value) < 0)
+        {
+            debug_emsg("Expression missing in \".table\" directive");
+            goto error;
+        }
+        if (i >= cnt)
+            break;
+
+        _cutvalue(ctx, (uint64_t*)&value, width);
+        memcpy(pbuf, &value, width);
+        pbuf += width;
+    }
+
+    symbol_drop(&ctx->symbols, TABLE_INDEX_SYMBOL);
+    if (cnt)
+        section_pushdata(ctx->section, bmem.buf, cnt * width);
+    bmem_destroy(&bmem);
+
+    return 0;
+error:
+    symbol_drop(&ctx->symbols, TABLE_INDEX_SYMBOL);
+    bmem_destroy(&bmem);
+    return -1;
+}
+
 /*
  *
  */
@@ -715,3 +960,239 @@ static void _dot_print(const char *fmt, ...)
     va_end(va);
 }
 
+/*
+ * Read lines of block until end directive, nested blocks are skipped. If
+ * macro is given, lines are appended to it's body.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _lang_block(struct token_t *token, char *end, struct macro_t *m)
+{
+    char *line;
+    char dname[TOKEN_STRING_MAX];
+    int depth;
+    int i;
+
+    depth = 0;
+    while (1)
+    {
+        line = token_get(token, TOKEN_TYPE_LINE, TOKEN_NEXT);
+        if (!line)
+        {
+            debug_emsgf("Missing end of block", "\".%s\"" NL, end);
+            return -1;
+        }
+
+        *dname = 0;
+        if (*line == '.')
+        {
+            for (i = 0; line[i + 1] == '_' ||
+                    (line[i + 1] >= 'a' && line[i + 1] <= 'z') ||
+                    (line[i + 1] >= 'A' && line[i + 1] <= 'Z') ||
+                    (line[i + 1] >= '0' && line[i + 1] <= '9'); i++)
+                dname[i] = line[i + 1];
+            dname[i] = 0;
+        }
+
+        if (strcmp(dname, "macro") == 0 || strcmp(dname, "rept") == 0)
+        {
+            depth++;
+        } else if (strcmp(dname, "endm") == 0 || strcmp(dname, "endr") == 0) {
+            if (!depth)
+            {
+                if (strcmp(dname, end) == 0)
+                    return 0;
+                debug_emsgf("Unexpected directive", "\".%s\"" NL, dname);
+                return -1;
+            }
+            depth--;
+        }
+
+        if (m)
+            macro_append(m, line);
+    }
+}
+
+/*
+ * .macro NAME [PARAM[, PARAM ...]]
+ */
+static int _lang_macro_define(struct asm_context_t *ctx, struct token_t *token)
+{
+    char *tname;
+    struct macro_t *m;
+
+    tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT);
+    if (!tname)
+    {
+        debug_emsg("Macro name missing");
+        return -1;
+    }
+    if (macro_find(&ctx->macros, tname))
+    {
+        debug_emsgf("Macro redefined", SQ NL, tname);
+        return -1;
+    }
+
+    m = macro_create(tname, token->file.fname, 0);
+
+    while ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT)))
+    {
+        if (macro_add_param(m, tname) < 0)
+            goto error;
+        token_get(token, TOKEN_TYPE_COMMA, TOKEN_NEXT);
+    }
+
+    if (lang_comment(token) < 0)
+    {
+        debug_emsg("Unexpected symbols after macro parameters");
+        goto error;
+    }
+
+    m->line = token->file.line;
+    if (_lang_block(token, "endm", m) < 0)
+        goto error;
+    macro_finish(m);
+
+    macros_add(&ctx->macros, m);
+
+    return 0;
+error:
+    macro_destroy(m);
+    return -1;
+}
+
+/*
+ * .rept COUNT
+ */
+static int _lang_rept(struct asm_context_t *ctx, struct token_t *token)
+{
+    char *tname;
+    int64_t cnt;
+    struct macro_t *m;
+    struct macro_expand_t e;
+
+    if (lang_constexpr(&ctx->symbols, token, &cnt) == 0)
+    {
+
+    } else if ((tname = token_get(token, TOKEN_TYPE_NUMBER, TOKEN_NEXT))) {
+        if (lang_util_str2num(tname, &cnt) < 0)
+            return -1;
+    } else {
+        debug_emsg("Missing count of repeats");
+        return -1;
+    }
+
+    if (lang_comment(token) < 0)
+    {
+        debug_emsg("Unexpected symbols after count of repeats");
+        return -1;
+    }
+
+    m = macro_create("rept", token->file.fname, token->file.line);
+    if (_lang_block(token, "endr", m) < 0)
+        goto error;
+    macro_finish(m);
+
+    macro_expand_init(&e, m);
+    if (_lang_expand(ctx, &e, cnt) < 0)
+    {
+        debug_emsg("Error in expansion of repeat block");
+        goto error;
+    }
+
+    macro_destroy(m);
+    return 0;
+error:
+    macro_destroy(m);
+    return -1;
+}
+
+/*
+ * Prepare token to read body of macro from start.
+ */
+static void _lang_expand_prepare(struct token_t *etoken, struct macro_expand_t *e)
+{
+    e->segment = 0;
+    e->kseg    = 0;
+    e->kstart  = 0;
+    token_prepare_fetch(etoken, e->macro->fname, e->macro->line, macro_fetch, e);
+    token_prepare_record(etoken, &e->macro->record, macro_key);
+}
+
+/*
+ * Register labels of body as first pass does it. Each expansion gets it's own
+ * scope, so local labels of body are unique in every expansion, local labels
+ * of outer scope are still visible.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _lang_expand_labels(struct asm_context_t *ctx, struct token_t *etoken,
+        struct macro_expand_t *e)
+{
+    char name[TOKEN_STRING_MAX * 2];
+    struct listing_t *listing;
+    struct symbol_t *scope;
+    int pass;
+    int error;
+
+    snprintf(name, sizeof(name), "%s#%d", e->macro->name, ++ctx->nexpand);
+    scope = symbols_add_scope(&ctx->symbols, name);
+
+    pass    = ctx->pass;
+    listing = ctx->listing;
+
+    ctx->pass    = 0;
+    ctx->listing = NULL;
+    _lang_expand_prepare(etoken, e);
+    error = assembler_parse(ctx, etoken);
+
+    ctx->pass    = pass;
+    ctx->listing = listing;
+    symbols_set_scope(&ctx->symbols, scope);
+
+    return error;
+}
+
+/*
+ * Assemble body of macro cnt times. Body is feeded to token directly from
+ * memory of macro, without copying, lexing of body is recorded on first
+ * expansion and replayed on next ones. Scope of local labels is restored
+ * after expansion.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _lang_expand(struct asm_context_t *ctx, struct macro_expand_t *e, int64_t cnt)
+{
+    struct token_t *etoken;
+    struct symbol_t *scope;
+    int error;
+
+    if (ctx->expand >= EXPAND_DEPTH_MAX)
+    {
+        debug_emsgf("Expansion nested too deep", SQ NL, e->macro->name);
+        return -1;
+    }
+
+    ctx->expand++;
+    etoken = token_new(&ctx->tokens);
+    scope  = ctx->symbols.scope;
+
+    error = 0;
+    while (cnt-- > 0)
+    {
+        if (e->macro->labels && (error = _lang_expand_labels(ctx, etoken, e)) < 0)
+            break;
+        _lang_expand_prepare(etoken, e);
+        if ((error = assembler_parse(ctx, etoken)) < 0)
+            break;
+    }
+
+    symbols_set_scope(&ctx->symbols, scope);
+    token_remove(&ctx->tokens, etoken);
+    ctx->expand--;
+
+    return error;
+}
@@ -35,6 +35,8 @@ int lang_comment(struct token_t *token);
 int lang_eof(struct token_t *token);
 int lang_label(struct asm_context_t *ctx, struct token_t *token);
 int lang_directive(struct asm_context_t *ctx, struct token_t *token);
+int lang_macro(struct asm_context_t *ctx, struct token_t *token);
+int lang_skip_block(struct token_t *token);
 
 #endif
 
@@ -38,6 +38,7 @@
 #include "assembler.h"
 #include "section.h"
 #include "symbol.h"
+#include "listing.h"
 
 //#define DEBUG_THIS
 
@@ -228,9 +229,6 @@ static int _get_arg(struct asm_context_t *ctx, struct arg_t *arg, struct token_t
             arg->type = ARG_TYPE_CC;
         else {
             strcpy(name, tname);
-            if (lang_util_question_expand(&ctx->symbols, name) < 0)
-                return GETARG_RESULT_ERROR;
-
             symbol = symbol_find(&ctx->symbols, name);
             if (symbol)
             {
@@ -629,6 +627,9 @@ struct gen_info_t {
     uint32_t flag;
 };
 
+static void _relax_info(struct relocation_t *r, struct gen_info_t *geninfo, struct gen_info_t *gen,
+        struct arg_t *args, struct arg_t *arg);
+
 static const struct gen_info_t _gen_info_adc[] = {
     {ARG_TYPE_A, ARG_TYPE_BYTE       , ARG_TYPE_NONE, ARG_TYPE_NONE, PREBYTE_NONE, 0xA9, 1, GEN_FLAG_NONE},
     {ARG_TYPE_A, ARG_TYPE_SHORTMEM   , ARG_TYPE_NONE, ARG_TYPE_NONE, PREBYTE_NONE, 0xB9, 1, GEN_FLAG_NONE},
@@ -1565,8 +1566,9 @@ static int _assemble_uni(struct asm_context_t *ctx, struct arg_t *args, struct g
                         return -1;
                     }
 
-                    relocations_add(&ctx->relocations, ctx->section->name, arg->symbol->name,
-                            ctx->section->length, gen->arglen, 0, RELOCATION_TYPE_ABOSULTE);
+                    _relax_info(relocations_add(&ctx->relocations, ctx->section->name, arg->symbol->name,
+                                ctx->section->length, gen->arglen, 0, RELOCATION_TYPE_ABOSULTE),
+                            geninfo, gen, args, arg);
                 } else {
                     if (gen->arglen == 2)
                         value = host_tobe16(arg->value);
@@ -1611,6 +1613,73 @@ static const struct gen_info_t _gen_info_jrc[]   = { {ARG_TYPE_SHORTMEM, ARG_TYP
 static const struct gen_info_t _gen_info_jrult[] = { {ARG_TYPE_SHORTMEM, ARG_TYPE_NONE, ARG_TYPE_NONE, ARG_TYPE_NONE, PREBYTE_NONE, 0x25, 1, GEN_FLAG_NONE}, };
 static const struct gen_info_t _gen_info_jrv[]   = { {ARG_TYPE_SHORTMEM, ARG_TYPE_NONE, ARG_TYPE_NONE, ARG_TYPE_NONE, PREBYTE_NONE, 0x29, 1, GEN_FLAG_NONE}, };
 
+/*
+ * Record short form of instruction which operand is longmem symbol, so
+ * linker may relax it when value of symbol is known: entry of same table
+ * with shortmem operand, or "callr"/"jra" for "call"/"jp". Form is recorded
+ * only if it is shorter.
+ */
+static void _relax_info(struct relocation_t *r, struct gen_info_t *geninfo, struct gen_info_t *gen,
+        struct arg_t *args, struct arg_t *arg)
+{
+    struct gen_info_t *sgen;
+    enum arg_type_t stype;
+    int n, i;
+
+    if (gen->arglen != 2)
+        return;
+
+    if (geninfo == (struct gen_info_t*)_gen_info_call || geninfo == (struct gen_info_t*)_gen_info_jp)
+    {
+        if (arg->type != ARG_TYPE_LONGMEM)
+            return;
+
+        r->relax.kind    = RELOCATION_RELAX_RELATIVE;
+        r->relax.head    = 1;
+        r->relax.prebyte = PREBYTE_NONE;
+        r->relax.opcode  = geninfo == (struct gen_info_t*)_gen_info_call ?
+            _gen_info_callr[0].opcode : _gen_info_jra[0].opcode;
+        return;
+    }
+
+    switch (arg->type)
+    {
+        case ARG_TYPE_LONGMEM:   stype = ARG_TYPE_SHORTMEM;   break;
+        case ARG_TYPE_LONGOFF_X: stype = ARG_TYPE_SHORTOFF_X; break;
+        case ARG_TYPE_LONGOFF_Y: stype = ARG_TYPE_SHORTOFF_Y; break;
+        default:
+            return;
+    }
+    n = arg - args;
+
+    for (sgen = geninfo; !(sgen->flag & GEN_FLAG_END); sgen++)
+    {
+        enum arg_type_t gtypes[4] = {gen->arg0, gen->arg1, gen->arg2, gen->arg3};
+        enum arg_type_t stypes[4] = {sgen->arg0, sgen->arg1, sgen->arg2, sgen->arg3};
+
+        if (sgen->arglen != 1 || (sgen->flag & (GEN_FLAG_CHECK_LONG | GEN_FLAG_CHECK_EXT)) ||
+                (sgen->flag & GEN_FLAG_ARG_DST) != (gen->flag & GEN_FLAG_ARG_DST))
+            continue;
+        for (i = 0; i < 4; i++)
+        {
+            if (stypes[i] != (i == n ? stype : gtypes[i]))
+                break;
+        }
+        if (i < 4)
+            continue;
+
+        /* prebyte and opcode of short form are not longer, operand is one byte less */
+        if ((sgen->prebyte != PREBYTE_NONE) > (gen->prebyte != PREBYTE_NONE))
+            return;
+
+        r->relax.kind    = RELOCATION_RELAX_SHORT;
+        r->relax.head    = gen->prebyte != PREBYTE_NONE ? 2 : 1;
+        r->relax.prebyte = sgen->prebyte;
+        r->relax.opcode  = sgen->opcode;
+        return;
+    }
+}
+
 /*
  *
  */
@@ -1933,6 +2002,187 @@ static int _assemble_mov(struct asm_context_t *ctx, struct arg_t *args, struct g
     return -1;
 }
 
+/*
+ * Cycles of instructions (see PM0044, STM8 CPU programming manual). Cycles
+ * of instruction form are selected by it's arguments: register only,
+ * memory/immediate, or indirect (pointer). Conditional jumps take extra
+ * cycles when jump is taken, DIV/DIVW take up to extra cycles depending on
+ * operands.
+ */
+struct cycle_info_t {
+    char *name;
+    uint8_t cycles;  /* memory or immediate operand */
+    uint8_t rcycles; /* register operands only or no operands */
+    uint8_t pcycles; /* indirect operand */
+    uint8_t xcycles; /* extra cycles, if jump taken */
+};
+
+static const struct cycle_info_t _cycle_info[] = {
+    {"adc"   ,  1,  1,  4,  0},
+    {"add"   ,  1,  1,  4,  0},
+    {"addw"  ,  2,  2,  2,  0},
+    {"and"   ,  1,  1,  4,  0},
+    {"bccm"  ,  1,  1,  1,  0},
+    {"bcp"   ,  1,  1,  4,  0},
+    {"bcpl"  ,  1,  1,  1,  0},
+    {"break" ,  1,  1,  1,  0},
+    {"bres"  ,  1,  1,  1,  0},
+    {"bset"  ,  1,  1,  1,  0},
+    {"btjf"  ,  2,  2,  2,  1},
+    {"btjt"  ,  2,  2,  2,  1},
+    {"call"  ,  4,  4,  6,  0},
+    {"callf" ,  5,  5,  8,  0},
+    {"callr" ,  4,  4,  4,  0},
+    {"ccf"   ,  1,  1,  1,  0},
+    {"clr"   ,  1,  1,  4,  0},
+    {"clrw"  ,  1,  1,  1,  0},
+    {"cp"    ,  1,  1,  4,  0},
+    {"cpw"   ,  2,  2,  5,  0},
+    {"cpl"   ,  1,  1,  4,  0},
+    {"cplw"  ,  2,  2,  2,  0},
+    {"dec"   ,  1,  1,  4,  0},
+    {"decw"  ,  1,  1,  1,  0},
+    {"div"   ,  2,  2,  2, 15},
+    {"divw"  ,  2,  2,  2, 15},
+    {"exg"   ,  3,  1,  3,  0},
+    {"exgw"  ,  1,  1,  1,  0},
+    {"halt"  , 10, 10, 10,  0},
+    {"inc"   ,  1,  1,  4,  0},
+    {"incw"  ,  1,  1,  1,  0},
+    {"int"   ,  2,  2,  2,  0},
+    {"iret"  , 11, 11, 11,  0},
+    {"jp"    ,  1,  1,  5,  0},
+    {"jpf"   ,  2,  2,  6,  0},
+    {"jra"   ,  2,  2,  2,  0},
+    {"jreq"  ,  1,  1,  1,  1},
+    {"jrf"   ,  1,  1,  1,  0},
+    {"jrh"   ,  1,  1,  1,  1},
+    {"jrih"  ,  1,  1,  1,  1},
+    {"jril"  ,  1,  1,  1,  1},
+    {"jrm"   ,  1,  1,  1,  1},
+    {"jrmi"  ,  1,  1,  1,  1},
+    {"jrnc"  ,  1,  1,  1,  1},
+    {"jrne"  ,  1,  1,  1,  1},
+    {"jrnh"  ,  1,  1,  1,  1},
+    {"jrnm"  ,  1,  1,  1,  1},
+    {"jrnv"  ,  1,  1,  1,  1},
+    {"jrpl"  ,  1,  1,  1,  1},
+    {"jrsge" ,  1,  1,  1,  1},
+    {"jrsgt" ,  1,  1,  1,  1},
+    {"jrsle" ,  1,  1,  1,  1},
+    {"jrslt" ,  1,  1,  1,  1},
+    {"jrt"   ,  2,  2,  2,  0},
+    {"jruge" ,  1,  1,  1,  1},
+    {"jrugt" ,  1,  1,  1,  1},
+    {"jrule" ,  1,  1,  1,  1},
+    {"jrc"   ,  1,  1,  1,  1},
+    {"jrult" ,  1,  1,  1,  1},
+    {"jrv"   ,  1,  1,  1,  1},
+    {"ld"    ,  1,  1,  4,  0},
+    {"ldf"   ,  1,  1,  5,  0},
+    {"ldw"   ,  2,  1,  5,  0},
+    {"mov"   ,  1,  1,  1,  0},
+    {"neg"   ,  1,  1,  4,  0},
+    {"negw"  ,  2,  2,  2,  0},
+    {"mul"   ,  4,  4,  4,  0},
+    {"nop"   ,  1,  1,  1,  0},
+    {"or"    ,  1,  1,  4,  0},
+    {"pop"   ,  1,  1,  1,  0},
+    {"popw"  ,  2,  2,  2,  0},
+    {"push"  ,  1,  1,  1,  0},
+    {"pushw" ,  2,  2,  2,  0},
+    {"rcf"   ,  1,  1,  1,  0},
+    {"ret"   ,  4,  4,  4,  0},
+    {"retf"  ,  5,  5,  5,  0},
+    {"rim"   ,  1,  1,  1,  0},
+    {"rlc"   ,  1,  1,  4,  0},
+    {"rlcw"  ,  2,  2,  2,  0},
+    {"rlwa"  ,  1,  1,  1,  0},
+    {"rrc"   ,  1,  1,  4,  0},
+    {"rrcw"  ,  2,  2,  2,  0},
+    {"rrwa"  ,  1,  1,  1,  0},
+    {"rvf"   ,  1,  1,  1,  0},
+    {"sbc"   ,  1,  1,  4,  0},
+    {"scf"   ,  1,  1,  1,  0},
+    {"sim"   ,  1,  1,  1,  0},
+    {"sll"   ,  1,  1,  4,  0},
+    {"sla"   ,  1,  1,  4,  0},
+    {"sllw"  ,  2,  2,  2,  0},
+    {"slaw"  ,  2,  2,  2,  0},
+    {"sra"   ,  1,  1,  4,  0},
+    {"sraw"  ,  2,  2,  2,  0},
+    {"srl"   ,  1,  1,  4,  0},
+    {"srlw"  ,  2,  2,  2,  0},
+    {"sub"   ,  1,  1,  4,  0},
+    {"subw"  ,  2,  2,  2,  0},
+    {"swap"  ,  1,  1,  4,  0},
+    {"swapw" ,  1,  1,  1,  0},
+    {"tnz"   ,  1,  1,  4,  0},
+    {"tnzw"  ,  2,  2,  2,  0},
+    {"trap"  ,  9,  9,  9,  0},
+    {"wfi"   , 10, 10, 10,  0},
+    {"wfe"   ,  1,  1,  1,  0},
+    {"xor"   ,  1,  1,  4,  0},
+    {NULL, 0, 0, 0, 0},
+};
+
+/*
+ *
+ */
+static void _cycles(struct asm_context_t *ctx, char *name, struct arg_t *args)
+{
+    struct cycle_info_t *ci;
+    int i, cycles, reg, ptr;
+
+    for (ci = (struct cycle_info_t*)_cycle_info; ci->name; ci++)
+    {
+        if (strcmp(ci->name, name) == 0)
+            break;
+    }
+    if (!ci->name)
+        return;
+
+    reg = 1;
+    ptr = 0;
+    for (i = 0; i < ARGS_MAX; i++)
+    {
+        switch (args[i].type)
+        {
+            case ARG_TYPE_NONE:
+            case ARG_TYPE_A:
+            case ARG_TYPE_X:
+            case ARG_TYPE_Y:
+            case ARG_TYPE_SP:
+            case ARG_TYPE_XL:
+            case ARG_TYPE_YL:
+            case ARG_TYPE_XH:
+            case ARG_TYPE_YH:
+            case ARG_TYPE_CC:
+                break;
+            case ARG_TYPE_SHORTPTR_X:
+            case ARG_TYPE_LONGPTR_X:
+            case ARG_TYPE_SHORTPTR_Y:
+            case ARG_TYPE_LONGPTR_Y:
+            case ARG_TYPE_SHORTPTR:
+            case ARG_TYPE_LONGPTR:
+                ptr = 1;
+                reg = 0;
+                break;
+            default:
+                reg = 0;
+        }
+    }
+
+    if (ptr)
+        cycles = ci->pcycles;
+    else if (reg)
+        cycles = ci->rcycles;
+    else
+        cycles = ci->cycles;
+
+    listing_cycles(ctx, cycles, cycles + ci->xcycles);
+}
+
 /*
  *
  */
@@ -2068,6 +2318,8 @@ static int _assemble(struct asm_context_t *ctx, char *name, struct arg_t *args)
             debug_emsgf("Invalid arguments to instruction", "\"%s\"" NL, name);
             return -1;
         } else {
+            if (ctx->listing)
+                _cycles(ctx, name, args);
             return 0;
         }
     }
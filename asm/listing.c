@@ -0,0 +1,253 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+/* */
+#include "app.h"
+#include "debug.h"
+#include "assembler.h"
+#include "listing.h"
+
+#define LISTING_BYTES_PER_LINE  8
+
+static void _print_subtotal(struct listing_t *l);
+
+/*
+ * Open listing file, listing is written while assembling in second pass.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int listing_open(struct asm_context_t *ctx, char *path)
+{
+    struct listing_t *l;
+
+    l = malloc(sizeof(struct listing_t));
+    if (!l)
+    {
+        debug_emsg("Can not allocate memory for listing");
+        return -1;
+    }
+    memset(l, 0, sizeof(struct listing_t));
+
+    l->fp = fopen(path, "w");
+    if (!l->fp)
+    {
+        debug_emsgf("Failed to open listing file", "%s, %s" NL, path, strerror(errno));
+        free(l);
+        return -1;
+    }
+
+    fprintf(l->fp, "OFFSET  BYTES                    CYCLES  SOURCE" NL);
+    ctx->listing = l;
+
+    return 0;
+}
+
+/*
+ *
+ */
+void listing_close(struct asm_context_t *ctx)
+{
+    struct listing_t *l;
+
+    l = ctx->listing;
+    if (!l)
+        return;
+
+    listing_flush(ctx);
+    _print_subtotal(l);
+
+    fclose(l->fp);
+    free(l);
+    ctx->listing = NULL;
+}
+
+/*
+ * Start new source line. Text of line is peeked from token, input is
+ * returned back, so parsing is not affected.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int listing_line(struct asm_context_t *ctx, struct token_t *token)
+{
+    struct listing_t *l;
+    unsigned long mark;
+    char *line;
+    char *ch;
+
+    l = ctx->listing;
+
+    listing_flush(ctx);
+
+    mark = token_mark(token);
+    line = token_get(token, TOKEN_TYPE_LINE, TOKEN_NEXT);
+    if (line)
+        strcpy(l->text, line);
+    else
+        *l->text = 0;
+    if (token_rewind(token, mark) < 0)
+    {
+        debug_emsg("Source line too long for listing");
+        return -1;
+    }
+
+    for (ch = l->text; *ch; ch++)
+    {
+        if (*ch == '\n' || *ch == '\r')
+        {
+            *ch = 0;
+            break;
+        }
+    }
+
+    l->pending = 1;
+    l->section = ctx->section;
+    l->offset  = ctx->section->length;
+    l->expand  = ctx->expand;
+    l->cmin    = 0;
+    l->cmax    = 0;
+
+    return 0;
+}
+
+/*
+ * Print pending line with data emitted since start of line.
+ */
+void listing_flush(struct asm_context_t *ctx)
+{
+    struct listing_t *l;
+    struct section_t *s;
+    uint32_t offset, length;
+    char bytes[LISTING_BYTES_PER_LINE * 3 + 1];
+    char cycles[16];
+    int first;
+
+    l = ctx->listing;
+    if (!l || !l->pending)
+        return;
+    l->pending = 0;
+
+    if (!*l->text)
+        return;
+
+    s = l->section;
+    if (s != l->psection)
+    {
+        fprintf(l->fp, "; section \"%s\"" NL, s->name);
+        l->psection = s;
+    }
+
+    *cycles = 0;
+    if (l->cmax)
+    {
+        if (l->cmin == l->cmax)
+            sprintf(cycles, "%d", l->cmin);
+        else
+            sprintf(cycles, "%d/%d", l->cmin, l->cmax);
+    }
+
+    offset = l->offset;
+    length = 0;
+    if (s->length > l->offset)
+        length = s->length - l->offset;
+
+    first = 1;
+    do {
+        uint32_t i, n;
+
+        n = length > LISTING_BYTES_PER_LINE ? LISTING_BYTES_PER_LINE : length;
+        *bytes = 0;
+        if (!s->noload && s->data)
+        {
+            for (i = 0; i < n; i++)
+                sprintf(&bytes[i * 3], "%02X ", (uint8_t)s->data[offset + i]);
+            if (n)
+                bytes[n * 3 - 1] = 0;
+        }
+
+        if (first)
+            fprintf(l->fp, "%06X  %-24s %-7s %s%s" NL, offset, bytes, cycles,
+                    l->expand ? "+ " : "", l->text);
+        else
+            fprintf(l->fp, "%06X  %s" NL, offset, bytes);
+
+        offset += n;
+        length -= n;
+        first = 0;
+    } while (length);
+}
+
+/*
+ * Start subtotal of cycles for label. Local labels are counted in subtotal of
+ * label they belong to.
+ */
+void listing_label(struct asm_context_t *ctx, char *name)
+{
+    struct listing_t *l;
+
+    l = ctx->listing;
+
+    _print_subtotal(l);
+
+    strcpy(l->label, name);
+    l->lmin = 0;
+    l->lmax = 0;
+}
+
+/*
+ * Add cycles of instruction to current line.
+ */
+void listing_cycles(struct asm_context_t *ctx, int cmin, int cmax)
+{
+    struct listing_t *l;
+
+    l = ctx->listing;
+
+    l->cmin += cmin;
+    l->cmax += cmax;
+    l->lmin += cmin;
+    l->lmax += cmax;
+}
+
+/*
+ *
+ */
+static void _print_subtotal(struct listing_t *l)
+{
+    if (!*l->label || !l->lmax)
+        return;
+
+    if (l->lmin == l->lmax)
+        fprintf(l->fp, "; cycles of \"%s\": %lu" NL NL, l->label, l->lmin);
+    else
+        fprintf(l->fp, "; cycles of \"%s\": %lu/%lu" NL NL, l->label, l->lmin, l->lmax);
+}
+
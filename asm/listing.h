@@ -0,0 +1,66 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#ifndef _LISTING_H
+#define _LISTING_H
+
+#include <stdio.h>
+/* */
+#include <token.h>
+#include <section.h>
+
+struct asm_context_t;
+
+struct listing_t {
+    FILE *fp;
+
+    /* current source line */
+    int pending;
+    char text[TOKEN_STRING_MAX];
+    struct section_t *section;
+    uint32_t offset;
+    int expand; /* line is part of macro/repeat expansion */
+    int cmin;  /* cycles of line, minimal */
+    int cmax;  /* cycles of line, maximal (branch taken) */
+
+    struct section_t *psection; /* section of last printed line */
+
+    /* cycles subtotal of current label */
+    char label[TOKEN_STRING_MAX];
+    unsigned long lmin;
+    unsigned long lmax;
+};
+
+int listing_open(struct asm_context_t *ctx, char *path);
+void listing_close(struct asm_context_t *ctx);
+int listing_line(struct asm_context_t *ctx, struct token_t *token);
+void listing_flush(struct asm_context_t *ctx);
+void listing_label(struct asm_context_t *ctx, char *name);
+void listing_cycles(struct asm_context_t *ctx, int cmin, int cmax);
+
+#endif
+
@@ -0,0 +1,409 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#include <stdlib.h>
+#include <string.h>
+/* */
+#include "app.h"
+#include "debug.h"
+#include "macro.h"
+
+#define MACRO_BODY_PREALLOC_SIZE   1024
+
+static void _macro_destroy(void *p);
+
+/*
+ *
+ */
+void macros_init(struct macros_t *ml)
+{
+    ml->first = NULL;
+}
+
+/*
+ *
+ */
+void macros_destroy(struct macros_t *ml)
+{
+    if (ml)
+        llist_destroy(ml->first);
+}
+
+/*
+ *
+ */
+void macros_add(struct macros_t *ml, struct macro_t *m)
+{
+    struct llist_t *head;
+
+    head = llist_add(ml->first, m, _macro_destroy, m);
+    if (!head)
+    {
+        debug_emsg("Can not add macro");
+        macro_destroy(m);
+        app_close(APP_EXITCODE_ERROR);
+        return;
+    }
+    ml->first = head;
+}
+
+/*
+ *
+ */
+struct macro_t *macro_find(struct macros_t *ml, char *name)
+{
+    struct llist_t *ll;
+    struct macro_t *m;
+
+    for (ll = ml->first; ll; ll = ll->next)
+    {
+        m = ll->p;
+        if (strcmp(m->name, name) == 0)
+            return m;
+    }
+
+    return NULL;
+}
+
+/*
+ *
+ */
+struct macro_t *macro_create(char *name, char *fname, int line)
+{
+    struct macro_t *m;
+
+    m = malloc(sizeof(struct macro_t));
+    if (!m)
+        goto error;
+    memset(m, 0, sizeof(struct macro_t));
+
+    m->name = malloc(strlen(name) + 1);
+    if (!m->name)
+        goto error;
+    strcpy(m->name, name);
+    m->fname = malloc(strlen(fname) + 1);
+    if (!m->fname)
+        goto error;
+    strcpy(m->fname, fname);
+    m->line = line;
+
+    return m;
+error:
+    debug_emsg("Can not create macro");
+    if (m)
+        macro_destroy(m);
+    app_close(APP_EXITCODE_ERROR);
+    return NULL;
+}
+
+/*
+ *
+ */
+void macro_destroy(struct macro_t *m)
+{
+    int i;
+
+    if (!m)
+        return;
+
+    if (m->name)
+        free(m->name);
+    if (m->fname)
+        free(m->fname);
+    for (i = 0; i < m->nparams; i++)
+        free(m->params[i]);
+    if (m->params)
+        free(m->params);
+    if (m->body)
+        free(m->body);
+    if (m->segments)
+        free(m->segments);
+    token_record_destroy(&m->record);
+    free(m);
+}
+
+/*
+ *
+ */
+static void _macro_destroy(void *p)
+{
+    macro_destroy(p);
+}
+
+/*
+ * RETURN
+ *     0 on success, -1 if parameter already exists or too much parameters
+ */
+int macro_add_param(struct macro_t *m, char *name)
+{
+    char **params;
+    int i;
+
+    for (i = 0; i < m->nparams; i++)
+    {
+        if (strcmp(m->params[i], name) == 0)
+        {
+            debug_emsgf("Macro parameter redefined", SQ NL, name);
+            return -1;
+        }
+    }
+    if (m->nparams >= MACRO_ARGS_MAX)
+    {
+        debug_emsgf("Too much macro parameters", SQ NL, m->name);
+        return -1;
+    }
+
+    params = realloc(m->params, sizeof(char*) * (m->nparams + 1));
+    if (!params)
+        goto error;
+    m->params = params;
+
+    m->params[m->nparams] = malloc(strlen(name) + 1);
+    if (!m->params[m->nparams])
+        goto error;
+    strcpy(m->params[m->nparams], name);
+    m->nparams++;
+
+    return 0;
+error:
+    debug_emsg("Can not add macro parameter");
+    app_close(APP_EXITCODE_ERROR);
+    return -1;
+}
+
+/*
+ * Append line of text to macro body.
+ */
+void macro_append(struct macro_t *m, char *text)
+{
+    uint32_t length;
+
+    length = strlen(text);
+    if (m->length + length > m->alength)
+    {
+        void *p;
+
+        m->alength += MACRO_BODY_PREALLOC_SIZE;
+        if (m->alength < m->length + length)
+            m->alength = m->length + length;
+
+        p = realloc(m->body, m->alength);
+        if (!p)
+        {
+            debug_emsg("Can not allocate memory for macro body");
+            app_close(APP_EXITCODE_ERROR);
+            return;
+        }
+        m->body = p;
+    }
+
+    memcpy(&m->body[m->length], text, length);
+    m->length += length;
+}
+
+/*
+ *
+ */
+static void _add_segment(struct macro_t *m, uint32_t offset, uint32_t length, int param)
+{
+    struct macro_segment_t *segment;
+
+    if (!length)
+        return;
+
+    /* join adjacent text */
+    if (param < 0 && m->nsegments)
+    {
+        segment = &m->segments[m->nsegments - 1];
+        if (segment->param < 0 && segment->offset + segment->length == offset)
+        {
+            segment->length += length;
+            return;
+        }
+    }
+
+    segment = realloc(m->segments, sizeof(struct macro_segment_t) * (m->nsegments + 1));
+    if (!segment)
+    {
+        debug_emsg("Can not allocate memory for macro segment");
+        app_close(APP_EXITCODE_ERROR);
+        return;
+    }
+    m->segments = segment;
+
+    segment = &m->segments[m->nsegments++];
+    segment->offset = offset;
+    segment->length = length;
+    segment->param  = param;
+}
+
+/*
+ *
+ */
+static int _isword(char ch)
+{
+    return (ch == '_') || (ch == '?') || (ch == '$') || (ch == '@') ||
+        (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9');
+}
+
+/*
+ * Split body to plain text and references to parameters. Parameter is
+ * referenced by it's name, names inside strings, chars and comments are
+ * not replaced. Colon outside of them marks body that may define labels.
+ */
+void macro_finish(struct macro_t *m)
+{
+    uint32_t i, start;
+    char *body;
+
+    body  = m->body;
+    start = 0;
+    i     = 0;
+    while (i < m->length)
+    {
+        char ch;
+
+        ch = body[i];
+        if (ch == ';')
+        {
+            while (i < m->length && body[i] != '\n')
+                i++;
+        } else if (ch == '"' || ch == '\'') {
+            i++;
+            while (i < m->length && body[i] != ch && body[i] != '\n')
+            {
+                if (body[i] == '\\')
+                    i++;
+                i++;
+            }
+            i++;
+        } else if (_isword(ch)) {
+            uint32_t wstart;
+            int p;
+
+            wstart = i;
+            while (i < m->length && _isword(body[i]))
+                i++;
+
+            for (p = 0; p < m->nparams; p++)
+            {
+                if (strlen(m->params[p]) == i - wstart &&
+                        strncmp(m->params[p], &body[wstart], i - wstart) == 0)
+                    break;
+            }
+            if (p < m->nparams)
+            {
+                _add_segment(m, start, wstart - start, -1);
+                _add_segment(m, wstart, i - wstart, p);
+                start = i;
+            }
+        } else {
+            if (ch == ':')
+                m->labels = 1;
+            i++;
+        }
+    }
+    if (i > m->length)
+        i = m->length;
+
+    _add_segment(m, start, i - start, -1);
+
+    token_record_init(&m->record, m->length);
+}
+
+/*
+ *
+ */
+void macro_expand_init(struct macro_expand_t *e, struct macro_t *m)
+{
+    memset(e, 0, sizeof(struct macro_expand_t));
+    e->macro = m;
+}
+
+/*
+ * Fetch function for token. Return chunks of body, parameters replaced by
+ * arguments of expansion.
+ */
+int macro_fetch(void *arg, char **pbuf)
+{
+    struct macro_expand_t *e;
+    struct macro_segment_t *segment;
+
+    e = arg;
+    while (e->segment < e->macro->nsegments)
+    {
+        segment = &e->macro->segments[e->segment++];
+        if (segment->param < 0)
+        {
+            *pbuf = &e->macro->body[segment->offset];
+            return segment->length;
+        }
+        if (e->arglen[segment->param])
+        {
+            *pbuf = e->args[segment->param];
+            return e->arglen[segment->param];
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Key function for token record. Position in input is translated to offset
+ * in body, positions inside of arguments are not recorded, since arguments
+ * differ from one expansion to other.
+ */
+long macro_key(void *arg, unsigned long pos, unsigned long *start, unsigned long *end)
+{
+    struct macro_expand_t *e;
+    struct macro_segment_t *segment;
+    uint32_t length;
+
+    e = arg;
+    segment = NULL;
+    while (pos < e->kstart && e->kseg > 0)
+    {
+        e->kseg--;
+        segment = &e->macro->segments[e->kseg];
+        e->kstart -= segment->param < 0 ? segment->length : e->arglen[segment->param];
+    }
+    while (e->kseg < e->macro->nsegments)
+    {
+        segment = &e->macro->segments[e->kseg];
+        length  = segment->param < 0 ? segment->length : e->arglen[segment->param];
+        if (pos < e->kstart + length)
+            break;
+        e->kstart += length;
+        e->kseg++;
+    }
+    if (e->kseg >= e->macro->nsegments || segment->param >= 0)
+        return -1;
+
+    *start = e->kstart;
+    *end   = e->kstart + segment->length;
+    return segment->offset;
+}
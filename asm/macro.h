@@ -0,0 +1,101 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#ifndef _MACRO_H
+#define _MACRO_H
+
+/* */
+#include <llist.h>
+#include <types.h>
+#include <token.h>
+
+/*
+ * Body of macro is splitted once on definition to chunks of plain text and
+ * references to parameters, so expansion only walk thru this chunks.
+ */
+struct macro_segment_t {
+    uint32_t offset; /* offset of text in body */
+    uint32_t length; /* length of text */
+    int param;       /* index of parameter, -1 for plain text */
+};
+
+struct macro_t {
+    char *name;
+    char *fname;     /* file where macro was defined */
+    int line;        /* line of first line of body */
+
+    int nparams;
+    char **params;
+
+    char *body;
+    uint32_t length;
+    uint32_t alength;
+
+    struct macro_segment_t *segments;
+    int nsegments;
+
+    int labels;                   /* body may define labels */
+    struct token_record_t record; /* lexing of body, keyed by offset in body */
+};
+
+struct macros_t {
+    struct llist_t *first;
+};
+
+/*
+ * State of macro expansion, used as argument of token fetch function.
+ */
+struct macro_expand_t {
+#define MACRO_ARGS_MAX  32
+    struct macro_t *macro;
+    char *args[MACRO_ARGS_MAX];
+    int arglen[MACRO_ARGS_MAX];
+
+    int segment; /* next segment to fetch */
+
+    /* segment of last position translated to key of record */
+    int kseg;
+    unsigned long kstart; /* position of it's start in input */
+};
+
+void macros_init(struct macros_t *ml);
+void macros_destroy(struct macros_t *ml);
+void macros_add(struct macros_t *ml, struct macro_t *m);
+struct macro_t *macro_find(struct macros_t *ml, char *name);
+
+struct macro_t *macro_create(char *name, char *fname, int line);
+void macro_destroy(struct macro_t *m);
+int macro_add_param(struct macro_t *m, char *name);
+void macro_append(struct macro_t *m, char *text);
+void macro_finish(struct macro_t *m);
+
+void macro_expand_init(struct macro_expand_t *e, struct macro_t *m);
+int macro_fetch(void *arg, char **pbuf);
+long macro_key(void *arg, unsigned long pos, unsigned long *start, unsigned long *end);
+
+#endif
+
@@ -29,10 +29,14 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 /* */
 #include <debug.h>
 #include <l0.h>
 #include <version.h>
+#include <watch.h>
 #include "app.h"
 #include "lang_util.h"
 #include "assembler.h"
@@ -43,6 +47,13 @@ struct app_context_t app;
 static void app_init(int argc, char** argv);
 static void app_run();
 static void _get_options(int argc, char** argv);
+static void _define(char *def, int override);
+static void _apply_defines();
+static void _watch();
+static int _update_file(char *tmppath, char *path);
+static void _suffix_path(char *path, char *name);
+static void _assemble(char *outputfile, char *listingfile);
+static void _run_variants();
 static void _print_head();
 static void _print_help(int argc, char **argv);
 
@@ -53,7 +64,10 @@ int main(int argc, char** argv)
 {
     app_init(argc, argv);
 
-    app_run();
+    if (app.watch)
+        _watch();
+    else
+        app_run();
     app_close(APP_EXITCODE_OK);
     return 0;
 }
@@ -102,12 +116,21 @@ static void app_init(int argc, char** argv)
 
     *app.inputfile  = 0;
     *app.outputfile = 0;
+    *app.listingfile = 0;
     app.printresult = 0;
     app.noprint     = 0;
+    app.ndefines    = 0;
+    app.nvariants   = 0;
+    app.watch       = 0;
+    app.watchjmp    = NULL;
+    app.jobs        = sysconf(_SC_NPROCESSORS_ONLN);
+    if (app.jobs < 1)
+        app.jobs = 1;
 
     assembler_init();
 
     _get_options(argc, argv);
+    _apply_defines();
 }
 
 /*
@@ -118,8 +141,23 @@ static void app_run()
     if (assembler(app.asmcontext, app.inputfile) < 0)
         app_close(APP_EXITCODE_ERROR);
     app.asmcontext->pass++;
+
+    if (app.nvariants)
+        _run_variants();
+    else
+        _assemble(app.outputfile, app.listingfile);
+}
+
+/*
+ * Second pass of assembling and output of result.
+ */
+static void _assemble(char *outputfile, char *listingfile)
+{
+    if (*listingfile && listing_open(app.asmcontext, listingfile) < 0)
+        app_close(APP_EXITCODE_ERROR);
     if (assembler(app.asmcontext, app.inputfile) < 0)
         app_close(APP_EXITCODE_ERROR);
+    listing_close(app.asmcontext);
 
     if (app.printresult)
         assembler_print_result(app.asmcontext);
@@ -139,13 +177,198 @@ static void app_run()
         }
     }
 
-    if (l0_save(app.outputfile,
+    if (app.watch)
+    {
+        char tmppath[PATH_MAX + 4];
+
+        /*
+         * Object is replaced only if it's content changed, so linker
+         * watching it does not relink without need.
+         */
+        snprintf(tmppath, sizeof(tmppath), "%s.tmp", outputfile);
+        if (l0_save(tmppath,
+                &app.asmcontext->symbols,
+                &app.asmcontext->relocations,
+                &app.asmcontext->sections) < 0)
+        {
+            app_close(APP_EXITCODE_ERROR);
+        }
+        if (_update_file(tmppath, outputfile))
+            debug_imsgf("Object updated", "%s" NL, outputfile);
+        else
+            debug_imsgf("Object not changed", "%s" NL, outputfile);
+    } else if (l0_save(outputfile,
             &app.asmcontext->symbols,
             &app.asmcontext->relocations,
-            &app.asmcontext->sections) < 0)
+            &app.asmcontext->sections) < 0) {
+        app_close(APP_EXITCODE_ERROR);
+    }
+}
+
+/*
+ * Replace file with new one if their content differ, remove new file
+ * otherwise.
+ *
+ * RETURN
+ *     1 if file replaced, 0 otherwise
+ */
+static int _update_file(char *tmppath, char *path)
+{
+    FILE *fa, *fb;
+    int ca, cb;
+
+    fa = fopen(tmppath, "r");
+    fb = fopen(path, "r");
+    ca = cb = EOF;
+    if (fa && fb)
+    {
+        do {
+            ca = fgetc(fa);
+            cb = fgetc(fb);
+        } while (ca == cb && ca != EOF);
+    }
+    if (fa)
+        fclose(fa);
+    if (fb)
+        fclose(fb);
+
+    if (fa && fb && ca == cb)
+    {
+        unlink(tmppath);
+        return 0;
+    }
+
+    if (rename(tmppath, path) < 0)
     {
+        debug_emsgf("Failed to rename file", "%s, %s" NL, tmppath, strerror(errno));
+        unlink(tmppath);
         app_close(APP_EXITCODE_ERROR);
     }
+    return 1;
+}
+
+/*
+ * Assemble input file, then reassemble it each time it or any included file
+ * changed. Errors of assembling does not terminate program, instead
+ * app_close() returns here to wait for next change.
+ */
+static void _watch()
+{
+    struct watch_t w;
+    struct llist_t *ll;
+    jmp_buf env;
+
+    watch_init(&w);
+    while (1)
+    {
+        if (setjmp(env) == 0)
+        {
+            app.watchjmp = &env;
+            app_run();
+        }
+        app.watchjmp = NULL;
+
+        watch_clear(&w);
+        watch_add(&w, app.inputfile);
+        for (ll = app.asmcontext->files; ll; ll = ll->next)
+            watch_add(&w, ll->p);
+
+        assembler_destroy();
+        assembler_init();
+        _apply_defines();
+
+        debug_imsg("Waiting for changes");
+        fflush(stdout);
+        watch_wait(&w);
+    }
+}
+
+/*
+ * First pass registers labels only and does not depend on constants, so it
+ * is done once. Each variant is assembled from state after first pass in
+ * child process, up to app.jobs variants at once.
+ */
+static void _run_variants()
+{
+    pid_t pids[VARIANTS_MAX];
+    int next, running, failed;
+    int i;
+
+    next    = 0;
+    running = 0;
+    failed  = 0;
+    while (next < app.nvariants || running)
+    {
+        if (next < app.nvariants && running < app.jobs)
+        {
+            pid_t pid;
+
+            fflush(stdout);
+            pid = fork();
+            if (pid < 0)
+            {
+                debug_emsg("Failed to create process for variant");
+                failed = 1;
+                break;
+            }
+
+            if (pid == 0)
+            {
+                char outputfile[PATH_MAX];
+                char listingfile[PATH_MAX];
+                char defs[TOKEN_STRING_MAX * 2 + 1];
+                char *def, *ch;
+
+                app.watchjmp = NULL;
+
+                strncpy(defs, app.variants[next].defs, sizeof(defs) - 1);
+                defs[sizeof(defs) - 1] = 0;
+                for (def = defs; def && *def; def = ch)
+                {
+                    ch = strchr(def, ',');
+                    if (ch)
+                        *ch++ = 0;
+                    _define(def, 1);
+                }
+
+                strcpy(outputfile, app.outputfile);
+                _suffix_path(outputfile, app.variants[next].name);
+                strcpy(listingfile, app.listingfile);
+                if (*listingfile)
+                    _suffix_path(listingfile, app.variants[next].name);
+
+                _assemble(outputfile, listingfile);
+                app_close(APP_EXITCODE_OK);
+            }
+
+            pids[next++] = pid;
+            running++;
+        } else {
+            pid_t pid;
+            int status;
+
+            pid = wait(&status);
+            if (pid < 0)
+                break;
+            running--;
+
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != APP_EXITCODE_OK)
+            {
+                for (i = 0; i < next; i++)
+                {
+                    if (pids[i] == pid)
+                        debug_emsgf("Failed to assemble variant", SQ NL, app.variants[i].name);
+                }
+                failed = 1;
+            }
+        }
+    }
+
+    while (running && wait(NULL) > 0)
+        running--;
+
+    if (failed)
+        app_close(APP_EXITCODE_ERROR);
 }
 
 /*
@@ -153,6 +376,9 @@ static void app_run()
  */
 void app_close(int code)
 {
+    if (app.watchjmp && code != APP_EXITCODE_SIGTERM)
+        longjmp(*app.watchjmp, 1);
+
     assembler_destroy();
     exit(code);
 }
@@ -182,6 +408,12 @@ static void _print_help(int argc, char **argv)
     printf("    -p, --noprint      suppress \".print\" directive" NL);
     printf("    -D<symbol>=<value> define constant symbol" NL);
     printf("    --output=<path>    output file" NL);
+    printf("    --listing=<path>   write listing with offsets, data and cycles of instructions" NL);
+    printf("    --variant=<name>[,<symbol>=<value>...]" NL);
+    printf("                       assemble variant with additional constants, output" NL);
+    printf("                       file name is suffixed with \"_<name>\", may be repeated" NL);
+    printf("    --jobs=<n>         number of variants assembled in parallel" NL);
+    printf("    -w, --watch        stay resident and reassemble on change of sources" NL);
 
     printf(NL);
 }
@@ -192,9 +424,7 @@ static void _print_help(int argc, char **argv)
 static void _get_options(int argc, char** argv)
 {
     int i;
-    char symbol[TOKEN_STRING_MAX * 2 + 1];
 
-    *symbol = 0;
     if (argc <= 1)
     {
         _print_help(argc, argv);
@@ -209,36 +439,47 @@ static void _get_options(int argc, char** argv)
             app_close(APP_EXITCODE_ERROR);
         } else if (strcmp("-I", argv[i]) == 0 || strcmp("--info", argv[i]) == 0) {
             app.printresult = 1;
-        } else if (sscanf(argv[i], "-D%s", symbol)) {
-            char *ch;
-            int64_t value;
-            struct symbol_t *s;
-
-            ch = symbol;
-            while (*ch)
-            {
-                if (*ch == '=')
-                {
-                    *ch = 0;
-                    ch++;
-                    break;
-                }
-                ch++;
-            }
-            if (!*ch)
+        } else if (strncmp(argv[i], "-D", 2) == 0 && argv[i][2]) {
+            if (app.ndefines >= DEFINES_MAX)
             {
-                debug_emsg("No value followed \"-D\"" NL);
+                debug_emsg("Too much constants defined");
                 app_close(APP_EXITCODE_ERROR);
             }
-            if (lang_util_str2num(ch, &value) < 0)
-                app_close(APP_EXITCODE_ERROR);
-
-            s = symbols_add(&app.asmcontext->symbols, symbol);
-            symbol_set_const(s, value);
+            app.defines[app.ndefines++] = &argv[i][2];
         } else if (strcmp("-p", argv[i]) == 0 || strcmp("--noprint", argv[i]) == 0) {
             app.noprint = 1;
         } else if (sscanf(argv[i], "--output=%s", app.outputfile)) {
 
+        } else if (sscanf(argv[i], "--listing=%s", app.listingfile)) {
+
+        } else if (strncmp(argv[i], "--variant=", 10) == 0) {
+            char *ch;
+
+            if (app.nvariants >= VARIANTS_MAX)
+            {
+                debug_emsg("Too much variants");
+                app_close(APP_EXITCODE_ERROR);
+            }
+
+            app.variants[app.nvariants].name = &argv[i][10];
+            app.variants[app.nvariants].defs = "";
+            ch = strchr(&argv[i][10], ',');
+            if (ch)
+            {
+                *ch = 0;
+                app.variants[app.nvariants].defs = ch + 1;
+            }
+            if (!*app.variants[app.nvariants].name)
+            {
+                debug_emsg("No name of variant given");
+                app_close(APP_EXITCODE_ERROR);
+            }
+            app.nvariants++;
+        } else if (strcmp("-w", argv[i]) == 0 || strcmp("--watch", argv[i]) == 0) {
+            app.watch = 1;
+        } else if (sscanf(argv[i], "--jobs=%d", &app.jobs)) {
+            if (app.jobs < 1)
+                app.jobs = 1;
         } else {
             if (i == argc - 1)
             {
@@ -284,3 +525,86 @@ static void _get_options(int argc, char** argv)
     }
 }
 
+/*
+ * Define constant symbol from "<symbol>=<value>" string. If override is set,
+ * value of already defined constant is replaced.
+ */
+static void _define(char *def, int override)
+{
+    char symbol[TOKEN_STRING_MAX * 2 + 1];
+    char *ch;
+    int64_t value;
+    struct symbol_t *s;
+
+    strncpy(symbol, def, sizeof(symbol) - 1);
+    symbol[sizeof(symbol) - 1] = 0;
+
+    ch = symbol;
+    while (*ch)
+    {
+        if (*ch == '=')
+        {
+            *ch = 0;
+            ch++;
+            break;
+        }
+        ch++;
+    }
+    if (!*ch)
+    {
+        debug_emsg("No value followed \"-D\"" NL);
+        app_close(APP_EXITCODE_ERROR);
+    }
+    if (lang_util_str2num(ch, &value) < 0)
+        app_close(APP_EXITCODE_ERROR);
+
+    s = symbol_find(&app.asmcontext->symbols, symbol);
+    if (!override || !s || s->type != SYMBOL_TYPE_CONST)
+        s = symbols_add(&app.asmcontext->symbols, symbol);
+    symbol_set_const(s, value);
+}
+
+/*
+ * Define constants given in command line.
+ */
+static void _apply_defines()
+{
+    int i;
+
+    for (i = 0; i < app.ndefines; i++)
+        _define(app.defines[i], 0);
+}
+
+/*
+ * Insert "_<name>" before extension of file name.
+ */
+static void _suffix_path(char *path, char *name)
+{
+    char ext[PATH_MAX];
+    char *dot, *ch;
+
+    dot = NULL;
+    for (ch = path; *ch; ch++)
+    {
+        if (*ch == '.')
+            dot = ch;
+        if (*ch == '/')
+            dot = NULL;
+    }
+
+    *ext = 0;
+    if (dot)
+    {
+        strcpy(ext, dot);
+        *dot = 0;
+    }
+
+    if (strlen(path) + strlen(name) + strlen(ext) + 2 > PATH_MAX)
+    {
+        debug_emsg("Path of variant output too long");
+        app_close(APP_EXITCODE_ERROR);
+    }
+    strcat(path, "_");
+    strcat(path, name);
+    strcat(path, ext);
+}
@@ -131,3 +131,11 @@ uint32_t le32to_host(uint32_t num)
     return le32toh(num);
 }
 
+/*
+ *
+ */
+uint64_t le64to_host(uint64_t num)
+{
+    return le64toh(num);
+}
+
@@ -43,6 +43,7 @@ uint64_t host_tole64(uint64_t num);
 
 uint16_t le16to_host(uint16_t num);
 uint32_t le32to_host(uint32_t num);
+uint64_t le64to_host(uint64_t num);
 
 #endif
 
@@ -32,6 +32,8 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <stddef.h>
 /* */
 #include <debug.h>
 #include <types.h>
@@ -39,7 +41,6 @@
 #include <btorder.h>
 //#include <token.h>
 #include "l0.h"
-#include "bmem.h"
 
 #if 1
     #define PRINTF(...) printf(__VA_ARGS__)
@@ -50,6 +51,9 @@
 
 #pragma pack(push, 1)
 
+/*
+ * Version 1. Sequence of variable length blocks following file head.
+ */
 struct l0_file_head_t {
 #define L0_HEAD_MAGIC    0x00306C2E
     uint32_t magic;
@@ -102,392 +106,1017 @@ struct l0_section_block_t {
     /* data */
 };
 
-#pragma pack(pop)
 
-static uint16_t _block_cs(struct l0_block_info_t *block);
+/*
+ * Version 2. Head holds directory of string table, fixed size arrays of
+ * symbols, relocations and sections. Names are referenced by offset in string
+ * table, section data is placed contiguously after arrays. Tables are padded
+ * to L0_V2_ALIGN so arrays are aligned in file.
+ *
+ *     head | strings | symbols | relocations | sections | data
+ */
+#define L0_V2_ALIGN    8
+
+struct l0_v2_table_t {
+    uint32_t offset; /* offset from start of file */
+    uint32_t count;  /* number of records, length in bytes for string table */
+};
+
+struct l0_v2_head_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved0;
+    uint32_t crc;    /* CRC32 of head after this field and of all tables */
+    uint32_t reserved1;
+    struct l0_v2_table_t strings;
+    struct l0_v2_table_t symbols;
+    struct l0_v2_table_t relocations;
+    struct l0_v2_table_t sections;
+};
 
-#define CURRENT_VERSION 0x0001
+struct l0_v2_symbol_t {
+#define L0_V2_SYMBOL_EXPORT    0x01
+#define L0_V2_SYMBOL_EXTERN    0x02
+    uint32_t name;
+    uint32_t section; /* 0 (empty string) if none */
+    int64_t  value;
+    uint8_t  flags;
+    uint8_t  width;
+    uint8_t  reserved[6];
+};
 
+struct l0_v2_relocation_t {
+    uint32_t symbol;
+    uint32_t section;
+    uint32_t offset; /* offset of fixup from start of section */
+    uint32_t length; /* length of fixup */
+    int32_t  adj;    /* adjust offset of relative fixup */
+    uint8_t  type;
+    /* short form of instruction, zero if it can not be relaxed */
+#define L0_V2_RELAX_KIND(r)    ((r) & 0x0F)
+#define L0_V2_RELAX_HEAD(r)    ((r) >> 4)
+    uint8_t  relax;   /* kind in low nibble, length of prebyte and opcode in high */
+    uint8_t  prebyte;
+    uint8_t  opcode;
+};
 
+struct l0_v2_section_t {
+#define L0_V2_SECTION_NOLOAD   0x01
+    uint32_t name;
+    uint32_t flags;
+    uint32_t offset; /* offset of data from start of file */
+    uint32_t length;
+    uint32_t crc;    /* CRC32 of data */
+    uint32_t reserved;
+};
 
 /*
+ * Archive. Head holds directory of string table, array of members and array
+ * of symbols exported by members, sorted by name. Members are objects stored
+ * as is, aligned to L0_V2_ALIGN.
  *
+ *     head | strings | members | symbols | data of members
+ */
+struct l0_archive_head_t {
+#define L0_ARCHIVE_MAGIC    0x61306C2E
+#define L0_ARCHIVE_VERSION  0x0001
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved0;
+    uint32_t crc;    /* CRC32 of head after this field and of all tables */
+    uint32_t reserved1;
+    struct l0_v2_table_t strings;
+    struct l0_v2_table_t members;
+    struct l0_v2_table_t symbols;
+    uint8_t reserved2[8];
+};
+
+struct l0_archive_member_t {
+    uint32_t name;
+    uint32_t offset; /* offset of object from start of file */
+    uint32_t length;
+    uint32_t reserved;
+};
+
+struct l0_archive_symbol_t {
+    uint32_t name;
+    uint32_t member; /* index of member which exports symbol */
+};
+
+#pragma pack(pop)
+
+/*
+ * Growing buffer used to build tables of file.
+ */
+struct _l0_buf_t {
+    char *p;
+    uint32_t length;
+    uint32_t alength;
+};
+
+/*
+ * String table with hash of offsets to find duplicates.
+ */
+struct _l0_strtab_t {
+    struct _l0_buf_t buf;
+    uint32_t *hash; /* offset + 1 of string, 0 if slot is empty */
+    uint32_t hsize; /* power of 2 */
+    uint32_t nstrings;
+};
+
+static uint16_t _block_cs(struct l0_block_info_t *block);
+static char *_block_string(char *str, char *bend);
+static uint32_t _crc32(uint32_t crc, void *buf, uint32_t length);
+static void *_buf_append(struct _l0_buf_t *b, void *data, uint32_t length);
+static int _buf_align(struct _l0_buf_t *b);
+static int _write_all(int fd, char *buf, uint32_t length);
+static int _write_file(char *fpath, char *buf, uint32_t length);
+static void _sync_dir(char *fpath);
+static int _map_file(char *fpath, struct l0_map_t *map);
+static int _archive_index_cmp(const void *a, const void *b);
+static char *_basename(char *path);
+static int _strtab_init(struct _l0_strtab_t *st);
+static void _strtab_destroy(struct _l0_strtab_t *st);
+static uint32_t _strtab_hash(char *str);
+static int _strtab_add(struct _l0_strtab_t *st, char *str, uint32_t *offset);
+static int _l0_load_v1(char *pbuf, char *pend,
+        struct symbols_t *symbols,
+        struct sections_t *sections,
+        struct relocations_t *relocations);
+static int _l0_load_v2(char *pbuf, char *pend,
+        struct symbols_t *symbols,
+        struct sections_t *sections,
+        struct relocations_t *relocations);
+
+#define CURRENT_VERSION 0x0002
+
+#define L0_TMP_SUFFIX   ".XXXXXX" /* template of temporary file for mkstemp() */
+
+/*
+ * Write object in format of current version.
  */
 int l0_save(char *fpath,
         struct symbols_t *symbols,
         struct relocations_t *relocations,
         struct sections_t *sections)
 {
-    int fd;
-    int wr;
-    int wlen;
-    mode_t mode;
-    struct l0_file_head_t head;
+    struct l0_v2_head_t *head;
+    struct _l0_buf_t meta;
+    struct _l0_strtab_t strtab;
     struct llist_t *ll;
-    struct bmem_t bmem;
-    struct l0_block_info_t *iblock;
-    char *pbuf;
-
-    bmem_init(&bmem);
+    uint32_t count, doffset;
 
-    mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
-    umask(~mode);
-    fd = open(fpath, O_WRONLY | O_CREAT | O_TRUNC, mode);
-    if (fd < 0)
-    {
-        debug_emsgf("Failed to open file", "\"%s\": %s" NL, fpath, strerror(errno));
-        return -1;
-    }
+    meta.p       = NULL;
+    meta.length  = 0;
+    meta.alength = 0;
 
-    /* write head */
-    {
-        wlen = sizeof(struct l0_file_head_t);
-        memset(&head, 0, wlen);
-        head.magic   = host_tole32(L0_HEAD_MAGIC);
-        head.version = host_tole32(CURRENT_VERSION);
+    if (_strtab_init(&strtab) < 0)
+        goto error;
 
-        wr = write(fd, &head, wlen);
-        if (wr != wlen)
-            goto error;
-    }
+    /* make head, filled when all tables are known */
+    if (!_buf_append(&meta, NULL, sizeof(struct l0_v2_head_t)))
+        goto error;
 
-    /* write symbols */
+    /* collect names to string table */
     for (ll = symbols->first; ll; ll = ll->next)
     {
-        struct symbol_t *s;
-        uint32_t length;
-        struct l0_symbol_block_t *sblock;
-        char *section;
-        char nosection[1];
-
-        nosection[0] = 0;
-
-        s = ll->p;
-
-        if (s->type == SYMBOL_TYPE_NONE)
-            continue;
+        struct symbol_t *s = ll->p;
 
         if (s->type != SYMBOL_TYPE_LABEL && s->type != SYMBOL_TYPE_EXTERN)
             continue;
-
-        section = NULL;
-        if (s->section)
-            section = s->section;
-        else if (s->type != SYMBOL_TYPE_LABEL)
-            section = nosection;
-
-        if (!section)
+        if (!s->section && s->type == SYMBOL_TYPE_LABEL)
         {
             debug_emsgf("Symbol has not section attribute", "\"%s\"" NL, s->name);
             goto error;
         }
-
-        length  = sizeof(struct l0_block_info_t);
-        length += sizeof(struct l0_symbol_block_t);
-        length += strlen(s->name) + 1;
-        length += strlen(section) + 1;
-
-        if (bmem_alloc(&bmem, length) < 0)
+        if (_strtab_add(&strtab, s->name, NULL) < 0)
             goto error;
-
-        pbuf = bmem.buf;
-
-        /* make iblock */
-        {
-            iblock = (struct l0_block_info_t*)pbuf;
-
-            memset(iblock, 0, sizeof(struct l0_block_info_t));
-            iblock->magic  = host_tole16(L0_SYMBOL_MAGIC);
-            iblock->length = host_tole32(length);
-
-            pbuf += sizeof(struct l0_block_info_t);
-        }
-
-        /* write symbol block head */
-        {
-            sblock = (struct l0_symbol_block_t*)pbuf;
-
-            memset(sblock, 0, sizeof(struct l0_symbol_block_t));
-            sblock->flag.exp = s->exp;
-            sblock->flag.ext = s->type == SYMBOL_TYPE_EXTERN ? 1 : 0;
-            sblock->width    = s->width;
-            sblock->value    = s->val64;
-
-            pbuf += sizeof(struct l0_symbol_block_t);
-        }
-
-        /* write symbol name */
-        {
-            strcpy(pbuf, s->name);
-            pbuf += strlen(s->name) + 1;
-        }
-
-        /* write symbol's section name */
-        {
-            strcpy(pbuf, section);
-            pbuf += strlen(section) + 1;
-        }
-
-        /* make cs for iblock */
-        iblock->cs = host_tole16(_block_cs(iblock));
-
-        /* write to file */
-        wr = write(fd, bmem.buf, length);
-        if (wr != length)
+        if (s->section && _strtab_add(&strtab, s->section, NULL) < 0)
             goto error;
     }
-
-    /* write relocations */
     for (ll = relocations->first; ll; ll = ll->next)
     {
-        struct relocation_t *r;
-        uint32_t length;
-        struct l0_relocation_block_t *rblock;
-
-        r = ll->p;
-
-        length  = sizeof(struct l0_block_info_t);
-        length += sizeof(struct l0_relocation_block_t);
-        length += strlen(r->symbol)  + 1;
-        length += strlen(r->section) + 1;
+        struct relocation_t *r = ll->p;
 
-        if (bmem_alloc(&bmem, length) < 0)
+        if (_strtab_add(&strtab, r->symbol, NULL) < 0 ||
+                _strtab_add(&strtab, r->section, NULL) < 0)
             goto error;
+    }
+    for (ll = sections->first; ll; ll = ll->next)
+    {
+        struct section_t *s = ll->p;
 
-        pbuf = bmem.buf;
-
-        /* make iblock */
-        {
-            iblock = (struct l0_block_info_t*)pbuf;
+        if (s->length && _strtab_add(&strtab, s->name, NULL) < 0)
+            goto error;
+    }
 
-            memset(iblock, 0, sizeof(struct l0_block_info_t));
-            iblock->magic  = host_tole16(L0_RELOCATION_MAGIC);
-            iblock->length = host_tole32(length);
+    /* write string table */
+    head = (struct l0_v2_head_t *)meta.p;
+    head->strings.offset = host_tole32(meta.length);
+    head->strings.count  = host_tole32(strtab.buf.length);
+    if (!_buf_append(&meta, strtab.buf.p, strtab.buf.length) || _buf_align(&meta) < 0)
+        goto error;
 
-            pbuf += sizeof(struct l0_block_info_t);
-        }
+    /* write symbols */
+    count = 0;
+    doffset = meta.length;
+    for (ll = symbols->first; ll; ll = ll->next)
+    {
+        struct symbol_t *s = ll->p;
+        struct l0_v2_symbol_t *rec;
+        uint32_t name, section;
 
-        /* write relocation block head */
-        {
-            rblock = (struct l0_relocation_block_t *)pbuf;
+        if (s->type != SYMBOL_TYPE_LABEL && s->type != SYMBOL_TYPE_EXTERN)
+            continue;
 
-            memset(rblock, 0, sizeof(struct l0_relocation_block_t));
-            rblock->type   = r->type;
-            rblock->offset = host_tole32(r->offset);
-            rblock->length = host_tole32(r->length);
-            rblock->adj    = host_tole32(r->adjust);
+        section = 0;
+        _strtab_add(&strtab, s->name, &name);
+        if (s->section)
+            _strtab_add(&strtab, s->section, &section);
 
-            pbuf += sizeof(struct l0_relocation_block_t);
-        }
+        rec = _buf_append(&meta, NULL, sizeof(struct l0_v2_symbol_t));
+        if (!rec)
+            goto error;
 
-        /* write symbol name */
-        {
-            strcpy(pbuf, r->symbol);
-            pbuf += strlen(r->symbol) + 1;
-        }
+        rec->name    = host_tole32(name);
+        rec->section = host_tole32(section);
+        rec->value   = host_tole64(s->val64);
+        rec->width   = s->width;
+        if (s->exp)
+            rec->flags |= L0_V2_SYMBOL_EXPORT;
+        if (s->type == SYMBOL_TYPE_EXTERN)
+            rec->flags |= L0_V2_SYMBOL_EXTERN;
+        count++;
+    }
+    head = (struct l0_v2_head_t *)meta.p;
+    head->symbols.offset = host_tole32(doffset);
+    head->symbols.count  = host_tole32(count);
 
-        /* write symbol's section name */
-        {
-            strcpy(pbuf, r->section);
-            pbuf += strlen(r->section) + 1;
-        }
+    /* write relocations */
+    count = 0;
+    doffset = meta.length;
+    for (ll = relocations->first; ll; ll = ll->next)
+    {
+        struct relocation_t *r = ll->p;
+        struct l0_v2_relocation_t *rec;
+        uint32_t symbol, section;
 
-        /* make cs for iblock */
-        iblock->cs = host_tole16(_block_cs(iblock));
+        _strtab_add(&strtab, r->symbol, &symbol);
+        _strtab_add(&strtab, r->section, &section);
 
-        /* write to file */
-        wr = write(fd, bmem.buf, length);
-        if (wr != length)
+        rec = _buf_append(&meta, NULL, sizeof(struct l0_v2_relocation_t));
+        if (!rec)
             goto error;
+
+        rec->symbol  = host_tole32(symbol);
+        rec->section = host_tole32(section);
+        rec->offset  = host_tole32(r->offset);
+        rec->length  = host_tole32(r->length);
+        rec->adj     = host_tole32(r->adjust);
+        rec->type    = r->type;
+        rec->relax   = r->relax.kind | (r->relax.head << 4);
+        rec->prebyte = r->relax.prebyte;
+        rec->opcode  = r->relax.opcode;
+        count++;
     }
+    head = (struct l0_v2_head_t *)meta.p;
+    head->relocations.offset = host_tole32(doffset);
+    head->relocations.count  = host_tole32(count);
 
-    /* write sections */
+    /* write section directory, data placed after it */
+    count = 0;
     for (ll = sections->first; ll; ll = ll->next)
     {
-        struct section_t *s;
-        uint32_t length;
-        struct l0_section_block_t *sblock;
+        if (((struct section_t *)ll->p)->length)
+            count++;
+    }
+    head = (struct l0_v2_head_t *)meta.p;
+    head->sections.offset = host_tole32(meta.length);
+    head->sections.count  = host_tole32(count);
 
-        s = ll->p;
+    doffset = meta.length + count * sizeof(struct l0_v2_section_t);
+    for (ll = sections->first; ll; ll = ll->next)
+    {
+        struct section_t *s = ll->p;
+        struct l0_v2_section_t *rec;
+        uint32_t name;
 
         /* drop empty section */
         if (s->length == 0)
             continue;
 
-        length  = sizeof(struct l0_block_info_t);
-        length += sizeof(struct l0_section_block_t);
-        length += strlen(s->name) + 1;
-        if (!s->noload)
-            length += s->length;
+        _strtab_add(&strtab, s->name, &name);
 
-        if (bmem_alloc(&bmem, length) < 0)
+        rec = _buf_append(&meta, NULL, sizeof(struct l0_v2_section_t));
+        if (!rec)
             goto error;
 
-        pbuf = bmem.buf;
-
-        /* make iblock */
-        {
-            iblock = (struct l0_block_info_t*)pbuf;
-
-            memset(iblock, 0, sizeof(struct l0_block_info_t));
-            iblock->magic  = host_tole16(L0_SECTION_MAGIC);
-            iblock->length = host_tole32(length);
-
-            pbuf += sizeof(struct l0_block_info_t);
-        }
-
-        /* write section block head */
-        {
-            sblock = (struct l0_section_block_t *)pbuf;
-
-            memset(sblock, 0, sizeof(struct l0_section_block_t));
-            sblock->flag.noload = s->noload;
-            sblock->length      = host_tole32(s->length);
-
-            pbuf += sizeof(struct l0_section_block_t);
-        }
-
-        /* write section name */
+        rec->name   = host_tole32(name);
+        rec->length = host_tole32(s->length);
+        if (s->noload)
         {
-            strcpy(pbuf, s->name);
-            pbuf += strlen(s->name) + 1;
+            rec->flags = host_tole32(L0_V2_SECTION_NOLOAD);
+        } else {
+            rec->offset = host_tole32(doffset);
+            rec->crc    = host_tole32(_crc32(0, s->data, s->length));
+            doffset += s->length;
         }
+    }
 
-        /* write section's data */
-        if (!s->noload)
-            memcpy(pbuf, s->data, s->length);
+    head = (struct l0_v2_head_t *)meta.p;
+    head->magic   = host_tole32(L0_HEAD_MAGIC);
+    head->version = host_tole16(CURRENT_VERSION);
+    head->crc     = host_tole32(_crc32(0, &head->reserved1,
+                meta.length - offsetof(struct l0_v2_head_t, reserved1)));
 
-        /* make cs for iblock */
-        iblock->cs = host_tole16(_block_cs(iblock));
+    /* section data follows tables in same buffer, so file is written at once */
+    for (ll = sections->first; ll; ll = ll->next)
+    {
+        struct section_t *s = ll->p;
 
-        /* write to file */
-        wr = write(fd, bmem.buf, length);
-        if (wr != length)
+        if (s->noload || s->length == 0)
+            continue;
+        if (!_buf_append(&meta, s->data, s->length))
             goto error;
     }
 
-    close(fd);
-    bmem_destroy(&bmem);
+    if (_write_file(fpath, meta.p, meta.length) < 0)
+        goto error;
+
+    free(meta.p);
+    _strtab_destroy(&strtab);
     return 0;
 error:
-    debug_emsgf("Failed to write file", "\"%s\": %s" NL, fpath, strerror(errno));
-    bmem_destroy(&bmem);
+    if (meta.p)
+        free(meta.p);
+    _strtab_destroy(&strtab);
     return -1;
 }
 
 /*
+ * File is written to temporary file in same directory, then renamed, so
+ * existing file is either kept or replaced with complete one. Data is
+ * flushed to disk before rename, so crash can not leave renamed file
+ * without its data.
  *
+ * RETURN
+ *     0 on success, -1 on error
  */
-int l0_load(char *fpath,
-        struct symbols_t *symbols,
-        struct sections_t *sections,
-        struct relocations_t *relocations)
+static int _write_file(char *fpath, char *buf, uint32_t length)
 {
     int fd;
-    int rd;
-    int rlen;
-    struct l0_file_head_t *head;
-    struct l0_block_info_t *iblock;
-    struct bmem_t bmem;
+    mode_t mode;
+    char *tmppath;
 
-    fd = open(fpath, O_RDONLY);
+    tmppath = malloc(strlen(fpath) + sizeof(L0_TMP_SUFFIX));
+    if (!tmppath)
+    {
+        debug_emsg("Can not allocate memory");
+        return -1;
+    }
+    strcpy(tmppath, fpath);
+    strcat(tmppath, L0_TMP_SUFFIX);
+
+    fd = mkstemp(tmppath);
     if (fd < 0)
     {
         debug_emsgf("Failed to open file", "\"%s\": %s" NL, fpath, strerror(errno));
+        free(tmppath);
         return -1;
     }
 
-    bmem_init(&bmem);
-
-    /* read file head */
+    mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    if (fchmod(fd, mode) < 0)
+        goto error;
+    if (_write_all(fd, buf, length) < 0)
+        goto error;
+    if (fsync(fd) < 0)
+        goto error;
+    if (close(fd) < 0)
     {
-        rlen = sizeof(struct l0_file_head_t);
-        if (bmem_alloc(&bmem, rlen) < 0)
-            goto error;
+        fd = -1;
+        goto error;
+    }
+    fd = -1;
 
-        rd = read(fd, bmem.buf, rlen);
-        if (rd != rlen)
-            goto error;
-        head = bmem.buf;
+    if (rename(tmppath, fpath) < 0)
+        goto error;
+    _sync_dir(fpath);
 
-        if (head->magic != le32to_host(L0_HEAD_MAGIC))
-        {
-            debug_emsg("File format error");
-            goto error;
-        }
-        if (head->version != le32to_host(CURRENT_VERSION))
-        {
-            debug_emsg("File format version mismatch");
-            goto error;
-        }
+    free(tmppath);
+    return 0;
+error:
+    debug_emsgf("Failed to write file", "\"%s\": %s" NL, fpath, strerror(errno));
+    if (fd >= 0)
+        close(fd);
+    if (tmppath)
+    {
+        unlink(tmppath);
+        free(tmppath);
     }
+    return -1;
+}
 
-    while (1)
-    {
-        off_t bpos;
-        uint32_t length;
-        char *pbuf;
+/*
+ * Flush directory of file, so rename of file is on disk. File is already
+ * replaced, so failure is not reported.
+ */
+static void _sync_dir(char *fpath)
+{
+    char *dpath, *slash;
+    int fd;
 
-        bpos = lseek(fd, 0, SEEK_CUR);
-        if (bpos == (off_t)-1)
-            goto error;
+    dpath = malloc(strlen(fpath) + 2);
+    if (!dpath)
+        return;
+    strcpy(dpath, fpath);
+    slash = strrchr(dpath, '/');
+    if (slash)
+        slash[slash == dpath ? 1 : 0] = 0;
+    else
+        strcpy(dpath, ".");
+
+    fd = open(dpath, O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    free(dpath);
+}
 
-        rlen = sizeof(struct l0_block_info_t);
-        if (bmem_alloc(&bmem, rlen) < 0)
-            goto error;
+/*
+ * Write whole buffer, continuing after partial write or interrupt.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _write_all(int fd, char *buf, uint32_t length)
+{
+    ssize_t wr;
 
-        /* read iblock */
+    while (length)
+    {
+        wr = write(fd, buf, length);
+        if (wr < 0)
         {
-            rd = read(fd, bmem.buf, rlen);
-            if (rd != rlen)
-            {
-                if (rd == 0)
-                    goto done;
-                goto error;
-            }
-            iblock = bmem.buf;
+            if (errno == EINTR)
+                continue;
+            return -1;
         }
+        buf    += wr;
+        length -= wr;
+    }
 
-        length = le32to_host(iblock->length);
+    return 0;
+}
 
-        if (bmem_alloc(&bmem, length) < 0)
-            goto error;
+/*
+ * File is mapped to memory and validated in place. Names and data of section
+ * are not copied, loaded objects reference mapping.
+ */
+int l0_load(char *fpath,
+        struct l0_map_t *map,
+        struct symbols_t *symbols,
+        struct sections_t *sections,
+        struct relocations_t *relocations)
+{
+    if (_map_file(fpath, map) < 0)
+        goto error;
+    if (l0_load_mem(map->addr, map->length, symbols, sections, relocations) < 0)
+        goto error;
 
-        if (lseek(fd, bpos, SEEK_SET) == (off_t)-1)
-            goto error;
+    return 0;
+error:
+    debug_emsgf("Failed to read file", "\"%s\"" NL, fpath);
+    return -1;
+}
 
-        /* read whole block */
-        rlen = length;
-        rd = read(fd, bmem.buf, rlen);
-        if (rd != rlen)
-            goto error;
+/*
+ * Load object from memory, files of version 1 and 2 are accepted. Loaded
+ * objects reference memory, so it should be valid until they are destroyed.
+ */
+int l0_load_mem(void *buf, size_t length,
+        struct symbols_t *symbols,
+        struct sections_t *sections,
+        struct relocations_t *relocations)
+{
+    struct l0_file_head_t *head;
+    char *pbuf, *pend;
 
-        iblock = bmem.buf;
+    pbuf = buf;
+    pend = pbuf + length;
 
-        if (le16to_host(iblock->cs) != _block_cs(iblock))
-        {
-            debug_emsg("Block checksum mismatch");
-            goto error;
-        }
+    head = (struct l0_file_head_t *)pbuf;
+    if (length < sizeof(struct l0_file_head_t) || head->magic != le32to_host(L0_HEAD_MAGIC))
+    {
+        debug_emsg("File format error");
+        return -1;
+    }
 
-        pbuf = bmem.buf;
-        switch (le16to_host(iblock->magic))
-        {
-            case L0_SYMBOL_MAGIC:
-                {
-                    struct symbol_t *s;
-                    struct l0_symbol_block_t *block;
-                    char *name;
-                    char *section;
+    switch (le16to_host(head->version))
+    {
+        case 0x0001:
+            return _l0_load_v1(pbuf, pend, symbols, sections, relocations);
+        case 0x0002:
+            return _l0_load_v2(pbuf, pend, symbols, sections, relocations);
+        default:
+            debug_emsg("File format version mismatch");
+            return -1;
+    }
+}
 
-                    pbuf += sizeof(struct l0_block_info_t);
-                    block = (struct l0_symbol_block_t*)pbuf;
-                    pbuf += sizeof(struct l0_symbol_block_t);
+/*
+ * Map whole file to memory for reading.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _map_file(char *fpath, struct l0_map_t *map)
+{
+    int fd;
+    struct stat st;
 
-                    name    = pbuf;
-                    section = name + strlen(name) + 1;
+    map->addr   = NULL;
+    map->length = 0;
 
-                    s = symbols_add(symbols, name);
+    fd = open(fpath, O_RDONLY);
+    if (fd < 0)
+    {
+        debug_emsgf("Failed to open file", "\"%s\": %s" NL, fpath, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        debug_emsg("File format error");
+        close(fd);
+        return -1;
+    }
+
+    map->addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map->addr == MAP_FAILED)
+    {
+        debug_emsgf("Failed to map file", "%s" NL, strerror(errno));
+        map->addr = NULL;
+        return -1;
+    }
+    map->length = st.st_size;
+
+    return 0;
+}
+
+/*
+ * Verify checksum of section data, if it was not verified on load.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int l0_section_check(struct section_t *s)
+{
+    if (!s->crccheck)
+        return 0;
+
+    if (s->crc != _crc32(0, s->data, s->length))
+    {
+        debug_emsgf("Section checksum mismatch", "\"%s\"" NL, s->name);
+        return -1;
+    }
+    s->crccheck = 0;
+
+    return 0;
+}
+
+/*
+ *
+ */
+void l0_unmap(struct l0_map_t *map)
+{
+    if (map->addr)
+        munmap(map->addr, map->length);
+    map->addr   = NULL;
+    map->length = 0;
+}
+
+/*
+ * Make archive of objects. Symbols exported by objects are placed to index,
+ * symbol exported by more than one object is an error.
+ */
+int l0_archive_save(char *fpath, char **files, int nfiles)
+{
+    struct l0_archive_head_t *head;
+    struct l0_map_t *maps;
+    struct _l0_buf_t meta;
+    struct _l0_strtab_t strtab;
+    struct _l0_archive_index_t {
+        char *name;
+        uint32_t member;
+    } *index, *nindex;
+    uint32_t nsymbols, asymbols;
+    uint32_t i, offset;
+    int n;
+
+    index    = NULL;
+    nsymbols = 0;
+    asymbols = 0;
+    meta.p       = NULL;
+    meta.length  = 0;
+    meta.alength = 0;
+
+    maps = calloc(nfiles ? nfiles : 1, sizeof(struct l0_map_t));
+    if (!maps)
+    {
+        debug_emsg("Can not allocate memory");
+        return -1;
+    }
+    if (_strtab_init(&strtab) < 0)
+        goto error;
+
+    /* collect exported symbols, names reference mapping of objects */
+    for (n = 0; n < nfiles; n++)
+    {
+        struct symbols_t symbols;
+        struct sections_t sections;
+        struct relocations_t relocations;
+        struct llist_t *ll;
+        int error;
+
+        if (_map_file(files[n], &maps[n]) < 0)
+            goto file_error;
+
+        symbols_init(&symbols);
+        sections_init(&sections);
+        relocations_init(&relocations);
+
+        error = l0_load_mem(maps[n].addr, maps[n].length, &symbols, &sections, &relocations);
+        for (ll = symbols.first; ll && !error; ll = ll->next)
+        {
+            struct symbol_t *s = ll->p;
+
+            if (!s->exp || s->type != SYMBOL_TYPE_LABEL)
+                continue;
+
+            if (nsymbols == asymbols)
+            {
+                asymbols = asymbols ? asymbols * 2 : 64;
+                nindex = realloc(index, asymbols * sizeof(*index));
+                if (!nindex)
+                {
+                    debug_emsg("Can not allocate memory");
+                    error = -1;
+                    break;
+                }
+                index = nindex;
+            }
+            index[nsymbols].name   = s->name;
+            index[nsymbols].member = n;
+            nsymbols++;
+        }
+
+        symbols_destroy(&symbols);
+        sections_destroy(&sections);
+        relocations_destroy(&relocations);
+        if (error)
+            goto file_error;
+    }
+
+    if (nsymbols)
+        qsort(index, nsymbols, sizeof(*index), _archive_index_cmp);
+    for (i = 1; i < nsymbols; i++)
+    {
+        if (strcmp(index[i - 1].name, index[i].name) == 0)
+        {
+            debug_emsgf("Symbol redefined", "\"%s\" in \"%s\" and \"%s\"" NL, index[i].name,
+                    files[index[i - 1].member], files[index[i].member]);
+            goto error;
+        }
+    }
+
+    /* make head, filled when all tables are known */
+    if (!_buf_append(&meta, NULL, sizeof(struct l0_archive_head_t)))
+        goto error;
+
+    for (n = 0; n < nfiles; n++)
+    {
+        if (_strtab_add(&strtab, _basename(files[n]), NULL) < 0)
+            goto error;
+    }
+    for (i = 0; i < nsymbols; i++)
+    {
+        if (_strtab_add(&strtab, index[i].name, NULL) < 0)
+            goto error;
+    }
+
+    head = (struct l0_archive_head_t *)meta.p;
+    head->strings.offset = host_tole32(meta.length);
+    head->strings.count  = host_tole32(strtab.buf.length);
+    if (!_buf_append(&meta, strtab.buf.p, strtab.buf.length) || _buf_align(&meta) < 0)
+        goto error;
+
+    head = (struct l0_archive_head_t *)meta.p;
+    head->members.offset = host_tole32(meta.length);
+    head->members.count  = host_tole32(nfiles);
+
+    offset  = meta.length + nfiles * sizeof(struct l0_archive_member_t);
+    offset += nsymbols * sizeof(struct l0_archive_symbol_t);
+    offset  = (offset + L0_V2_ALIGN - 1) / L0_V2_ALIGN * L0_V2_ALIGN;
+    for (n = 0; n < nfiles; n++)
+    {
+        struct l0_archive_member_t *rec;
+        uint32_t name;
+
+        _strtab_add(&strtab, _basename(files[n]), &name);
+
+        rec = _buf_append(&meta, NULL, sizeof(struct l0_archive_member_t));
+        if (!rec)
+            goto error;
+
+        rec->name   = host_tole32(name);
+        rec->offset = host_tole32(offset);
+        rec->length = host_tole32(maps[n].length);
+
+        offset += maps[n].length;
+        offset  = (offset + L0_V2_ALIGN - 1) / L0_V2_ALIGN * L0_V2_ALIGN;
+    }
+
+    head = (struct l0_archive_head_t *)meta.p;
+    head->symbols.offset = host_tole32(meta.length);
+    head->symbols.count  = host_tole32(nsymbols);
+    for (i = 0; i < nsymbols; i++)
+    {
+        struct l0_archive_symbol_t *rec;
+        uint32_t name;
+
+        _strtab_add(&strtab, index[i].name, &name);
+
+        rec = _buf_append(&meta, NULL, sizeof(struct l0_archive_symbol_t));
+        if (!rec)
+            goto error;
+
+        rec->name   = host_tole32(name);
+        rec->member = host_tole32(index[i].member);
+    }
+
+    head = (struct l0_archive_head_t *)meta.p;
+    head->magic   = host_tole32(L0_ARCHIVE_MAGIC);
+    head->version = host_tole16(L0_ARCHIVE_VERSION);
+    head->crc     = host_tole32(_crc32(0, &head->reserved1,
+                meta.length - offsetof(struct l0_archive_head_t, reserved1)));
+
+    if (_buf_align(&meta) < 0)
+        goto error;
+    for (n = 0; n < nfiles; n++)
+    {
+        if (!_buf_append(&meta, maps[n].addr, maps[n].length) || _buf_align(&meta) < 0)
+            goto error;
+    }
+
+    if (_write_file(fpath, meta.p, meta.length) < 0)
+        goto error;
+
+    for (n = 0; n < nfiles; n++)
+        l0_unmap(&maps[n]);
+    free(maps);
+    free(meta.p);
+    if (index)
+        free(index);
+    _strtab_destroy(&strtab);
+    return 0;
+file_error:
+    debug_emsgf("Failed to read file", "\"%s\"" NL, files[n]);
+error:
+    for (n = 0; n < nfiles; n++)
+        l0_unmap(&maps[n]);
+    free(maps);
+    if (meta.p)
+        free(meta.p);
+    if (index)
+        free(index);
+    _strtab_destroy(&strtab);
+    return -1;
+}
+
+/*
+ * RETURN
+ *     1 if file is archive, 0 otherwise
+ */
+int l0_archive_probe(char *fpath)
+{
+    int fd;
+    uint32_t magic;
+
+    fd = open(fpath, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    if (read(fd, &magic, sizeof(magic)) != sizeof(magic))
+        magic = 0;
+    close(fd);
+
+    return le32to_host(magic) == L0_ARCHIVE_MAGIC;
+}
+
+/*
+ * Map archive and validate it's tables. Members are validated when loaded.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int l0_archive_open(char *fpath, struct l0_archive_t *ar)
+{
+    struct l0_archive_head_t *head;
+    struct l0_archive_member_t *member;
+    struct l0_archive_symbol_t *symbol;
+    uint64_t flength, tend;
+    uint32_t i;
+
+    if (_map_file(fpath, &ar->map) < 0)
+        goto error;
+
+    flength = ar->map.length;
+    head = ar->map.addr;
+    if (flength < sizeof(struct l0_archive_head_t) || le32to_host(head->magic) != L0_ARCHIVE_MAGIC)
+        goto format_error;
+    if (le16to_host(head->version) != L0_ARCHIVE_VERSION)
+    {
+        debug_emsg("File format version mismatch");
+        goto error;
+    }
+
+    tend = (uint64_t)le32to_host(head->symbols.offset) +
+        (uint64_t)le32to_host(head->symbols.count) * sizeof(struct l0_archive_symbol_t);
+    if (le32to_host(head->strings.offset) < sizeof(struct l0_archive_head_t) ||
+            (uint64_t)le32to_host(head->strings.offset) + le32to_host(head->strings.count) >
+                le32to_host(head->members.offset) ||
+            (uint64_t)le32to_host(head->members.offset) +
+                (uint64_t)le32to_host(head->members.count) * sizeof(struct l0_archive_member_t) >
+                le32to_host(head->symbols.offset) ||
+            tend > flength)
+    {
+        goto format_error;
+    }
+
+    if (le32to_host(head->crc) != _crc32(0, &head->reserved1,
+                tend - offsetof(struct l0_archive_head_t, reserved1)))
+    {
+        debug_emsg("Tables checksum mismatch");
+        goto error;
+    }
+
+    ar->strings  = (char *)ar->map.addr + le32to_host(head->strings.offset);
+    ar->slength  = le32to_host(head->strings.count);
+    ar->members  = (char *)ar->map.addr + le32to_host(head->members.offset);
+    ar->nmembers = le32to_host(head->members.count);
+    ar->symbols  = (char *)ar->map.addr + le32to_host(head->symbols.offset);
+    ar->nsymbols = le32to_host(head->symbols.count);
+
+    if (!ar->slength || ar->strings[ar->slength - 1] != 0)
+        goto format_error;
+
+    member = ar->members;
+    for (i = 0; i < ar->nmembers; i++, member++)
+    {
+        if (le32to_host(member->name) >= ar->slength ||
+                (uint64_t)le32to_host(member->offset) + le32to_host(member->length) > flength)
+            goto format_error;
+    }
+    symbol = ar->symbols;
+    for (i = 0; i < ar->nsymbols; i++, symbol++)
+    {
+        if (le32to_host(symbol->name) >= ar->slength || le32to_host(symbol->member) >= ar->nmembers)
+            goto format_error;
+    }
+
+    return 0;
+format_error:
+    debug_emsg("File format error");
+error:
+    debug_emsgf("Failed to read file", "\"%s\"" NL, fpath);
+    l0_unmap(&ar->map);
+    return -1;
+}
+
+/*
+ *
+ */
+void l0_archive_close(struct l0_archive_t *ar)
+{
+    l0_unmap(&ar->map);
+}
+
+/*
+ * RETURN
+ *     index of member which exports symbol, -1 if symbol not found
+ */
+int l0_archive_find(struct l0_archive_t *ar, char *name)
+{
+    struct l0_archive_symbol_t *symbols;
+    uint32_t lo, hi, mid;
+    int cmp;
+
+    symbols = ar->symbols;
+    lo = 0;
+    hi = ar->nsymbols;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        cmp = strcmp(name, ar->strings + le32to_host(symbols[mid].name));
+        if (cmp == 0)
+            return le32to_host(symbols[mid].member);
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return -1;
+}
+
+/*
+ * RETURN
+ *     name of member, object of member is returned thru data and length
+ */
+char *l0_archive_member(struct l0_archive_t *ar, int n, void **data, size_t *length)
+{
+    struct l0_archive_member_t *member;
+
+    member = (struct l0_archive_member_t *)ar->members + n;
+    if (data)
+        *data = (char *)ar->map.addr + le32to_host(member->offset);
+    if (length)
+        *length = le32to_host(member->length);
+
+    return ar->strings + le32to_host(member->name);
+}
+
+/*
+ * RETURN
+ *     name of symbol of index, member which exports it is returned thru member
+ */
+char *l0_archive_symbol(struct l0_archive_t *ar, int n, int *member)
+{
+    struct l0_archive_symbol_t *symbol;
+
+    symbol = (struct l0_archive_symbol_t *)ar->symbols + n;
+    if (member)
+        *member = le32to_host(symbol->member);
+
+    return ar->strings + le32to_host(symbol->name);
+}
+
+/*
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _l0_load_v1(char *pbuf, char *pend,
+        struct symbols_t *symbols,
+        struct sections_t *sections,
+        struct relocations_t *relocations)
+{
+    struct l0_block_info_t *iblock;
+
+    pbuf += sizeof(struct l0_file_head_t);
+
+    while (pbuf < pend)
+    {
+        uint32_t length;
+        char *bend;
+
+        iblock = (struct l0_block_info_t *)pbuf;
+        if (pend - pbuf < sizeof(struct l0_block_info_t))
+            goto format_error;
+
+        length = le32to_host(iblock->length);
+        if (length < sizeof(struct l0_block_info_t) || length > pend - pbuf)
+            goto format_error;
+        bend = pbuf + length;
+
+        if (le16to_host(iblock->cs) != _block_cs(iblock))
+        {
+            debug_emsg("Block checksum mismatch");
+            goto error;
+        }
+
+        pbuf += sizeof(struct l0_block_info_t);
+        switch (le16to_host(iblock->magic))
+        {
+            case L0_SYMBOL_MAGIC:
+                {
+                    struct symbol_t *s;
+                    struct l0_symbol_block_t *block;
+                    char *name;
+                    char *section;
+
+                    block = (struct l0_symbol_block_t*)pbuf;
+                    pbuf += sizeof(struct l0_symbol_block_t);
+
+                    name    = pbuf;
+                    section = _block_string(name, bend);
+                    if (!section || !_block_string(section, bend))
+                        goto format_error;
+
+                    s = symbols_add_ref(symbols, name, *section ? section : NULL);
                     s->exp   = block->flag.exp;
                     s->width = block->width;
                     s->val64 = block->value;
@@ -495,9 +1124,6 @@ int l0_load(char *fpath,
                         s->type = SYMBOL_TYPE_EXTERN;
                     else
                         s->type = SYMBOL_TYPE_LABEL;
-
-                    if (strlen(section))
-                        symbol_set_section(s, section);
                 }
                 break;
             case L0_RELOCATION_MAGIC:
@@ -506,14 +1132,15 @@ int l0_load(char *fpath,
                     char *symbol;
                     char *section;
 
-                    pbuf += sizeof(struct l0_block_info_t);
                     block = (struct l0_relocation_block_t*)pbuf;
                     pbuf += sizeof(struct l0_relocation_block_t);
 
                     symbol  = pbuf;
-                    section = symbol + strlen(symbol) + 1;
+                    section = _block_string(symbol, bend);
+                    if (!section || !_block_string(section, bend))
+                        goto format_error;
 
-                    relocations_add(relocations, section, symbol,
+                    relocations_add_ref(relocations, section, symbol,
                             le32to_host(block->offset),
                             le32to_host(block->length),
                             le32to_host(block->adj),
@@ -525,51 +1152,224 @@ int l0_load(char *fpath,
                     struct section_t *s;
                     struct l0_section_block_t *block;
                     char *name;
-                    void *data;
+                    char *data;
+                    uint32_t dlength;
+                    int noload;
 
-                    pbuf += sizeof(struct l0_block_info_t);
                     block = (struct l0_section_block_t *)pbuf;
                     pbuf += sizeof(struct l0_section_block_t);
 
                     name = pbuf;
-                    data = name + strlen(name) + 1;
-
-                    s = section_select(sections, name);
-                    s->noload = block->flag.noload;
-
-                    if (!s->noload)
-                        section_pushdata(s, data, le32to_host(block->length));
+                    data = _block_string(name, bend);
+                    if (!data)
+                        goto format_error;
+
+                    noload  = block->flag.noload;
+                    dlength = le32to_host(block->length);
+                    if (!noload && dlength > bend - data)
+                        goto format_error;
+
+                    s = section_find(sections, name);
+                    if (!s)
+                        section_add_ref(sections, name, data, dlength, noload);
+                    else if (s->noload != noload)
+                        goto format_error;
                     else
-                        s->length = le32to_host(block->length);
+                        section_pushdata(s, data, dlength);
                 }
                 break;
         }
+
+        pbuf = bend;
     }
 
-done:
-    close(fd);
-    bmem_destroy(&bmem);
     return 0;
+format_error:
+    debug_emsg("File format error");
 error:
-    debug_emsgf("Failed to read file", "\"%s\"" NL, fpath);
-    if (fd >= 0)
-        close(fd);
-    bmem_destroy(&bmem);
     return -1;
 }
 
+/*
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _l0_load_v2(char *pbuf, char *pend,
+        struct symbols_t *symbols,
+        struct sections_t *sections,
+        struct relocations_t *relocations)
+{
+    struct l0_v2_head_t *head;
+    struct l0_v2_symbol_t *sym;
+    struct l0_v2_relocation_t *rel;
+    struct l0_v2_section_t *sec;
+    char *strings;
+    uint64_t flength, tend;
+    uint32_t slength, i;
+
+    flength = pend - pbuf;
+    if (flength < sizeof(struct l0_v2_head_t))
+        goto format_error;
+    head = (struct l0_v2_head_t *)pbuf;
+
+    /* directory should point inside of file, tables follow each other */
+    tend = (uint64_t)le32to_host(head->sections.offset) +
+        (uint64_t)le32to_host(head->sections.count) * sizeof(struct l0_v2_section_t);
+    if (le32to_host(head->strings.offset) < sizeof(struct l0_v2_head_t) ||
+            (uint64_t)le32to_host(head->strings.offset) + le32to_host(head->strings.count) >
+                le32to_host(head->symbols.offset) ||
+            (uint64_t)le32to_host(head->symbols.offset) +
+                (uint64_t)le32to_host(head->symbols.count) * sizeof(struct l0_v2_symbol_t) >
+                le32to_host(head->relocations.offset) ||
+            (uint64_t)le32to_host(head->relocations.offset) +
+                (uint64_t)le32to_host(head->relocations.count) * sizeof(struct l0_v2_relocation_t) >
+                le32to_host(head->sections.offset) ||
+            tend > flength)
+    {
+        goto format_error;
+    }
+
+    if (le32to_host(head->crc) != _crc32(0, &head->reserved1,
+                tend - offsetof(struct l0_v2_head_t, reserved1)))
+    {
+        debug_emsg("Tables checksum mismatch");
+        goto error;
+    }
+
+    /* string table ends with NUL, so any offset inside of it gives valid string */
+    strings = pbuf + le32to_host(head->strings.offset);
+    slength = le32to_host(head->strings.count);
+    if (!slength || strings[slength - 1] != 0)
+        goto format_error;
+
+    sym = (struct l0_v2_symbol_t *)(pbuf + le32to_host(head->symbols.offset));
+    for (i = le32to_host(head->symbols.count); i; i--, sym++)
+    {
+        struct symbol_t *s;
+        uint32_t name, section;
+
+        name    = le32to_host(sym->name);
+        section = le32to_host(sym->section);
+        if (name >= slength || section >= slength)
+            goto format_error;
+
+        s = symbols_add_ref(symbols, strings + name, section ? strings + section : NULL);
+        s->exp   = (sym->flags & L0_V2_SYMBOL_EXPORT) ? 1 : 0;
+        s->width = sym->width;
+        s->val64 = le64to_host(sym->value);
+        if (sym->flags & L0_V2_SYMBOL_EXTERN)
+            s->type = SYMBOL_TYPE_EXTERN;
+        else
+            s->type = SYMBOL_TYPE_LABEL;
+    }
+
+    rel = (struct l0_v2_relocation_t *)(pbuf + le32to_host(head->relocations.offset));
+    for (i = le32to_host(head->relocations.count); i; i--, rel++)
+    {
+        struct relocation_t *r;
+        uint32_t symbol, section;
+
+        symbol  = le32to_host(rel->symbol);
+        section = le32to_host(rel->section);
+        if (symbol >= slength || section >= slength)
+            goto format_error;
+
+        r = relocations_add_ref(relocations, strings + section, strings + symbol,
+                le32to_host(rel->offset),
+                le32to_host(rel->length),
+                le32to_host(rel->adj),
+                rel->type);
+        r->relax.kind    = L0_V2_RELAX_KIND(rel->relax);
+        r->relax.head    = L0_V2_RELAX_HEAD(rel->relax);
+        r->relax.prebyte = rel->prebyte;
+        r->relax.opcode  = rel->opcode;
+
+        /* linker rewrites instruction in place, so it should be sane */
+        if (r->relax.kind > RELOCATION_RELAX_RELATIVE || (r->relax.kind &&
+                    (r->length != 2 || !r->relax.head || r->relax.head > 2 || r->offset < r->relax.head)))
+            goto format_error;
+    }
+
+    sec = (struct l0_v2_section_t *)(pbuf + le32to_host(head->sections.offset));
+    for (i = le32to_host(head->sections.count); i; i--, sec++)
+    {
+        struct section_t *s;
+        uint32_t name, length, offset;
+        char *data;
+        int noload;
+
+        name   = le32to_host(sec->name);
+        length = le32to_host(sec->length);
+        offset = le32to_host(sec->offset);
+        noload = (le32to_host(sec->flags) & L0_V2_SECTION_NOLOAD) ? 1 : 0;
+        if (name >= slength)
+            goto format_error;
+
+        data = NULL;
+        if (!noload)
+        {
+            if ((uint64_t)offset + length > flength)
+                goto format_error;
+            data = pbuf + offset;
+        }
+
+        /*
+         * Data is not touched here, it's checksum is verified by
+         * l0_section_check() when data is used.
+         */
+        s = section_find(sections, strings + name);
+        if (!s)
+        {
+            s = section_add_ref(sections, strings + name, data, length, noload);
+            s->crc      = le32to_host(sec->crc);
+            s->crccheck = !noload;
+        } else if (s->noload != noload) {
+            goto format_error;
+        } else {
+            if (!noload && le32to_host(sec->crc) != _crc32(0, data, length))
+            {
+                debug_emsgf("Section checksum mismatch", "\"%s\"" NL, strings + name);
+                goto error;
+            }
+            section_pushdata(s, data, length);
+        }
+    }
+
+    return 0;
+format_error:
+    debug_emsg("File format error");
+error:
+    return -1;
+}
+
+/*
+ * RETURN
+ *     pointer next to NUL-terminated string, NULL if string is not terminated
+ *     before end of block
+ */
+static char *_block_string(char *str, char *bend)
+{
+    char *end;
+
+    if (str >= bend)
+        return NULL;
+
+    end = memchr(str, 0, bend - str);
+    if (!end)
+        return NULL;
+
+    return end + 1;
+}
+
 /*
  *
  */
 static uint16_t _block_cs(struct l0_block_info_t *block)
 {
-    uint16_t cs, bcs;
+    uint16_t cs;
     uint8_t *p;
     uint32_t length;
 
-    bcs = block->cs;
-    block->cs = 0;
-
     cs = 0;
     p = (uint8_t*)block;
     length = le32to_host(block->length);
@@ -577,9 +1377,220 @@ static uint16_t _block_cs(struct l0_block_info_t *block)
     while (length--)
         cs += *p++;
 
-    block->cs = bcs;
+    /* checksum field itself is counted as zero */
+    p = (uint8_t*)&block->cs;
+    cs -= p[0] + p[1];
 
     return cs;
 }
 
+/*
+ * CRC-32 (IEEE 802.3), computed by nibbles.
+ */
+static uint32_t _crc32(uint32_t crc, void *buf, uint32_t length)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint8_t *p;
+
+    p = buf;
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+
+    return ~crc;
+}
+
+/*
+ * Append zero filled space to buffer, copy data to it if not NULL.
+ *
+ * RETURN
+ *     pointer to appended space, NULL on error
+ */
+static void *_buf_append(struct _l0_buf_t *b, void *data, uint32_t length)
+{
+    char *p;
+
+    if (b->length + length > b->alength)
+    {
+        uint32_t alength;
+
+        alength = b->alength ? b->alength : 1024;
+        while (alength < b->length + length)
+            alength *= 2;
+
+        p = realloc(b->p, alength);
+        if (!p)
+        {
+            debug_emsg("Can not allocate memory");
+            return NULL;
+        }
+        b->p       = p;
+        b->alength = alength;
+    }
+
+    p = b->p + b->length;
+    if (data)
+        memcpy(p, data, length);
+    else
+        memset(p, 0, length);
+    b->length += length;
+
+    return p;
+}
+
+/*
+ * Pad buffer with zeroes to L0_V2_ALIGN.
+ */
+static int _buf_align(struct _l0_buf_t *b)
+{
+    uint32_t pad;
 
+    pad = (L0_V2_ALIGN - b->length % L0_V2_ALIGN) % L0_V2_ALIGN;
+    if (pad && !_buf_append(b, NULL, pad))
+        return -1;
+
+    return 0;
+}
+
+/*
+ * First string of table is empty, so offset 0 means no name.
+ */
+static int _strtab_init(struct _l0_strtab_t *st)
+{
+    st->buf.p       = NULL;
+    st->buf.length  = 0;
+    st->buf.alength = 0;
+    st->nstrings    = 0;
+    st->hsize       = 256;
+    st->hash        = calloc(st->hsize, sizeof(uint32_t));
+    if (!st->hash)
+    {
+        debug_emsg("Can not allocate memory");
+        return -1;
+    }
+
+    return _strtab_add(st, "", NULL);
+}
+
+/*
+ *
+ */
+static void _strtab_destroy(struct _l0_strtab_t *st)
+{
+    if (st->buf.p)
+        free(st->buf.p);
+    if (st->hash)
+        free(st->hash);
+    st->buf.p = NULL;
+    st->hash  = NULL;
+}
+
+/*
+ *
+ */
+static uint32_t _strtab_hash(char *str)
+{
+    uint32_t h;
+
+    h = 5381;
+    while (*str)
+        h = h * 33 + (unsigned char)*str++;
+
+    return h;
+}
+
+/*
+ * Add string to table if it is not there yet.
+ *
+ * ARGS
+ *     offset    where to store offset of string in table, may be NULL
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _strtab_add(struct _l0_strtab_t *st, char *str, uint32_t *offset)
+{
+    uint32_t h, i;
+
+    h = _strtab_hash(str);
+    for (i = h & (st->hsize - 1); st->hash[i]; i = (i + 1) & (st->hsize - 1))
+    {
+        if (strcmp(st->buf.p + st->hash[i] - 1, str) == 0)
+        {
+            if (offset)
+                *offset = st->hash[i] - 1;
+            return 0;
+        }
+    }
+
+    /* keep hash at most half full */
+    if ((st->nstrings + 1) * 2 > st->hsize)
+    {
+        uint32_t *hash, hsize, j;
+
+        hsize = st->hsize * 2;
+        hash = calloc(hsize, sizeof(uint32_t));
+        if (!hash)
+        {
+            debug_emsg("Can not allocate memory");
+            return -1;
+        }
+        for (j = 0; j < st->hsize; j++)
+        {
+            uint32_t k;
+
+            if (!st->hash[j])
+                continue;
+
+            k = _strtab_hash(st->buf.p + st->hash[j] - 1) & (hsize - 1);
+            for (; hash[k]; k = (k + 1) & (hsize - 1))
+                ;
+            hash[k] = st->hash[j];
+        }
+        free(st->hash);
+        st->hash  = hash;
+        st->hsize = hsize;
+
+        for (i = h & (st->hsize - 1); st->hash[i]; i = (i + 1) & (st->hsize - 1))
+            ;
+    }
+
+    st->hash[i] = st->buf.length + 1;
+    st->nstrings++;
+    if (offset)
+        *offset = st->buf.length;
+    if (!_buf_append(&st->buf, str, strlen(str) + 1))
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Compare entries of archive index by name, which is first member of entry.
+ */
+static int _archive_index_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * RETURN
+ *     file name without directory
+ */
+static char *_basename(char *path)
+{
+    char *ch;
+
+    ch = strrchr(path, '/');
+
+    return ch ? ch + 1 : path;
+}
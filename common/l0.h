@@ -28,19 +28,59 @@
 #ifndef _L0_H
 #define _L0_H
 
+#include <stddef.h>
 /* */
 #include <symbol.h>
 #include <section.h>
 #include <relocation.h>
 
+/*
+ * Mapping of loaded file. Names of symbols, relocations and sections, and
+ * data of sections point into it, so it should be unmapped after they are
+ * destroyed.
+ */
+struct l0_map_t {
+    void *addr;
+    size_t length;
+};
+
 int l0_save(char *fpath,
         struct symbols_t *symbols,
         struct relocations_t *relocations,
         struct sections_t *sections);
 int l0_load(char *fpath,
+        struct l0_map_t *map,
+        struct symbols_t *symbols,
+        struct sections_t *sections,
+        struct relocations_t *relocations);
+int l0_load_mem(void *buf, size_t length,
         struct symbols_t *symbols,
         struct sections_t *sections,
         struct relocations_t *relocations);
+int l0_section_check(struct section_t *s);
+void l0_unmap(struct l0_map_t *map);
+
+/*
+ * Archive of objects with index of symbols exported by them.
+ */
+struct l0_archive_t {
+    struct l0_map_t map;
+
+    char *strings;
+    uint32_t slength;
+    void *members;
+    uint32_t nmembers;
+    void *symbols;     /* sorted by name */
+    uint32_t nsymbols;
+};
+
+int l0_archive_save(char *fpath, char **files, int nfiles);
+int l0_archive_probe(char *fpath);
+int l0_archive_open(char *fpath, struct l0_archive_t *ar);
+void l0_archive_close(struct l0_archive_t *ar);
+int l0_archive_find(struct l0_archive_t *ar, char *name);
+char *l0_archive_member(struct l0_archive_t *ar, int n, void **data, size_t *length);
+char *l0_archive_symbol(struct l0_archive_t *ar, int n, int *member);
 
 #endif
 
@@ -441,12 +441,6 @@ static void _not_opd(struct symbols_t *sl, struct token_t *token)
         int64_t value;
 
         strcpy(name, tname);
-        if (lang_util_question_expand(sl, name) < 0)
-        {
-            token_print_rollback(token);
-            app_close(APP_EXITCODE_ERROR);
-        }
-
         s = symbol_get_const(sl, name, &value);
         if (!s)
         {
@@ -63,6 +63,32 @@ struct llist_t * llist_add(struct llist_t *head, void *p, void (*destroy_cb)(voi
     return head;
 }
 
+/*
+ * Add element after tail of list known by caller, list is not walked.
+ *
+ * RETURN
+ *     added element, NULL on error
+ */
+struct llist_t * llist_append(struct llist_t *tail, void *p, void (*destroy_cb)(void *), void *context)
+{
+    struct llist_t *nx;
+
+    nx = malloc(sizeof(struct llist_t));
+    if (!nx)
+        return NULL;
+
+    nx->p          = p;
+    nx->destroy_cb = destroy_cb;
+    nx->context    = context;
+    nx->next       = NULL;
+    nx->prev       = tail;
+
+    if (tail)
+        tail->next = nx;
+
+    return nx;
+}
+
 /*
  * RETURN
  *     pointer to head of list
@@ -146,6 +172,20 @@ struct llist_t * llist_find(struct llist_t *ll, void *p)
     return NULL;
 }
 
+/*
+ * RETURN
+ *     number of elements of list
+ */
+int llist_count(struct llist_t *ll)
+{
+    int count;
+
+    for (count = 0; ll; ll = ll->next)
+        count++;
+
+    return count;
+}
+
 /*
  *
  */
@@ -38,9 +38,11 @@ struct llist_t {
 };
 
 struct llist_t * llist_add(struct llist_t *head, void *p, void (*destroy_cb)(void *), void *context);
+struct llist_t * llist_append(struct llist_t *tail, void *p, void (*destroy_cb)(void *), void *context);
 struct llist_t * llist_remove(struct llist_t *head, struct llist_t *nx);
 struct llist_t * llist_find(struct llist_t *ll, void *p);
 struct llist_t * llist_sort(struct llist_t *head, int (*f)(void *, void *));
+int llist_count(struct llist_t *ll);
 void llist_destroy(struct llist_t *head);
 
 #endif
@@ -55,7 +55,7 @@ static void memdata_row_destroy(void *context)
     struct memdata_row_t *row;
 
     row = context;
-    if (row->data)
+    if (row->data && !row->ref)
         free(row->data);
     free(row);
 }
@@ -85,6 +85,7 @@ int memdata_add(struct memdata_t *md, uint32_t offset, uint8_t *buf, uint32_t le
     row->offset = offset;
     row->length = length;
     row->mark   = 0;
+    row->ref    = 0;
 
     head = llist_add(md->rows, row, memdata_row_destroy, row);
     if (!head)
@@ -99,6 +100,42 @@ error:
     return -1;
 }
 
+/*
+ * Add row referencing data without copying it. Data should be valid until
+ * row destroyed.
+ */
+int memdata_add_ref(struct memdata_t *md, uint32_t offset, uint8_t *buf, uint32_t length)
+{
+    struct memdata_row_t *row;
+    struct llist_t *head;
+
+    if (!md)
+    {
+        /* NOTREACHED */
+        debug_emsg("NULL md");
+        return -1;
+    }
+
+    row = malloc(sizeof(struct memdata_row_t));
+    if (!row)
+        return -1;
+    row->data   = buf;
+    row->offset = offset;
+    row->length = length;
+    row->mark   = 0;
+    row->ref    = 1;
+
+    head = llist_add(md->rows, row, memdata_row_destroy, row);
+    if (!head)
+    {
+        free(row);
+        return -1;
+    }
+    md->rows = head;
+
+    return 0;
+}
+
 /*
  *
  */
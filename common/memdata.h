@@ -36,6 +36,7 @@ struct memdata_row_t {
     uint8_t *data;
     uint32_t length;
     int mark;
+    int ref; /* data is not owned by row */
 };
 
 struct memdata_t {
@@ -44,6 +45,7 @@ struct memdata_t {
 
 struct memdata_t *memdata_create();
 int memdata_add(struct memdata_t *md, uint32_t offset, uint8_t *buf, uint32_t len);
+int memdata_add_ref(struct memdata_t *md, uint32_t offset, uint8_t *buf, uint32_t len);
 void memdata_destroy(struct memdata_t *md);
 void memdata_print(struct memdata_t *md);
 int memdata_pack(struct memdata_t **md);
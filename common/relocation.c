@@ -47,6 +47,7 @@ static void _relocation_destroy(void *p);
 void relocations_init(struct relocations_t *sl)
 {
     sl->first = NULL;
+    sl->last  = NULL;
 }
 
 /*
@@ -59,12 +60,13 @@ void relocations_destroy(struct relocations_t *sl)
 }
 
 /*
- *
+ * RETURN
+ *     added relocation
  */
-void relocations_add(struct relocations_t *rl,
+struct relocation_t *relocations_add(struct relocations_t *rl,
         char *section, char *symbol, uint32_t offset, uint32_t length, int32_t adjust, enum relocation_type_t type)
 {
-    struct llist_t *head;
+    struct llist_t *ll;
     struct relocation_t *r;
 
     r = malloc(sizeof(struct relocation_t));
@@ -84,18 +86,67 @@ void relocations_add(struct relocations_t *rl,
     r->offset = offset;
     r->length = length;
     r->adjust = adjust;
+    r->ref    = 0;
+    r->target = NULL;
+    memset(&r->relax, 0, sizeof(r->relax));
+
+    ll = llist_append(rl->last, r, _relocation_destroy, r);
+    if (!ll)
+        goto error;
+    if (!rl->first)
+        rl->first = ll;
+    rl->last = ll;
+
+    return r;
+error:
+    debug_emsg("Can not add relocation");
+    if (r)
+        _relocation_destroy(r);
+    app_close(APP_EXITCODE_ERROR);
+    return NULL;
+}
+
+/*
+ * Add relocation referencing section and symbol names without copying them.
+ * Names should be valid until relocation destroyed.
+ *
+ * RETURN
+ *     added relocation
+ */
+struct relocation_t *relocations_add_ref(struct relocations_t *rl,
+        char *section, char *symbol, uint32_t offset, uint32_t length, int32_t adjust, enum relocation_type_t type)
+{
+    struct llist_t *ll;
+    struct relocation_t *r;
+
+    r = malloc(sizeof(struct relocation_t));
+    if (!r)
+        goto error;
 
-    head = llist_add(rl->first, r, _relocation_destroy, r);
-    if (!head)
+    r->section = section;
+    r->symbol  = symbol;
+    r->type    = type;
+    r->offset  = offset;
+    r->length  = length;
+    r->adjust  = adjust;
+    r->ref     = 1;
+    r->target  = NULL;
+    memset(&r->relax, 0, sizeof(r->relax));
+
+    ll = llist_append(rl->last, r, _relocation_destroy, r);
+    if (!ll)
         goto error;
-    rl->first = head;
+    if (!rl->first)
+        rl->first = ll;
+    rl->last = ll;
 
-    return;
+    return r;
 error:
     debug_emsg("Can not add relocation");
     if (r)
         _relocation_destroy(r);
     app_close(APP_EXITCODE_ERROR);
+    return NULL;
 }
 
 /*
@@ -108,10 +159,13 @@ static void _relocation_destroy(void *p)
     if (!p)
         return;
     r = p;
-    if (r->section)
-        free(r->section);
-    if (r->symbol)
-        free(r->symbol);
+    if (!r->ref)
+    {
+        if (r->section)
+            free(r->section);
+        if (r->symbol)
+            free(r->symbol);
+    }
 
     free(r);
 }
@@ -32,6 +32,8 @@
 #include <types.h>
 #include <llist.h>
 
+struct symbol_t;
+
 struct relocation_t {
     enum relocation_type_t {
         RELOCATION_TYPE_ABOSULTE = 0,
@@ -44,15 +46,38 @@ struct relocation_t {
     uint32_t offset; /* offset of fixup from start of section */
     uint32_t length; /* length of fixup */
     int32_t  adjust; /* adjust offset of relative fixup */
+
+    /*
+     * Instruction of fixup may be relaxed by linker to short form when value
+     * fits it. Instruction starts "head" bytes (prebyte and opcode) before
+     * fixup, fixup of short form is one byte.
+     */
+    struct {
+        enum relocation_relax_t {
+            RELOCATION_RELAX_NONE     = 0,
+            RELOCATION_RELAX_SHORT    = 1, /* longmem to shortmem, value below $100 */
+            RELOCATION_RELAX_RELATIVE = 2, /* "call"/"jp" to "callr"/"jra" */
+        } kind;
+        uint8_t head;
+        uint8_t prebyte; /* prebyte of short form, 0 if none */
+        uint8_t opcode;  /* opcode of short form */
+    } relax;
+
+    int ref; /* section and symbol names are not owned by relocation */
+
+    struct symbol_t *target; /* symbol resolved by linker, NULL if not resolved */
 };
 
 struct relocations_t {
     struct llist_t *first;
+    struct llist_t *last;  /* relocations are appended after it */
 };
 
 void relocations_init(struct relocations_t *rl);
 void relocations_destroy(struct relocations_t *rl);
-void relocations_add(struct relocations_t *rl,
+struct relocation_t *relocations_add(struct relocations_t *rl,
+        char *section, char *symbol, uint32_t offset, uint32_t length, int32_t adjust, enum relocation_type_t type);
+struct relocation_t *relocations_add_ref(struct relocations_t *rl,
         char *section, char *symbol, uint32_t offset, uint32_t length, int32_t adjust, enum relocation_type_t type);
 
 void relocations_mkloop(struct relocations_t *rl, struct llist_t **ll);
@@ -42,6 +42,8 @@
 
 static struct section_t * _section_create(char *name);
 static void _section_destroy(void *p);
+static void _section_own(struct section_t *s);
+static uint32_t _section_piece(struct section_t *s, uint32_t offset, uint32_t length);
 
 /*
  *
@@ -49,6 +51,7 @@ static void _section_destroy(void *p);
 void sections_init(struct sections_t *sl)
 {
     sl->first = NULL;
+    sl->last  = NULL;
 }
 
 /*
@@ -110,17 +113,19 @@ error:
 struct section_t *section_add(struct sections_t *sl, char *name)
 {
     struct section_t *s;
-    struct llist_t *head;
+    struct llist_t *ll;
 
     s = _section_create(name);
 
     if (!s)
         goto error;
 
-    head = llist_add(sl->first, s, _section_destroy, s);
-    if (!head)
+    ll = llist_append(sl->last, s, _section_destroy, s);
+    if (!ll)
         goto error;
-    sl->first = head;
+    if (!sl->first)
+        sl->first = ll;
+    sl->last = ll;
 
     return s;
 error:
@@ -130,30 +135,98 @@ error:
 }
 
 /*
- *
+ * Add section referencing name and data without copying them. Name and data
+ * should be valid until section destroyed, data is copied on first change of
+ * section.
  */
-static struct section_t * _section_create(char *name)
+struct section_t *section_add_ref(struct sections_t *sl, char *name, void *data, uint32_t length, int noload)
 {
     struct section_t *s;
+    struct llist_t *ll;
 
     s = malloc(sizeof(struct section_t));
     if (!s)
         goto error;
 
-    s->data = malloc(SECTION_PREALLOC_SIZE);
-    if (!s->data)
+    s->name    = name;
+    s->data    = noload ? NULL : data;
+    s->length  = length;
+    s->alength = 0;
+    s->noload  = noload;
+    s->ref     = 1;
+    s->dataref = 0;
+    s->crc      = 0;
+    s->crccheck = 0;
+    s->placed  = 0;
+    s->align   = 1;
+    s->offset  = 0;
+    s->output  = NULL;
+    s->discard = 0;
+    s->fold    = NULL;
+    s->strmap  = NULL;
+    s->nstrmap = 0;
+    s->lma     = 0;
+    s->vma     = 0;
+    s->reserved = 0;
+    s->pieces   = NULL;
+    s->npieces  = 0;
+    s->apieces  = 0;
+
+    ll = llist_append(sl->last, s, _section_destroy, s);
+    if (!ll)
         goto error;
-    s->name = malloc(strlen(name) + 1);
-    if (!s->name)
+    if (!sl->first)
+        sl->first = ll;
+    sl->last = ll;
+
+    return s;
+error:
+    debug_emsg("Can not add section");
+    if (s)
+        _section_destroy(s);
+    app_close(APP_EXITCODE_ERROR);
+    return NULL;
+}
+
+/*
+ *
+ */
+static struct section_t * _section_create(char *name)
+{
+    struct section_t *s;
+
+    s = malloc(sizeof(struct section_t));
+    if (!s)
         goto error;
-    strcpy(s->name, name);
+    s->ref     = 0;
+    s->dataref = 0;
 
+    /* data is allocated when first pushed */
+    s->data   = NULL;
     s->length = 0;
     s->noload  = 0;
+    s->crc      = 0;
+    s->crccheck = 0;
     s->placed  = 0;
+    s->align   = 1;
+    s->offset  = 0;
+    s->output  = NULL;
+    s->discard = 0;
+    s->fold    = NULL;
+    s->strmap  = NULL;
+    s->nstrmap = 0;
     s->lma     = 0;
     s->vma     = 0;
-    s->alength = SECTION_PREALLOC_SIZE;
+    s->alength = 0;
+    s->reserved = 0;
+    s->pieces   = NULL;
+    s->npieces  = 0;
+    s->apieces  = 0;
+
+    /* fields released by _section_destroy() are set before */
+    s->name = malloc(strlen(name) + 1);
+    if (!s->name)
+        goto error;
     strcpy(s->name, name);
 
     return s;
@@ -173,21 +246,59 @@ static void _section_destroy(void *p)
         return;
 
     s = p;
-    if (s->data)
-        free(s->data);
-    if (s->name)
-        free(s->name);
+    if (!s->ref)
+    {
+        if (s->data && !s->dataref)
+            free(s->data);
+        if (s->name)
+            free(s->name);
+    }
+    if (s->strmap)
+        free(s->strmap);
+    if (s->pieces)
+        free(s->pieces);
     free(s);
 }
 
+/*
+ * Make own copy of referenced name and data before section changed.
+ */
+static void _section_own(struct section_t *s)
+{
+    char *name, *data;
+    uint32_t alength;
+
+    if (!s->ref)
+        return;
+
+    alength = (s->length / SECTION_PREALLOC_SIZE + 1) * SECTION_PREALLOC_SIZE;
+
+    name = malloc(strlen(s->name) + 1);
+    data = malloc(alength);
+    if (!name || !data)
+    {
+        debug_emsg("Can not allocate memory for section");
+        app_close(APP_EXITCODE_ERROR);
+        return;
+    }
+    strcpy(name, s->name);
+    if (s->data)
+        memcpy(data, s->data, s->length);
+
+    s->name    = name;
+    s->data    = data;
+    s->alength = alength;
+    s->ref     = 0;
+}
+
 /*
  *
  */
 void section_pushdata(struct section_t *s, void *data, uint32_t length)
 {
-    uint32_t needspace;
+    uint32_t needspace, pos;
 
-    if (!s || !data)
+    if (!s || (!data && !s->noload && length > 0))
     {
         /* NOTREACHED */
         debug_emsg("NULL");
@@ -195,10 +306,26 @@ void section_pushdata(struct section_t *s, void *data, uint32_t length)
         return;
     }
 
+    _section_own(s);
+
     if (!s->noload && length > 0)
     {
+        if (s->dataref)
+        {
+            /* NOTREACHED */
+            debug_emsgf("Section data can not grow", "\"%s\"" NL, s->name);
+            app_close(APP_EXITCODE_ERROR);
+            return;
+        }
+
+
+        /* section with reserved space holds only data pushed */
+        pos = s->length;
+        if (s->reserved)
+            pos = _section_piece(s, s->length, length);
+
         /* reallocate memory if necessary */
-        needspace = s->length + length;
+        needspace = pos + length;
         if (needspace > s->alength) 
         {
             void *p;
@@ -217,11 +344,138 @@ void section_pushdata(struct section_t *s, void *data, uint32_t length)
             s->data = p;
         }
 
-        memcpy(&s->data[s->length], data, length);
+        memcpy(&s->data[pos], data, length);
     }
     s->length += length;
 }
 
+/*
+ * Add piece of data at offset of section, or extend last piece if it ends
+ * there.
+ *
+ * RETURN
+ *     position of data of piece added in data of section
+ */
+static uint32_t _section_piece(struct section_t *s, uint32_t offset, uint32_t length)
+{
+    struct section_piece_t *p;
+
+    if (s->npieces)
+    {
+        p = &s->pieces[s->npieces - 1];
+        if (p->offset + p->length == offset)
+        {
+            p->length += length;
+            return p->pos + p->length - length;
+        }
+    }
+
+    if (s->npieces == s->apieces)
+    {
+        s->apieces = s->apieces ? s->apieces * 2 : 16;
+        p = realloc(s->pieces, s->apieces * sizeof(struct section_piece_t));
+        if (!p)
+        {
+            debug_emsg("Realloc failed");
+            app_close(APP_EXITCODE_ERROR);
+            return 0;
+        }
+        s->pieces = p;
+    }
+
+    p = &s->pieces[s->npieces++];
+    p->offset = offset;
+    p->pos    = s->npieces > 1 ? p[-1].pos + p[-1].length : 0;
+    p->length = length;
+
+    return p->pos;
+}
+
+/*
+ * Grow section by length without data. Space reserved is written later, by
+ * section_patch() or in buffer given by section_attach(). Data pushed after
+ * it follows reserved space, it is held without reserved space before it.
+ */
+void section_reserve(struct section_t *s, uint32_t length)
+{
+    _section_own(s);
+
+    /* data held before is first piece */
+    if (!s->reserved && !s->noload && s->length)
+        _section_piece(s, 0, s->length);
+    s->reserved = 1;
+
+    s->length += length;
+}
+
+/*
+ * Make section hold its data in buffer given, which should be valid until
+ * section destroyed and be large enough for length of section. Data held
+ * before is moved to its offset in buffer, reserved space is left as is.
+ */
+void section_attach(struct section_t *s, void *data)
+{
+    uint32_t i;
+
+    _section_own(s);
+    if (s->data && !s->noload)
+    {
+        if (s->reserved)
+        {
+            for (i = 0; i < s->npieces; i++)
+            {
+                struct section_piece_t *p = &s->pieces[i];
+
+                memcpy((char *)data + p->offset, &s->data[p->pos], p->length);
+            }
+        } else {
+            memmove(data, s->data, s->length);
+        }
+    }
+    if (s->data && !s->dataref)
+        free(s->data);
+    if (s->pieces)
+        free(s->pieces);
+
+    s->data     = data;
+    s->alength  = s->length;
+    s->dataref  = 1;
+    s->reserved = 0;
+    s->pieces   = NULL;
+    s->npieces  = 0;
+    s->apieces  = 0;
+}
+
+/*
+ * RETURN
+ *     data at offset of section, NULL if offset is in reserved space
+ */
+void *section_data(struct section_t *s, uint32_t offset)
+{
+    uint32_t lo, hi, mid;
+
+    if (!s->data || offset >= s->length)
+        return NULL;
+    if (!s->reserved)
+        return &s->data[offset];
+
+    /* last piece starting at or before offset */
+    lo = 0;
+    hi = s->npieces;
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (s->pieces[mid].offset <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo || offset >= s->pieces[lo - 1].offset + s->pieces[lo - 1].length)
+        return NULL;
+
+    return &s->data[s->pieces[lo - 1].pos + offset - s->pieces[lo - 1].offset];
+}
+
 /*
  *
  */
@@ -230,17 +484,38 @@ void section_patch(struct section_t *s, uint32_t offset, void *data, uint32_t le
     if (s->noload)
         return;
 
-    if (offset + length > s->length)
+    if (offset + length > s->length || s->reserved)
     {
         debug_emsg("Failed to patch section");
         printf("offset %08X length %08X section length %08X" NL, offset, length, s->length);
         app_close(APP_EXITCODE_ERROR);
     }
 
+    _section_own(s);
     memcpy(&s->data[offset], data, length);
     return;
 }
 
+/*
+ * Remove data at offset, following data is moved to its place.
+ */
+void section_cut(struct section_t *s, uint32_t offset, uint32_t length)
+{
+    if (offset + length > s->length || s->reserved)
+    {
+        debug_emsg("Failed to cut section");
+        printf("offset %08X length %08X section length %08X" NL, offset, length, s->length);
+        app_close(APP_EXITCODE_ERROR);
+    }
+
+    if (!s->noload)
+    {
+        _section_own(s);
+        memmove(&s->data[offset], &s->data[offset + length], s->length - offset - length);
+    }
+    s->length -= length;
+}
+
 /*
  *
  */
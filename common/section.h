@@ -32,33 +32,62 @@
 #include <llist.h>
 #include <types.h>
 
+/* data pushed to section with reserved space, held without the space */
+struct section_piece_t {
+    uint32_t offset; /* offset in section */
+    uint32_t pos;    /* position in data of section */
+    uint32_t length;
+};
+
 struct section_t {
     char *name;
 
     uint8_t  noload; /* section has not real data */
+    uint8_t  ref;    /* name and data are not owned by section, copied on change */
+    uint8_t  dataref; /* data is part of buffer not owned by section, written in place */
+
+    uint32_t crc;     /* CRC32 of referenced data */
+    uint8_t crccheck; /* CRC should be verified before data is used */
 
     char *data;
     uint32_t length;  /* current section length/data pointer */
     uint32_t alength; /* allocated data length */
 
+    uint8_t reserved;                /* section has reserved space, data holds only pieces */
+    struct section_piece_t *pieces;  /* pieces of data in order of offset */
+    uint32_t npieces;
+    uint32_t apieces;                /* allocated number of pieces */
+
     /* filled by linker */
     int placed;
-    uint32_t offset;
+    uint32_t align; /* alignment of address of automatically placed section */
+    uint32_t offset;          /* offset of input section in output section */
+    struct section_t *output; /* output section input section glued to */
+    uint8_t discard;          /* input section dropped by garbage collection */
+    struct section_t *fold;   /* identical input section this one is folded into */
+    uint32_t *strmap;         /* offsets of strings of merged input section, pairs of input and output */
+    uint32_t nstrmap;         /* number of strings in map */
     uint32_t lma; /* load memory address */
     uint32_t vma; /* virtual memory address */
 };
 
 struct sections_t {
     struct llist_t *first;
+    struct llist_t *last;  /* sections are appended after it */
 };
 
 void sections_init(struct sections_t *sl);
 void sections_destroy(struct sections_t *sl);
 void section_pushdata(struct section_t *s, void *data, uint32_t length);
+void section_reserve(struct section_t *s, uint32_t length);
+void section_attach(struct section_t *s, void *data);
+void *section_data(struct section_t *s, uint32_t offset);
 struct section_t *section_find(struct sections_t *sl, char *name);
 struct section_t *section_select(struct sections_t *sl, char *name);
 struct section_t *section_add(struct sections_t *sl, char *name);
+struct section_t *section_add_ref(struct sections_t *sl, char *name, void *data, uint32_t length, int noload);
 void section_patch(struct section_t *s, uint32_t offset, void *data, uint32_t length);
+void section_cut(struct section_t *s, uint32_t offset, uint32_t length);
 
 void sections_mkloop(struct sections_t *sl, struct llist_t **ll);
 struct section_t *sections_next(struct llist_t **ll);
@@ -80,13 +80,13 @@ static void _print_trace(char *trace);
 static uint8_t _ch2num(char ch);
 
 /*
- * Read S-record file.
+ * Read S-record file, print name of it and S0 comment if "verbose" is set.
  *
  * RETURN
  *     Pointer to memdata_t structure. NULL on error.
  *     Structure should be destroyed in future by memdata_destroy().
  */
-struct memdata_t *srec_read(const char *path)
+struct memdata_t *srec_read(const char *path, int verbose)
 {
     struct memdata_t *md;
     FILE *f;
@@ -103,7 +103,8 @@ struct memdata_t *srec_read(const char *path)
         goto error;
     }
 
-    printf("Read file \"%s\"" NL, path);
+    if (verbose)
+        printf("Read file \"%s\"" NL, path);
 
     f = fopen(path, "r");
     if (!f)
@@ -295,7 +296,8 @@ struct memdata_t *srec_read(const char *path)
 
                 if (parser.record.type == RTYPE_S0)
                 {
-                    printf("S19 Comment: %s" NL, parser.record.data);
+                    if (verbose)
+                        printf("S19 Comment: %s" NL, parser.record.data);
                 } else {
                     switch (parser.record.type)
                     {
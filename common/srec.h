@@ -30,7 +30,7 @@
 
 #include "memdata.h"
 
-struct memdata_t *srec_read(const char *path);
+struct memdata_t *srec_read(const char *path, int verbose);
 int srec_write(const char *path, struct memdata_t *memdata, char *comment);
 
 #endif
@@ -39,7 +39,9 @@
 #endif
 
 static void _symbol_destroy(void *p);
-static struct symbol_t * _symbol_create(char *name);
+static struct symbol_t * _symbol_create(char *prefix, char *name);
+static unsigned int _symbol_hash(char *name);
+static struct symbol_t *_symbol_find_local(struct symbol_t *scope, char *name);
 
 /*
  *
@@ -47,6 +49,8 @@ static struct symbol_t * _symbol_create(char *name);
 void symbols_init(struct symbols_t *sl)
 {
     sl->first = NULL;
+    sl->last  = NULL;
+    sl->scope = NULL;
 }
 
 /*
@@ -54,26 +58,58 @@ void symbols_init(struct symbols_t *sl)
  */
 struct symbol_t *symbols_add(struct symbols_t *sl, char *name)
 {
-    struct llist_t *head;
+    struct llist_t *ll;
     struct symbol_t *s;
+    struct symbol_t *scope;
 
     s = NULL;
-    if (symbol_find(sl, name))
+    if (symbol_find_scope(sl, name))
     {
         debug_emsgf("Symbol redefined", "%s" NL, name);
         goto error;
     }
 
-    s = _symbol_create(name);
+    scope = NULL;
+    if (*name == '?')
+    {
+        scope = sl->scope;
+        if (!scope)
+        {
+            debug_emsgf("Local symbol not within label", "%s" NL, name);
+            goto error;
+        }
+        if (!scope->locals)
+        {
+            scope->locals = calloc(SYMBOL_LOCAL_HASH_SIZE, sizeof(struct symbol_t *));
+            if (!scope->locals)
+                goto error;
+        }
+    }
+
+    s = _symbol_create(scope ? scope->name : "", name);
     if (!s)
         goto error;
 
     s->type = SYMBOL_TYPE_NONE;
 
-    head = llist_add(sl->first, s, _symbol_destroy, s);
-    if (!head)
+    if (scope)
+    {
+        unsigned int h;
+
+        s->scope = scope;
+        s->lname = &s->name[strlen(scope->name)];
+
+        h = _symbol_hash(s->lname);
+        s->lnext = scope->locals[h];
+        scope->locals[h] = s;
+    }
+
+    ll = llist_append(sl->last, s, _symbol_destroy, s);
+    if (!ll)
         goto error;
-    sl->first = head;
+    if (!sl->first)
+        sl->first = ll;
+    sl->last = ll;
 
     PRINTF("Add symbol %s, %llu" NL, name);
 
@@ -86,6 +122,43 @@ error:
     return NULL;
 }
 
+/*
+ * Add symbol referencing name and section strings without copying them.
+ * Strings should be valid until symbol destroyed. Name is not checked for
+ * duplicates, caller is responsible for it.
+ */
+struct symbol_t *symbols_add_ref(struct symbols_t *sl, char *name, char *section)
+{
+    struct llist_t *ll;
+    struct symbol_t *s;
+
+    s = malloc(sizeof(struct symbol_t));
+    if (!s)
+        goto error;
+    memset(s, 0, sizeof(struct symbol_t));
+
+    s->type    = SYMBOL_TYPE_NONE;
+    s->name    = name;
+    s->section = section;
+    s->width   = 1;
+    s->ref     = 1;
+
+    ll = llist_append(sl->last, s, _symbol_destroy, s);
+    if (!ll)
+        goto error;
+    if (!sl->first)
+        sl->first = ll;
+    sl->last = ll;
+
+    return s;
+error:
+    debug_emsg("Can not add symbol");
+    if (s)
+        _symbol_destroy(s);
+    app_close(APP_EXITCODE_ERROR);
+    return NULL;
+}
+
 /*
  *
  */
@@ -120,15 +193,26 @@ struct symbol_t *symbol_get_const(struct symbols_t *sl, char *name, int64_t *val
 }
 
 /*
- *
+ * Local symbol ("?name") searched within scope of current label, then
+ * within outer scopes.
  */
 struct symbol_t *symbol_find(struct symbols_t *sl, char *name)
 {
     struct llist_t *ll;
     struct symbol_t *s;
+    struct symbol_t *scope;
 
     if (!sl)
         return NULL;
+    if (*name == '?')
+    {
+        for (scope = sl->scope; scope; scope = scope->outer)
+        {
+            if ((s = _symbol_find_local(scope, name)))
+                return s;
+        }
+        return NULL;
+    }
 
     for (ll = sl->first; ll; ll = ll->next)
     {
@@ -147,26 +231,104 @@ void symbol_drop(struct symbols_t *sl, char *name)
     struct llist_t *ll;
     struct symbol_t *s;
 
-    if (!sl)
+    s = symbol_find(sl, name);
+    if (!s)
         return;
 
-    for (ll = sl->first; ll; ll = ll->next)
+    if (s->scope)
     {
-        s = ll->p;
-        if (strcmp(s->name, name) == 0)
+        struct symbol_t **pl;
+
+        for (pl = &s->scope->locals[_symbol_hash(s->lname)]; *pl; pl = &(*pl)->lnext)
         {
-            sl->first = llist_remove(sl->first, ll);
-            break;
+            if (*pl == s)
+            {
+                *pl = s->lnext;
+                break;
+            }
         }
     }
+    if (sl->scope == s)
+        sl->scope = NULL;
 
-    return;
+    ll = llist_find(sl->first, s);
+    if (ll == sl->last)
+        sl->last = ll->prev;
+    sl->first = llist_remove(sl->first, ll);
+}
+
+/*
+ * Set label which local symbols are searched/added in, NULL if none.
+ */
+void symbols_set_scope(struct symbols_t *sl, struct symbol_t *s)
+{
+    sl->scope = s;
+}
+
+/*
+ * Add scope nested in current one and make it current. Name of scope is
+ * not visible in object, only it's local symbols are.
+ */
+struct symbol_t *symbols_add_scope(struct symbols_t *sl, char *name)
+{
+    struct symbol_t *s;
+
+    s = symbols_add(sl, name);
+    s->outer  = sl->scope;
+    sl->scope = s;
+
+    return s;
+}
+
+/*
+ * Same as symbol_find(), but local symbol is searched within current scope
+ * only, so local symbol of outer scope may be defined again.
+ */
+struct symbol_t *symbol_find_scope(struct symbols_t *sl, char *name)
+{
+    if (*name == '?')
+        return sl->scope ? _symbol_find_local(sl->scope, name) : NULL;
+
+    return symbol_find(sl, name);
+}
+
+/*
+ *
+ */
+static unsigned int _symbol_hash(char *name)
+{
+    unsigned int h;
+
+    h = 5381;
+    while (*name)
+        h = h * 33 + (unsigned char)*name++;
+
+    return h & (SYMBOL_LOCAL_HASH_SIZE - 1);
+}
+
+/*
+ *
+ */
+static struct symbol_t *_symbol_find_local(struct symbol_t *scope, char *name)
+{
+    struct symbol_t *s;
+
+    if (!scope->locals)
+        return NULL;
+
+    for (s = scope->locals[_symbol_hash(name)]; s; s = s->lnext)
+    {
+        if (strcmp(s->lname, name) == 0)
+            return s;
+    }
+
+    return NULL;
 }
 
 /*
  *
  */
-static struct symbol_t * _symbol_create(char *name)
+static struct symbol_t * _symbol_create(char *prefix, char *name)
 {
     struct symbol_t *s;
 
@@ -175,11 +337,12 @@ static struct symbol_t * _symbol_create(char *name)
 
     s->section  = NULL;
     s->val64    = 0;
-    s->name     = malloc(strlen(name) + 1);
+    s->name     = malloc(strlen(prefix) + strlen(name) + 1);
     s->attr     = NULL;
     if (!s->name)
         goto error;
-    strcpy(s->name, name);
+    strcpy(s->name, prefix);
+    strcat(s->name, name);
     symbol_set_width(s, SYMBOL_WIDTH_SHORT);
 
     return s;
@@ -218,10 +381,12 @@ static void _symbol_destroy(void *p)
         return;
     s = p;
 
-    if (s->name)
+    if (s->name && !s->ref)
         free(s->name);
     if (s->attr)
         llist_destroy(s->attr);
+    if (s->locals)
+        free(s->locals);
 
     free(s);
 }
@@ -57,10 +57,32 @@ struct symbol_t {
     uint8_t width; /* width of symbol in bytes */
 
     struct llist_t *attr;
+
+    int ref; /* name and section are not owned by symbol */
+
+    /*
+     * Local ("?name") symbols are owned by label they follow. Full name of
+     * local symbol ("label?name") is built once on it's creation, references
+     * are resolved thru hash table of owner label.
+     */
+    struct symbol_t *scope;   /* label that owns local symbol */
+    char *lname;              /* local part of name, points inside of name */
+    struct symbol_t *lnext;   /* next local symbol in hash chain */
+    struct symbol_t **locals; /* hash table of local symbols of label */
+    struct symbol_t *outer;   /* scope searched if local symbol not found in this */
+
+    /*
+     * Labels of linked files are kept apart by file they came from, not by
+     * name. Input label refers to label of result made of it.
+     */
+    char *file;              /* file of label of result, not owned */
+    struct symbol_t *result; /* label of result made of input label */
 };
 
 struct symbols_t {
     struct llist_t *first;
+    struct llist_t *last;   /* symbols are appended after it */
+    struct symbol_t *scope; /* current label, scope of local symbols */
 };
 
 #define SYMBOL_WIDTH_SHORT  "w8"
@@ -69,13 +91,17 @@ struct symbols_t {
 
 //#define SYMBOL_WIDTH_DEFAULT   SYMBOL_WIDTH_SHORT
 
-#define SYMBOL_CURRENT_LABEL    "##current_label##"
+#define SYMBOL_LOCAL_HASH_SIZE  16 /* should be power of 2 */
 
 void symbols_init(struct symbols_t *sl);
 void symbols_destroy(struct symbols_t *sl);
 struct symbol_t *symbols_add(struct symbols_t *sl, char *name);
+struct symbol_t *symbols_add_ref(struct symbols_t *sl, char *name, char *section);
 struct symbol_t *symbol_find(struct symbols_t *sl, char *name);
 void symbol_drop(struct symbols_t *sl, char *name);
+void symbols_set_scope(struct symbols_t *sl, struct symbol_t *s);
+struct symbol_t *symbols_add_scope(struct symbols_t *sl, char *name);
+struct symbol_t *symbol_find_scope(struct symbols_t *sl, char *name);
 
 void symbol_set_const(struct symbol_t *s, int64_t value);
 struct symbol_t *symbol_get_const(struct symbols_t *sl, char *name, int64_t *value);
@@ -52,11 +52,93 @@ void token_prepare(struct token_t *token, char *path)
 
     token->file.cnt      = 0;
     token->file.line     = 1;
+    token->file.fetch    = NULL;
+    token->file.arg      = NULL;
     strcpy(token->file.fname, path);
 
     token->trace.wp       = 0;
     token->trace.ncurrent = 0;
     token->trace.nnext    = 0;
+    token->trace.nread    = 0;
+
+    token->replay.record = NULL;
+    token->replay.key    = NULL;
+}
+
+/*
+ * Prepare token to read input from memory chunks instead of file. Fetch
+ * function should set pointer to next chunk of input and return it's length,
+ * 0 on end of input. Chunks are not copied, so they should be valid until token
+ * is in use.
+ */
+void token_prepare_fetch(struct token_t *token, char *name, int line,
+        int (*fetch)(void *arg, char **pbuf), void *arg)
+{
+    token->file.fd    = -1;
+    token->file.cnt   = 0;
+    token->file.line  = line;
+    token->file.fetch = fetch;
+    token->file.arg   = arg;
+    strncpy(token->file.fname, name, PATH_MAX - 1);
+    token->file.fname[PATH_MAX - 1] = 0;
+
+    token->trace.wp       = 0;
+    token->trace.ncurrent = 0;
+    token->trace.nnext    = 0;
+    token->trace.nread    = 0;
+
+    token->replay.record = NULL;
+    token->replay.key    = NULL;
+}
+
+/*
+ * Replay lexing recorded in record instead of lexing input again. Key
+ * function is called with argument of fetch function and position of token
+ * start in input, it should set start and end of range of positions around
+ * it, which input is same every time input is read with this record, and
+ * return key of start of range, -1 if position should not be recorded.
+ */
+void token_prepare_record(struct token_t *token, struct token_record_t *record,
+        long (*key)(void *arg, unsigned long pos, unsigned long *start, unsigned long *end))
+{
+    token->replay.record = record;
+    token->replay.key    = key;
+    token->replay.start  = 0;
+    token->replay.end    = 0;
+    token->replay.base   = -1;
+}
+
+/*
+ * Read next chunk of input.
+ *
+ * RETURN
+ *     0 on end of input, 1 otherwise
+ */
+static int _token_refill(struct token_t *token)
+{
+    int rd;
+
+    if (token->file.fetch)
+    {
+        rd = (*token->file.fetch)(token->file.arg, &token->file.pbuf);
+        if (rd == 0)
+            return 0;
+    } else {
+        rd = read(token->file.fd, token->file.buf, TOKEN_FILE_BUF_SIZE);
+        if (rd < 0)
+        {
+            debug_emsg("File read error");
+            app_close(APP_EXITCODE_ERROR);
+        }
+        if (rd == 0)
+            return 0;
+
+        token->file.pbuf = token->file.buf;
+    }
+
+    token->file.cnt = rd;
+
+    return 1;
 }
 
 /*
@@ -75,22 +157,8 @@ static char *token_getchar(struct token_t *token)
     } else {
         char *ch;
 
-        if (token->file.cnt == 0)
-        {
-            int rd;
-
-            rd = read(token->file.fd, token->file.buf, TOKEN_FILE_BUF_SIZE);
-            if (rd < 0)
-            {
-                debug_emsg("File read error");
-                app_close(APP_EXITCODE_ERROR);
-            }
-            if (rd == 0)
-                return NULL;
-
-            token->file.cnt  = rd;
-            token->file.pbuf = token->file.buf;
-        }
+        if (token->file.cnt == 0 && !_token_refill(token))
+            return NULL;
 
         token->file.cnt--;
 
@@ -101,6 +169,7 @@ static char *token_getchar(struct token_t *token)
 
         token->trace.buf[token->trace.wp] = *ch;
         token->trace.nnext++;
+        token->trace.nread++;
 
         token->trace.wp++;
         if (token->trace.wp >= TOKEN_TRACE_SIZE)
@@ -117,6 +186,54 @@ static char *token_getchar(struct token_t *token)
     }
 }
 
+/*
+ * Read n characters of input to trace at once, as token_getchar() does it
+ * for every character.
+ *
+ * RETURN
+ *     number of characters readed, less than n on EOF
+ */
+static int _token_fill(struct token_t *token, int n)
+{
+    int length, rd;
+    char *ch, *end;
+
+    rd = 0;
+    while (rd < n)
+    {
+        if (token->file.cnt == 0 && !_token_refill(token))
+            break;
+
+        length = n - rd;
+        if (length > token->file.cnt)
+            length = token->file.cnt;
+        if (length > TOKEN_TRACE_SIZE - token->trace.wp)
+            length = TOKEN_TRACE_SIZE - token->trace.wp;
+
+        memcpy(&token->trace.buf[token->trace.wp], token->file.pbuf, length);
+        for (ch = token->file.pbuf, end = ch + length; (ch = memchr(ch, '\n', end - ch)); ch++)
+            token->file.line++;
+
+        token->file.pbuf     += length;
+        token->file.cnt      -= length;
+        token->trace.nnext   += length;
+        token->trace.nread   += length;
+        token->trace.wp      += length;
+        if (token->trace.wp >= TOKEN_TRACE_SIZE)
+            token->trace.wp = 0;
+        rd += length;
+
+        if (token->trace.nnext + token->trace.ncurrent > TOKEN_TRACE_SIZE)
+        {
+            /* NOTREACHED ? */
+            debug_emsg("Rollback exceed");
+            app_close(APP_EXITCODE_ERROR);
+        }
+    }
+
+    return rd;
+}
+
 //#define TOKEN_GETCHAR(t) _token_getchar(t)
 
 #ifdef TOKEN_GETCHAR
@@ -146,10 +263,14 @@ static char *_token_getchar(struct token_t *token)
 
 
 /*
+ * Lex token from input. Number of characters examined and payload length
+ * are returned for record, eof is set if end of input was reached.
+ *
  * RETURN
  *     pointer to token name, NULL if token does not appear in input stream
  */
-char *token_get(struct token_t *token, enum token_type_t type, int whence)
+static char *_token_lex(struct token_t *token, enum token_type_t type, int whence,
+        int *nfetch, int *ppayload, int *eof)
 {
     char *ch;
     int tpayload; /* token payload length */
@@ -177,10 +298,12 @@ char *token_get(struct token_t *token, enum token_type_t type, int whence)
         ch = TOKEN_GETCHAR(token);
         if (!ch)
         {
+            *eof = 1;
             if (type == TOKEN_TYPE_EOF)
                 break;
             return NULL;
         }
+        (*nfetch)++;
         if (tpayload >= TOKEN_MAX_NAME_SIZE)
         {
             /* NOTREACHED */
@@ -463,6 +586,7 @@ char *token_get(struct token_t *token, enum token_type_t type, int whence)
     }
 
     token->name[tpayload] = 0;
+    *ppayload = tpayload;
 
 #if 0
     printf("< TOCKEN GET, %u, %u, NCURRENT %u NNEXT %u" NL, type, whence, token->trace.ncurrent, token->trace.nnext);
@@ -473,6 +597,170 @@ char *token_get(struct token_t *token, enum token_type_t type, int whence)
     return token->name;
 }
 
+/*
+ * Save result of lexing at key of record.
+ */
+static void _token_record(struct token_t *token, struct token_record_t *record, long key,
+        enum token_type_t type, char *name, unsigned long pos, int nfetch, int tpayload)
+{
+    struct token_entry_t *entry;
+    int i;
+
+    if (!record->heads)
+    {
+        uint32_t k;
+
+        record->heads = malloc(sizeof(int) * record->size);
+        if (!record->heads)
+            goto error;
+        for (k = 0; k < record->size; k++)
+            record->heads[k] = -1;
+    }
+
+    if (record->heads[key] < 0)
+    {
+        if (record->nslots >= record->aslots)
+        {
+            void *p;
+
+            p = realloc(record->slots, sizeof(int) * TOKEN_TYPES * (record->aslots * 2 + 16));
+            if (!p)
+                goto error;
+            record->slots  = p;
+            record->aslots = record->aslots * 2 + 16;
+        }
+
+        for (i = 0; i < TOKEN_TYPES; i++)
+            record->slots[record->nslots * TOKEN_TYPES + i] = -1;
+        record->heads[key] = record->nslots++;
+    }
+
+    if (record->nentries >= record->aentries)
+    {
+        void *p;
+
+        p = realloc(record->entries, sizeof(struct token_entry_t) * (record->aentries * 2 + 16));
+        if (!p)
+            goto error;
+        record->entries  = p;
+        record->aentries = record->aentries * 2 + 16;
+    }
+
+    entry = &record->entries[record->nentries];
+    entry->found    = name ? 1 : 0;
+    entry->nfetch   = nfetch;
+    entry->drop     = 0;
+    entry->tlength  = 0;
+    entry->payload  = 0;
+    entry->tpayload = 0;
+
+    if (name)
+    {
+        if (record->npayload + tpayload + 1 > record->apayload)
+        {
+            void *p;
+            uint32_t size;
+
+            size = record->apayload * 2 + TOKEN_STRING_MAX;
+            p = realloc(record->payload, size);
+            if (!p)
+                goto error;
+            record->payload  = p;
+            record->apayload = size;
+        }
+
+        entry->tlength  = token->trace.ncurrent;
+        entry->drop     = token->trace.nread - pos - token->trace.ncurrent - token->trace.nnext;
+        entry->payload  = record->npayload;
+        entry->tpayload = tpayload;
+        memcpy(&record->payload[record->npayload], name, tpayload + 1);
+        record->npayload += tpayload + 1;
+    }
+
+    record->slots[record->heads[key] * TOKEN_TYPES + type] = record->nentries++;
+    return;
+error:
+    debug_emsg("Can not allocate memory for token record");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * Reproduce recorded lexing: characters examined by lexer are read to
+ * trace, current and next tokens are realligned as lexer does it.
+ */
+static char *_token_replay(struct token_t *token, struct token_record_t *record,
+        struct token_entry_t *entry, unsigned long pos)
+{
+    if (token->trace.nread - pos < entry->nfetch)
+    {
+        int n;
+
+        n = entry->nfetch - (token->trace.nread - pos);
+        if (_token_fill(token, n) < n)
+            return NULL;
+    }
+
+    if (!entry->found)
+        return NULL;
+
+    token->trace.ncurrent = entry->tlength;
+    token->trace.nnext    = token->trace.nread - pos - entry->tlength - entry->drop;
+    memcpy(token->name, &record->payload[entry->payload], entry->tpayload + 1);
+
+    return token->name;
+}
+
+/*
+ * RETURN
+ *     pointer to token name, NULL if token does not appear in input stream
+ */
+char *token_get(struct token_t *token, enum token_type_t type, int whence)
+{
+    struct token_record_t *record;
+    unsigned long pos;
+    long key;
+    int nfetch, tpayload, eof;
+    int i;
+    char *name;
+
+    nfetch   = 0;
+    tpayload = 0;
+    eof      = 0;
+
+    record = token->replay.record;
+    if (!record)
+        return _token_lex(token, type, whence, &nfetch, &tpayload, &eof);
+
+    if (whence == TOKEN_CURRENT)
+        pos = token->trace.nread - (token->trace.ncurrent + token->trace.nnext);
+    else
+        pos = token->trace.nread - token->trace.nnext;
+
+    if (pos < token->replay.start || pos >= token->replay.end)
+    {
+        token->replay.base = (*token->replay.key)(token->file.arg, pos,
+                &token->replay.start, &token->replay.end);
+        if (token->replay.base < 0)
+            token->replay.end = 0;
+    }
+    if (token->replay.base < 0)
+        return _token_lex(token, type, whence, &nfetch, &tpayload, &eof);
+
+    key = token->replay.base + (pos - token->replay.start);
+    if (record->heads && record->heads[key] >= 0)
+    {
+        i = record->slots[record->heads[key] * TOKEN_TYPES + type];
+        if (i >= 0)
+            return _token_replay(token, record, &record->entries[i], pos);
+    }
+
+    name = _token_lex(token, type, whence, &nfetch, &tpayload, &eof);
+    if (!eof && pos + nfetch <= token->replay.end)
+        _token_record(token, record, key, type, name, pos, nfetch, tpayload);
+
+    return name;
+}
+
 /*
  *
  */
@@ -505,6 +793,64 @@ void token_print_rollback(struct token_t *token)
     printf(NL);
 }
 
+/*
+ * RETURN
+ *     position of first not consumed character of input stream
+ */
+unsigned long token_mark(struct token_t *token)
+{
+    return token->trace.nread - token->trace.nnext;
+}
+
+/*
+ * Return input stream to position obtained by token_mark(). Characters
+ * after mark are replayed from trace buffer, so distance is limited by it's size.
+ *
+ * RETURN
+ *     0 on success, -1 if mark is out of trace buffer
+ */
+int token_rewind(struct token_t *token, unsigned long mark)
+{
+    unsigned long n;
+
+    if (mark > token->trace.nread)
+        return -1;
+
+    n = token->trace.nread - mark;
+    if (n > TOKEN_TRACE_SIZE)
+        return -1;
+
+    token->trace.ncurrent = 0;
+    token->trace.nnext    = n;
+
+    return 0;
+}
+
+/*
+ * Prepare empty record for keys from 0 to size - 1.
+ */
+void token_record_init(struct token_record_t *record, uint32_t size)
+{
+    memset(record, 0, sizeof(struct token_record_t));
+    record->size = size;
+}
+
+/*
+ *
+ */
+void token_record_destroy(struct token_record_t *record)
+{
+    if (record->heads)
+        free(record->heads);
+    if (record->slots)
+        free(record->slots);
+    if (record->entries)
+        free(record->entries);
+    if (record->payload)
+        free(record->payload);
+    memset(record, 0, sizeof(struct token_record_t));
+}
+
 /*
  *
  */
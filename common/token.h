@@ -29,6 +29,7 @@
 #define _TOKEN_H
 
 #include <limits.h>
+#include <stdint.h>
 /* */
 
 #define TOKEN_MAX_NAME_SIZE   1024
@@ -90,6 +91,42 @@ enum {
     TOKEN_NEXT,
 };
 
+#define TOKEN_TYPES (TOKEN_TYPE_NEGATE + 1)
+
+/*
+ * Results of lexing recorded by position of input, so input that is read
+ * again (body of macro or repeat block) is not lexed again. Position is
+ * translated to key of record by function given to token, input between
+ * token start and last character examined by lexer should be same for
+ * same key.
+ */
+struct token_entry_t {
+    uint8_t found;    /* token appears in input */
+    uint16_t drop;    /* length of dropped prefix */
+    uint16_t tlength; /* whole token length */
+    uint16_t nfetch;  /* characters examined by lexer */
+    uint16_t tpayload;
+    uint32_t payload; /* offset of payload in record */
+};
+
+struct token_record_t {
+    uint32_t size; /* number of keys */
+    int *heads;    /* slots of key, -1 if nothing recorded at key */
+
+    /* index of entry for every token type, -1 if not recorded */
+    int *slots;
+    int nslots;
+    int aslots;
+
+    struct token_entry_t *entries;
+    int nentries;
+    int aentries;
+
+    char *payload;
+    uint32_t npayload;
+    uint32_t apayload;
+};
+
 struct token_t {
     struct {
         int fd;
@@ -99,6 +136,10 @@ struct token_t {
         int cnt;
 
         int line;
+
+        /* alternative input, used instead of file descriptor if not NULL */
+        int (*fetch)(void *arg, char **pbuf);
+        void *arg;
     } file;
 
     struct {
@@ -108,8 +149,21 @@ struct token_t {
         int ncurrent;
         int nnext;
         int rollback;
+
+        unsigned long nread; /* characters readed from file */
     } trace;
 
+    /* replay of recorded lexing, used if record is not NULL */
+    struct {
+        struct token_record_t *record;
+        long (*key)(void *arg, unsigned long pos, unsigned long *start, unsigned long *end);
+
+        /* positions from start to end have keys from base */
+        unsigned long start;
+        unsigned long end;
+        long base;
+    } replay;
+
     char name[TOKEN_STRING_MAX];
 };
 
@@ -121,9 +175,18 @@ enum token_number_format_t {
 };
 
 void token_prepare(struct token_t *token, char *path);
+void token_prepare_fetch(struct token_t *token, char *name, int line,
+        int (*fetch)(void *arg, char **pbuf), void *arg);
+void token_prepare_record(struct token_t *token, struct token_record_t *record,
+        long (*key)(void *arg, unsigned long pos, unsigned long *start, unsigned long *end));
 char *token_get(struct token_t *token, enum token_type_t type, int whence);
 void token_drop(struct token_t *token);
 void token_print_rollback(struct token_t *token);
+unsigned long token_mark(struct token_t *token);
+int token_rewind(struct token_t *token, unsigned long mark);
+
+void token_record_init(struct token_record_t *record, uint32_t size);
+void token_record_destroy(struct token_record_t *record);
 
 /*******************************************
  * For easy wipeout collate tokens in list.
@@ -0,0 +1,218 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+/* */
+#include <debug.h>
+#include <app_common.h>
+#include "watch.h"
+
+#define WATCH_EVENTS        (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE)
+#define WATCH_EVENT_BUF     4096
+#define WATCH_SETTLE_TIME   20 /* ms, time without events to consider changes complete */
+
+struct watch_file_t {
+    int wd;
+    char *name; /* name of file without directory */
+};
+
+static void _watch_file_destroy(void *p);
+static int _watch_read(struct watch_t *w);
+
+/*
+ *
+ */
+void watch_init(struct watch_t *w)
+{
+    w->files = NULL;
+    w->fd = inotify_init1(IN_CLOEXEC);
+    if (w->fd < 0)
+    {
+        debug_emsgf("Failed to init inotify", "%s" NL, strerror(errno));
+        app_close(APP_EXITCODE_ERROR);
+    }
+}
+
+/*
+ *
+ */
+void watch_destroy(struct watch_t *w)
+{
+    llist_destroy(w->files);
+    w->files = NULL;
+    if (w->fd >= 0)
+        close(w->fd);
+    w->fd = -1;
+}
+
+/*
+ * Remove all watched files.
+ */
+void watch_clear(struct watch_t *w)
+{
+    watch_destroy(w);
+    watch_init(w);
+}
+
+/*
+ *
+ */
+void watch_add(struct watch_t *w, char *path)
+{
+    struct watch_file_t *f;
+    struct llist_t *head;
+    char *dir, *name;
+
+    f   = NULL;
+    dir = malloc(strlen(path) + 2);
+    if (!dir)
+        goto error;
+    strcpy(dir, path);
+
+    name = strrchr(path, '/');
+    if (name)
+    {
+        name++;
+        dir[name - path] = 0;
+    } else {
+        name = path;
+        strcpy(dir, ".");
+    }
+
+    f = malloc(sizeof(struct watch_file_t));
+    if (!f)
+        goto error;
+    f->name = malloc(strlen(name) + 1);
+    if (!f->name)
+        goto error;
+    strcpy(f->name, name);
+
+    /* for already watched directory same descriptor is returned */
+    f->wd = inotify_add_watch(w->fd, dir, WATCH_EVENTS);
+    if (f->wd < 0)
+    {
+        debug_emsgf("Failed to watch directory", "%s, %s" NL, dir, strerror(errno));
+        goto error;
+    }
+
+    head = llist_add(w->files, f, _watch_file_destroy, f);
+    if (!head)
+        goto error;
+    w->files = head;
+
+    free(dir);
+    return;
+error:
+    debug_emsgf("Can not watch file", "%s" NL, path);
+    if (dir)
+        free(dir);
+    if (f)
+        _watch_file_destroy(f);
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * Wait for change of any watched file. Events following within settle time
+ * are gathered, so group of files saved together cause one return.
+ */
+void watch_wait(struct watch_t *w)
+{
+    struct pollfd pfd;
+    int changed;
+
+    changed = 0;
+    while (!changed)
+        changed = _watch_read(w);
+
+    pfd.fd     = w->fd;
+    pfd.events = POLLIN;
+    while (poll(&pfd, 1, WATCH_SETTLE_TIME) > 0)
+        _watch_read(w);
+}
+
+/*
+ * RETURN
+ *     1 if watched file changed, 0 otherwise
+ */
+static int _watch_read(struct watch_t *w)
+{
+    char buf[WATCH_EVENT_BUF] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *event;
+    struct watch_file_t *f;
+    struct llist_t *ll;
+    ssize_t rd;
+    char *p;
+    int changed;
+
+    rd = read(w->fd, buf, sizeof(buf));
+    if (rd < 0)
+    {
+        if (errno == EINTR)
+            return 0;
+        debug_emsgf("Failed to read inotify events", "%s" NL, strerror(errno));
+        app_close(APP_EXITCODE_ERROR);
+    }
+
+    changed = 0;
+    for (p = buf; p < buf + rd; p += sizeof(struct inotify_event) + event->len)
+    {
+        event = (struct inotify_event *)p;
+        if (!event->len)
+            continue;
+
+        for (ll = w->files; ll; ll = ll->next)
+        {
+            f = ll->p;
+            if (f->wd == event->wd && strcmp(f->name, event->name) == 0)
+                changed = 1;
+        }
+    }
+
+    return changed;
+}
+
+/*
+ *
+ */
+static void _watch_file_destroy(void *p)
+{
+    struct watch_file_t *f;
+
+    if (!p)
+        return;
+
+    f = p;
+    if (f->name)
+        free(f->name);
+    free(f);
+}
+
@@ -167,7 +167,7 @@ void program_write()
         uint32_t elength;
         struct llist_t *loop;
 
-        upload = srec_read(app.inputfile);
+        upload = srec_read(app.inputfile, 1);
         if (!upload)
         {
             debug_emsg("Failed to read memory data");
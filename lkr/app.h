@@ -29,6 +29,7 @@
 #define _APPLICATION_H
 
 #include <limits.h>
+#include <setjmp.h>
 /* */
 #include <app_common.h>
 #include <token.h>
@@ -44,9 +45,39 @@ struct app_context_t {
 
     int printmap;
     int printmapdata;
+    char mapjson[PATH_MAX];             /* map in JSON format, empty if not needed */
+
+    /* symbols given with "-D", applied to each new linker context */
+#define DEFINES_MAX     64
+    char *defines[DEFINES_MAX];
+    int ndefines;
+
+    /* links of same input files, each one with own script, output and symbols */
+#define VARIANTS_MAX    16
+    struct app_variant_t {
+        char spec[PATH_MAX * 2]; /* "<script>,<output>[,<symbol>=<value>...]", split by zeros */
+        char *lscript;
+        char *outputfile;
+        char *defines[DEFINES_MAX];
+        int ndefines;
+    } variants[VARIANTS_MAX];
+    int nvariants;
+
+    int gcsections;                     /* drop sections not referenced from kept ones */
+    int icf;                            /* fold identical sections */
+    int relax;                          /* shrink instructions which operand fits short form */
+    int incremental;                    /* relink only changed objects, using state of previous link */
+    int stream;                         /* release data of input file after it is glued */
+    int jobs;                           /* number of threads loading and patching, of variants at once, 0 if number of processors */
+
+    int watch;                          /* relink on change of input files */
+    jmp_buf *watchjmp;                  /* return point of failed link in watch mode */
 };
 
 extern struct app_context_t app;
+extern __thread jmp_buf *app_taskjmp;   /* return point of failed task of linker thread */
+
+void app_variant(int n);
 
 #endif
 
@@ -34,9 +34,11 @@
 #include "app.h"
 #include "lang.h"
 #include "linker.h"
+#include "place.h"
 
 //static int _lang_db(struct asm_context_t *ctx, struct token_t *token, int width);
 static void _dot_print(const char *fmt, ...);
+static int _lang_value(struct linker_context_t *ctx, struct token_t *token, int64_t *value);
 
 /*
  *
@@ -244,6 +246,7 @@ int lang_directive(struct linker_context_t *ctx, struct token_t *token)
         s->exp = 1;
     } else if (strcmp(tname, "place") == 0) {
         struct section_t *s;
+        struct linker_region_t *lregion, *vregion;
         int64_t value;
 
         if (!(tname = token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT)))
@@ -265,8 +268,16 @@ int lang_directive(struct linker_context_t *ctx, struct token_t *token)
             goto error;
         }
 
-        if ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT)))
+        lregion = vregion = NULL;
+        if ((tname = token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT)))
         {
+            lregion = place_region_find(ctx, tname);
+            if (!lregion)
+            {
+                debug_emsgf("Region not found", "\"%s\"" NL, tname);
+                goto error;
+            }
+        } else if ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT))) {
             if (strcmp(tname, "NOLOAD") == 0)
             {
                 s->noload = 1;
@@ -294,8 +305,15 @@ int lang_directive(struct linker_context_t *ctx, struct token_t *token)
             s->lma = value;
         }
 
-        if ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT)))
+        if ((tname = token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT)))
         {
+            vregion = place_region_find(ctx, tname);
+            if (!vregion)
+            {
+                debug_emsgf("Region not found", "\"%s\"" NL, tname);
+                goto error;
+            }
+        } else if ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT))) {
             if (strcmp(tname, "NOLOAD") == 0)
             {
                 debug_emsg("NOLOAD not permitted for VMA");
@@ -315,17 +333,106 @@ int lang_directive(struct linker_context_t *ctx, struct token_t *token)
             if (lang_util_str2num(tname, &value) < 0)
                 goto error;
             s->vma = value;
+        } else if (lang_constexpr(&ctx->symbols, token, &value) == 0) {
+            s->vma = value;
+        } else if (lregion) {
+            /* VMA omitted, section is placed into region of LMA */
+            vregion = lregion;
         } else {
+            debug_emsg("No valid expression for VMA");
+            goto error;
+        }
 
-            if (lang_constexpr(&ctx->symbols, token, &value) < 0)
+        /* address in region is found after script */
+        if ((lregion || vregion) && place_request(ctx, s, lregion, vregion) < 0)
+            goto error;
+
+        s->placed = 1;
+    } else if (strcmp(tname, "keep") == 0) {
+        /* taken by lang_prescan() before sections are glued */
+        if (!token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT) &&
+            !token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT))
+        {
+            debug_emsg("Missing section or symbol name in \".keep\" directive");
+            goto error;
+        }
+    } else if (strcmp(tname, "fold") == 0) {
+        /* taken by lang_prescan() before sections are glued */
+        if (!token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT))
+        {
+            debug_emsg("Missing section name in \".fold\" directive");
+            goto error;
+        }
+        token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT);
+    } else if (strcmp(tname, "region") == 0) {
+        char name[TOKEN_STRING_MAX];
+        int64_t start, length;
+        int noload;
+
+        if (!(tname = token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT)))
+        {
+            debug_emsg("Missing region name in \".region\" directive");
+            goto error;
+        }
+        strncpy(name, tname, sizeof(name) - 1);
+        name[sizeof(name) - 1] = 0;
+
+        if (_lang_value(ctx, token, &start) < 0)
+        {
+            debug_emsg("Missing valid start address of region");
+            goto error;
+        }
+        if (_lang_value(ctx, token, &length) < 0)
+        {
+            debug_emsg("Missing valid length of region");
+            goto error;
+        }
+
+        noload = 0;
+        if ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT)))
+        {
+            if (strcmp(tname, "NOLOAD") != 0)
             {
-                debug_emsg("No valid expression for VMA");
+                debug_emsg("Only NOLOAD attribute permitted for region");
                 goto error;
             }
-            s->vma = value;
+            noload = 1;
         }
 
-        s->placed = 1;
+        if (!place_region_add(ctx, name, start, length, noload))
+            goto error;
+    } else if (strcmp(tname, "chip") == 0) {
+        if (!(tname = token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT)))
+        {
+            debug_emsg("Missing chip name in \".chip\" directive");
+            goto error;
+        }
+
+        if (place_chip(ctx, tname) < 0)
+            goto error;
+    } else if (strcmp(tname, "align") == 0) {
+        struct section_t *s;
+        int64_t align;
+
+        if (!(tname = token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT)))
+        {
+            debug_emsg("Missing sections name in \".align\" directive");
+            goto error;
+        }
+
+        s = section_find(&ctx->result.sections, tname);
+        if (!s)
+        {
+            debug_emsgf("Section not found", "\"%s\"" NL, tname);
+            goto error;
+        }
+
+        if (_lang_value(ctx, token, &align) < 0 || align <= 0 || align > 0x10000)
+        {
+            debug_emsg("Missing valid alignment in \".align\" directive");
+            goto error;
+        }
+        s->align = align;
     } else if (strcmp(tname, "fill") == 0) {
         struct section_t *s;
         int64_t cnt;
@@ -385,6 +492,138 @@ error:
     return -1;
 }
 
+/*
+ * ".keep" directive, section name or exported symbol which is root of
+ * garbage collection of sections.
+ */
+static void _lang_keep(struct linker_context_t *ctx, struct token_t *token)
+{
+    char *tname;
+
+    if ((tname = token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT)))
+    {
+        linker_keep_add(ctx, tname, 0);
+    } else if ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT))) {
+        linker_keep_add(ctx, tname, 1);
+    } else {
+        debug_emsg("Missing section or symbol name in \".keep\" directive");
+        goto error;
+    }
+
+    if (lang_comment(token) < 0)
+    {
+        debug_emsg("Unexpected symbols after directive");
+        goto error;
+    }
+
+    return;
+error:
+    token_print_rollback(token);
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * ".fold" directive, name of output section which identical input sections
+ * are folded in. With "STRINGS" input sections of it hold strings which are
+ * merged by string.
+ */
+static void _lang_fold(struct linker_context_t *ctx, struct token_t *token)
+{
+    char *tname;
+    char name[TOKEN_STRING_MAX];
+    int strings;
+
+    if (!(tname = token_get(token, TOKEN_TYPE_STRING, TOKEN_NEXT)))
+    {
+        debug_emsg("Missing section name in \".fold\" directive");
+        goto error;
+    }
+    strcpy(name, tname);
+
+    strings = 0;
+    if ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT)))
+    {
+        if (strcmp(tname, "STRINGS") != 0)
+        {
+            debug_emsgf("Unknown attribute of section", "\"%s\"" NL, tname);
+            goto error;
+        }
+        strings = 1;
+    }
+
+    if (lang_comment(token) < 0)
+    {
+        debug_emsg("Unexpected symbols after directive");
+        goto error;
+    }
+
+    linker_fold_add(ctx, name, strings);
+
+    return;
+error:
+    token_print_rollback(token);
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * Take directives which are needed before sections are glued: ".keep" and
+ * ".fold". Sections are collected and folded before script is run, so this
+ * is used by separate pass over script.
+ *
+ * RETURN
+ *     0 if directive taken, -1 if it is not one of them
+ */
+int lang_prescan(struct linker_context_t *ctx, struct token_t *token)
+{
+    char *tname;
+
+    if (!token_get(token, TOKEN_TYPE_DOT, TOKEN_CURRENT))
+        return -1;
+    tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT);
+    if (!tname)
+        return -1;
+
+    if (strcmp(tname, "keep") == 0)
+        _lang_keep(ctx, token);
+    else if (strcmp(tname, "fold") == 0)
+        _lang_fold(ctx, token);
+    else
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Get value given by symbol, number or expression.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _lang_value(struct linker_context_t *ctx, struct token_t *token, int64_t *value)
+{
+    char *tname;
+
+    if ((tname = token_get(token, TOKEN_TYPE_SYMBOL, TOKEN_NEXT)))
+    {
+        struct symbol_t *symbol;
+
+        symbol = symbol_find(&ctx->symbols, tname);
+        if (!symbol)
+        {
+            debug_emsgf("Symbol not defined", SQ NL, tname);
+            return -1;
+        }
+        *value = symbol->val64;
+    } else if ((tname = token_get(token, TOKEN_TYPE_NUMBER, TOKEN_NEXT))) {
+        if (lang_util_str2num(tname, value) < 0)
+            return -1;
+    } else if (lang_constexpr(&ctx->symbols, token, value) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  *
  */
@@ -36,6 +36,7 @@ int lang_comment(struct token_t *token);
 int lang_eof(struct token_t *token);
 int lang_const_symbol(struct linker_context_t *ctx, struct token_t *token);
 int lang_directive(struct linker_context_t *ctx, struct token_t *token);
+int lang_prescan(struct linker_context_t *ctx, struct token_t *token);
 
 #endif
 
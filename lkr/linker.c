@@ -28,6 +28,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
 /* */
 #include "app.h"
 #include <debug.h>
@@ -36,17 +39,45 @@
 #include <token.h>
 #include "linker.h"
 #include "lang.h"
+#include "place.h"
+#include "map.h"
 #include "memdata.h"
 #include "srec.h"
 
 struct linker_context_t lcontext;
 
-static void _load_file(struct linker_context_t *ctx, char *path);
+#define LINKER_EXPORTS_HASH_SIZE    1024 /* initial size, power of 2 */
+
+static struct linker_file_data_t *_create_file(char *fname);
+static struct linker_file_data_t *_add_file(struct linker_context_t *ctx, char *fname);
+static void _load_files(struct linker_context_t *ctx);
+static void _load_member(struct linker_context_t *ctx, struct linker_archive_t *la, int n);
+static void _load_members(struct linker_context_t *ctx);
+static void _link(struct linker_context_t *ctx);
+static int _symbol_exported(struct linker_context_t *ctx, char *name);
+static void _exports_add_file(struct linker_context_t *ctx, struct linker_file_data_t *fd);
+static struct linker_export_t *_exports_find(struct linker_context_t *ctx, char *name);
+static int _rgroups_build(struct linker_file_data_t *fd);
+static int _stream_names(struct linker_file_data_t *fd);
+static void _stream_release(struct linker_file_data_t *fd);
+static char *_basename(char *path);
+static char *_section_output_name(char *name, char *buf, size_t size);
+static struct symbol_t *_relocation_symbol(struct relocation_t *r);
+static char *_symbol_name(struct symbol_t *s);
 static void _print_map(struct linker_context_t *ctx);
+static void _gc_sections(struct linker_context_t *ctx);
+static void _fold_sections(struct linker_context_t *ctx);
+static void _relax(struct linker_context_t *ctx);
+static void _lscript_prescan(struct linker_context_t *ctx);
 static void _glue_sections(struct linker_context_t *ctx);
+static void _image_build(struct linker_context_t *ctx);
+static void _image_destroy(struct linker_context_t *ctx);
 static void _patch_sections(struct linker_context_t *ctx);
+static void _apply_relocations(struct linker_context_t *ctx);
 static void _lscript(struct linker_context_t *ctx);
 static void _write_srec(struct linker_context_t *ctx, char *path);
+static int _relink(struct linker_context_t *ctx);
+static void _state_write(struct linker_context_t *ctx);
 
 /*
  *
@@ -56,6 +87,19 @@ void linker_init()
     struct linker_context_t *ctx = &lcontext;
 
     lcontext.flist = NULL;
+    lcontext.alist = NULL;
+    lcontext.keeps = NULL;
+    lcontext.folds = NULL;
+
+    lcontext.exports.table = NULL;
+    lcontext.exports.size  = 0;
+    lcontext.exports.count = 0;
+
+    lcontext.image.data   = NULL;
+    lcontext.image.chunks = NULL;
+
+    place_init(ctx);
+    state_init(&ctx->state);
 
     symbols_init(&ctx->symbols);
     symbols_init(&ctx->result.symbols);
@@ -71,14 +115,37 @@ void linker_run()
 {
     struct linker_context_t *ctx = &lcontext;
 
-    while (app.innum--)
-        _load_file(ctx, *app.infiles++);
+    if (app.incremental && _relink(ctx) == 0)
+        return;
+
+    _load_files(ctx);
+    _load_members(ctx);
+    _link(ctx);
+}
+
+/*
+ * Link files loaded with script and output of application.
+ */
+static void _link(struct linker_context_t *ctx)
+{
+    if (app.gcsections || app.icf)
+        _lscript_prescan(ctx);
+    if (app.gcsections)
+        _gc_sections(ctx);
+    if (app.icf)
+        _fold_sections(ctx);
 
 #if 0
     printf("Link" NL);
 #endif
-    _glue_sections(ctx);
-    _lscript(ctx);
+    if (app.relax)
+    {
+        _relax(ctx);
+    } else {
+        _glue_sections(ctx);
+        _lscript(ctx);
+        place_sections(ctx);
+    }
     _patch_sections(ctx);
 
     if (*app.outputfile)
@@ -87,10 +154,143 @@ void linker_run()
         printf("Write %s" NL, app.outputfile);
 #endif
         _write_srec(ctx, app.outputfile);
+        if (app.incremental)
+            _state_write(ctx);
     }
 
     if (app.printmap)
         _print_map(ctx);
+    if (*app.mapjson)
+        map_write_json(ctx, app.mapjson);
+}
+
+/*
+ * Link n-th variant by child process, output of it is written to "log".
+ * Does not return.
+ */
+static void _link_variant(struct linker_context_t *ctx, int n, FILE *log)
+{
+    app.watchjmp = NULL;
+
+    if (dup2(fileno(log), STDOUT_FILENO) < 0 || dup2(fileno(log), STDERR_FILENO) < 0)
+        _exit(APP_EXITCODE_ERROR);
+
+    app_variant(n);
+    _link(ctx);
+    app_close(APP_EXITCODE_OK);
+}
+
+/*
+ * Link each variant given by "--variant" on files loaded once. Variants are
+ * linked by child processes, which share loaded files with parent as long
+ * as they do not change them, at most "app.jobs" of them at once (number of
+ * processors if not set). Output of each child is kept in temporary file and
+ * printed in order of variants, so it does not depend on order in which
+ * children finished.
+ */
+void linker_run_variants()
+{
+    struct linker_context_t *ctx = &lcontext;
+    struct _variant_run_t {
+        FILE *log;
+        pid_t pid;
+        int status;
+    } *runs;
+    int njobs, running, next, failed, status, i;
+    pid_t pid;
+
+    _load_files(ctx);
+    _load_members(ctx);
+
+    runs = calloc(app.nvariants, sizeof(struct _variant_run_t));
+    if (!runs)
+    {
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
+    for (i = 0; i < app.nvariants; i++)
+    {
+        runs[i].pid = -1;
+        runs[i].log = tmpfile();
+        if (!runs[i].log)
+        {
+            debug_emsg("Can not create temporary file");
+            goto error;
+        }
+    }
+
+    njobs = app.jobs > 0 ? app.jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (njobs < 1)
+        njobs = 1;
+
+    /* buffered output of parent should not be repeated by children */
+    fflush(stdout);
+    fflush(stderr);
+
+    running = 0;
+    next    = 0;
+    while (next < app.nvariants || running)
+    {
+        if (next < app.nvariants && running < njobs)
+        {
+            pid = fork();
+            if (pid == 0)
+                _link_variant(ctx, next, runs[next].log);
+            if (pid < 0)
+            {
+                /* variants not started yet are failed */
+                debug_emsg("Can not start process");
+                next = app.nvariants;
+                continue;
+            }
+            runs[next++].pid = pid;
+            running++;
+            continue;
+        }
+
+        pid = wait(&status);
+        if (pid < 0)
+            break;
+        for (i = 0; i < app.nvariants; i++)
+        {
+            if (runs[i].pid == pid)
+                runs[i].status = status;
+        }
+        running--;
+    }
+
+    failed = 0;
+    for (i = 0; i < app.nvariants; i++)
+    {
+        char buf[4096];
+        size_t length;
+
+        rewind(runs[i].log);
+        while ((length = fread(buf, 1, sizeof(buf), runs[i].log)) > 0)
+            fwrite(buf, 1, length, stdout);
+
+        if (runs[i].pid < 0 || !WIFEXITED(runs[i].status) || WEXITSTATUS(runs[i].status) != APP_EXITCODE_OK)
+        {
+            debug_emsgf("Failed to link variant", "\"%s\"" NL, app.variants[i].outputfile);
+            failed = 1;
+        }
+    }
+
+    for (i = 0; i < app.nvariants; i++)
+        fclose(runs[i].log);
+    free(runs);
+
+    if (failed)
+        app_close(APP_EXITCODE_ERROR);
+    return;
+error:
+    for (i = 0; i < app.nvariants; i++)
+    {
+        if (runs[i].log)
+            fclose(runs[i].log);
+    }
+    free(runs);
+    app_close(APP_EXITCODE_ERROR);
 }
 
 /*
@@ -101,11 +301,22 @@ void linker_destroy()
     struct linker_context_t *ctx = &lcontext;
 
     llist_destroy(ctx->flist);
+    llist_destroy(ctx->alist);
+    llist_destroy(ctx->keeps);
+    ctx->keeps = NULL;
+    llist_destroy(ctx->folds);
+    ctx->folds = NULL;
+    if (ctx->exports.table)
+        free(ctx->exports.table);
+    ctx->exports.table = NULL;
+    place_destroy(ctx);
+    state_destroy(&ctx->state);
     symbols_destroy(&ctx->symbols);
     symbols_destroy(&ctx->result.symbols);
     sections_destroy(&ctx->result.sections);
     relocations_destroy(&ctx->result.relocations);
     tokens_destroy(&ctx->tokens);
+    _image_destroy(ctx);
 }
 
 /*
@@ -130,562 +341,2679 @@ struct symbol_t * linker_add_symbol(struct linker_context_t *ctx, char *name, in
 /*
  *
  */
-static void _destroy_file_data(void *p)
+static void _destroy_keep(void *p)
 {
-    struct linker_file_data_t *fd;
+    struct linker_keep_t *k = p;
 
-    if (!p)
+    if (!k)
         return;
+    if (k->name)
+        free(k->name);
+    free(k);
+}
 
-    fd = p;
+/*
+ *
+ */
+static void _destroy_fold(void *p)
+{
+    struct linker_fold_t *f = p;
 
-    if (fd->fname)
-        free(fd->fname);
-    symbols_destroy(&fd->symbols);
-    sections_destroy(&fd->sections);
-    relocations_destroy(&fd->relocations);
+    if (!f)
+        return;
+    if (f->name)
+        free(f->name);
+    free(f);
 }
 
 /*
- *
+ * Add output section which identical input sections are folded in.
  */
-static void _load_file(struct linker_context_t *ctx, char *path)
+void linker_fold_add(struct linker_context_t *ctx, char *name, int strings)
 {
-    char *fname, *pfname;
     struct llist_t *head;
-    struct linker_file_data_t *fd, *lfd;
-
-    fname = NULL;
-    fd    = NULL;
+    struct linker_fold_t *f;
 
-#if 0
-    printf("Load file \"%s\"" NL, path);
-#endif
+    f = malloc(sizeof(struct linker_fold_t));
+    if (!f)
+        goto error;
+    f->name = malloc(strlen(name) + 1);
+    if (!f->name)
+        goto error;
+    strcpy(f->name, name);
+    f->strings = strings;
 
-    /* remove path from file name */
-    {
-        int slen;
+    head = llist_add(ctx->folds, f, _destroy_fold, f);
+    if (!head)
+        goto error;
+    ctx->folds = head;
 
-        slen = strlen(path);
+    return;
+error:
+    _destroy_fold(f);
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+}
 
-        pfname = path + strlen(path);
-        while (slen--)
-        {
-            if (*pfname == '/' || *pfname == '\\')
-            {
-                pfname++;
-                break;
-            }
-            pfname--;
-        }
-    }
+/*
+ * Add root of garbage collection of sections.
+ */
+void linker_keep_add(struct linker_context_t *ctx, char *name, int symbol)
+{
+    struct llist_t *head;
+    struct linker_keep_t *k;
 
-    fname = malloc(strlen(pfname) + 1);
-    if (!fname)
+    k = malloc(sizeof(struct linker_keep_t));
+    if (!k)
         goto error;
-    strcpy(fname, pfname);
-
-    fd = malloc(sizeof(struct linker_file_data_t));
-    if (!fd)
+    k->name = malloc(strlen(name) + 1);
+    if (!k->name)
         goto error;
+    strcpy(k->name, name);
+    k->symbol = symbol;
 
-    fd->fname = fname;
-    fname = NULL;
-    symbols_init(&fd->symbols);
-    sections_init(&fd->sections);
-    relocations_init(&fd->relocations);
-
-    head = llist_add(ctx->flist, fd, _destroy_file_data, fd);
+    head = llist_add(ctx->keeps, k, _destroy_keep, k);
     if (!head)
         goto error;
-    ctx->flist = head;
-    lfd = fd;
-    fd = NULL;
-
-    if (l0_load(path, &lfd->symbols, &lfd->sections, &lfd->relocations) < 0)
-        goto error;
+    ctx->keeps = head;
 
     return;
 error:
-    if (fname)
-        free(fname);
-    if (fd)
-        _destroy_file_data(fd);
-    debug_emsgf("Failed to load file", "\"%s\"" NL, path);
+    _destroy_keep(k);
+    debug_emsg("Can not allocate memory");
     app_close(APP_EXITCODE_ERROR);
-    return;
 }
 
 /*
  *
  */
-static void _print_symbols(struct symbols_t *symbols)
+static void _destroy_file_data(void *p)
 {
-    struct llist_t *loop;
-    struct symbol_t *s;
-
-    printf(NL);
-    printf("-------------" NL);
-    printf("-- Symbols --" NL);
-    printf("-------------" NL);
-
-    symbols_mkloop(symbols, &loop);
-    while ((s = symbols_next(&loop)))
-    {
-        if (s->type == SYMBOL_TYPE_NONE)
-            continue;
-        switch (s->type)
-        {
-            case SYMBOL_TYPE_CONST:  printf("CONST"); break;
-            case SYMBOL_TYPE_EXTERN: printf("EXTERN"); break;
-            case SYMBOL_TYPE_LABEL:  printf("LABEL"); break;
-            default:                 printf("-----");
-        }
-        printf(", width %u", s->width);
-        printf(", export %u", s->exp);
-        printf(", value 0x%06llX (%lld)", (long long int)s->val64, (long long int)s->val64);
-        printf(" \"%s\"", s->name);
-        if (s->section)
-            printf(", section \"%s\"", s->section);
+    struct linker_file_data_t *fd;
 
-        printf(NL);
+    if (!p)
+        return;
 
-        /* print attributes */
-        {
-            struct symbol_attr_t *a;
-            struct llist_t *loop;
+    fd = p;
 
-            symbol_attr_mkloop(s, &loop);
-            while ((a = symbol_attr_next(&loop)))
-                printf("\tattr \"%s\" = \"%s\"" NL, a->name, a->value ? a->value : "NULL");
-        }
-    }
+    if (fd->fname)
+        free(fd->fname);
+    symbols_destroy(&fd->symbols);
+    sections_destroy(&fd->sections);
+    relocations_destroy(&fd->relocations);
+    if (fd->rgroups.table)
+        free(fd->rgroups.table);
+    if (fd->rgroups.list)
+        free(fd->rgroups.list);
+    l0_unmap(&fd->map);
+    if (fd->strings)
+        free(fd->strings);
+    free(fd);
 }
 
 /*
+ * Create empty file data.
  *
+ * RETURN
+ *     file data, NULL on error
  */
-static void _print_relocations(struct relocations_t *relocations)
+static struct linker_file_data_t *_create_file(char *fname)
 {
-    struct relocation_t *r;
-    struct llist_t *loop;
+    struct linker_file_data_t *fd;
 
-    printf(NL);
-    printf("-----------------" NL);
-    printf("-- Relocations --" NL);
-    printf("-----------------" NL);
+    fd = malloc(sizeof(struct linker_file_data_t));
+    if (!fd)
+        return NULL;
 
-    relocations_mkloop(relocations, &loop);
-    while ((r = relocations_next(&loop)))
+    symbols_init(&fd->symbols);
+    sections_init(&fd->sections);
+    relocations_init(&fd->relocations);
+    fd->rgroups.table = NULL;
+    fd->rgroups.list  = NULL;
+    fd->rgroups.size  = 0;
+    fd->map.addr   = NULL;
+    fd->map.length = 0;
+    fd->strings    = NULL;
+
+    fd->fname = malloc(strlen(fname) + 1);
+    if (!fd->fname)
     {
-        printf("%s", r->type == RELOCATION_TYPE_ABOSULTE ? "ABS" : "REL");
-        printf(", offset: 0x%06X", r->offset);
-        printf(", length: 0x%02X", r->length);
-        printf(", section: \"%s\"", r->section);
-        printf(", symbol: \"%s\"", r->symbol);
-        if (r->type == RELOCATION_TYPE_ABOSULTE)
-            printf(", adjust: --");
-        else
-            printf(", adjust: %d", r->adjust);
-        printf(NL);
+        _destroy_file_data(fd);
+        return NULL;
     }
+    strcpy(fd->fname, fname);
+
+    return fd;
 }
 
 /*
- *
+ * Add empty file data to the end of list of files.
  */
-static void _print_sections(struct sections_t *sections)
+static struct linker_file_data_t *_add_file(struct linker_context_t *ctx, char *fname)
 {
-    struct llist_t *loop;
-    struct section_t *s;
+    struct llist_t *head;
+    struct linker_file_data_t *fd;
 
-    printf(NL);
-    printf("--------------" NL);
-    printf("-- Sections --" NL);
-    printf("--------------" NL);
+    fd = _create_file(fname);
+    if (!fd)
+    {
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
 
-    sections_mkloop(sections, &loop);
-    while ((s = sections_next(&loop)))
+    head = llist_add(ctx->flist, fd, _destroy_file_data, fd);
+    if (!head)
     {
-        printf(NL);
-        printf("Section \"%s\" %s" NL, s->name, s->noload ? "NOLOAD" : "");
-        if (!s->noload)
-            printf("    LMA    0x%06X" NL, s->lma);
-        printf("    VMA    0x%06X" NL, s->vma);
-        printf("    size   0x%06X" NL, s->length);
-        if (!s->noload && app.printmapdata)
-            debug_buf((uint8_t*)s->data, s->length);
+        _destroy_file_data(fd);
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
     }
+    ctx->flist = head;
+
+    return fd;
 }
 
 /*
  *
  */
-static void _print_map(struct linker_context_t *ctx)
+static void _destroy_archive(void *p)
 {
-    struct llist_t *floop;
+    struct linker_archive_t *la;
 
-    printf(NL);
-    printf("############" NL);
-    printf("## Input  ##" NL);
-    printf("############" NL);
+    if (!p)
+        return;
 
-    for (floop = ctx->flist; floop; floop = floop->next)
-    {
-        struct linker_file_data_t *fd = floop->p;
+    la = p;
+    if (la->fname)
+        free(la->fname);
+    if (la->loaded)
+        free(la->loaded);
+    l0_archive_close(&la->ar);
+    free(la);
+}
 
-        printf(NL);
-        printf("*****************************" NL);
-        printf("** %s " NL, fd->fname);
-        printf("*****************************" NL);
+/*
+ * RETURN
+ *     opened archive, NULL on error
+ */
+static struct linker_archive_t *_create_archive(char *path)
+{
+    struct linker_archive_t *la;
 
-        _print_symbols(&fd->symbols);
-        _print_relocations(&fd->relocations);
-        _print_sections(&fd->sections);
+    la = calloc(1, sizeof(struct linker_archive_t));
+    if (!la)
+        goto error;
 
-        printf(NL);
-    }
+    if (l0_archive_open(path, &la->ar) < 0)
+        goto error;
 
-    printf(NL);
-    printf("############" NL);
-    printf("## Output ##" NL);
-    printf("############" NL);
+    la->fname  = malloc(strlen(_basename(path)) + 1);
+    la->loaded = calloc(la->ar.nmembers ? la->ar.nmembers : 1, sizeof(uint8_t));
+    if (!la->fname || !la->loaded)
+        goto error;
+    strcpy(la->fname, _basename(path));
 
-    _print_symbols(&ctx->result.symbols);
-    _print_relocations(&ctx->result.relocations);
-    _print_sections(&ctx->result.sections);
+    return la;
+error:
+    if (la)
+        _destroy_archive(la);
+    return NULL;
 }
 
-struct _symbol_find_info_t {
-    char *sname;             /* symbol to find */
-    char *fexclude;          /* exclude file from search */
-
-    char *ffound;            /* name of file in which symbol was found, NULL if symbol was found on linker context */
-    struct symbol_t *symbol; /* pointer to found symbol */
+/*
+ * Tasks run by threads, each task is taken by first free thread.
+ */
+struct _tasks_t {
+    pthread_mutex_t lock;
+    int next;   /* next task to run */
+    int count;  /* number of tasks */
+    int failed; /* first task failed, -1 if none */
+
+    void (*run)(void *arg, int n);
+    void *arg;
 };
 
 /*
- *
+ * Run tasks until no one left. Task which calls app_close() returns here, it
+ * is marked as failed and thread takes next one.
  */
-void _symbol_find_extern(struct linker_context_t *ctx, struct _symbol_find_info_t *find)
+static void *_tasks_thread(void *p)
 {
-    struct llist_t *floop;
-    struct symbol_t *sext;
+    struct _tasks_t *tasks = p;
+    jmp_buf env;
+    int n;
 
-    /* find symbol in files */
-    sext = NULL;
-    for (floop = ctx->flist; floop; floop = floop->next)
+    while (1)
     {
-        struct linker_file_data_t *fd = floop->p;
-        struct symbol_t *s;
-        struct llist_t *loop;
+        pthread_mutex_lock(&tasks->lock);
+        n = tasks->next++;
+        pthread_mutex_unlock(&tasks->lock);
 
-        if (strcmp(fd->fname, find->fexclude) == 0)
-            continue;
+        if (n >= tasks->count)
+            break;
 
-        symbols_mkloop(&fd->symbols, &loop);
-        while ((s = symbols_next(&loop)))
+        if (setjmp(env) == 0)
         {
-            if (strcmp(find->sname, s->name) == 0 && s->exp)
-            {
-                if (sext)
-                {
-                    debug_emsgf("Symbol redefined", "\"%s\"" NL, find->sname);
-                    app_close(APP_EXITCODE_ERROR);
-                }
-                sext = s;
-                find->ffound = fd->fname;
-            }
+            app_taskjmp = &env;
+            (*tasks->run)(tasks->arg, n);
+        } else {
+            pthread_mutex_lock(&tasks->lock);
+            if (tasks->failed < 0 || n < tasks->failed)
+                tasks->failed = n;
+            pthread_mutex_unlock(&tasks->lock);
         }
+        app_taskjmp = NULL;
     }
 
-    /* find symbol in linker context */
+    return NULL;
+}
+
+/*
+ * Run "count" tasks with at most "app.jobs" threads (number of processors if
+ * not set) and wait for them to finish. Calling thread is one of them, if
+ * thread can not be created others do its work.
+ *
+ * RETURN
+ *     first task failed, -1 if all tasks finished
+ */
+static int _run_tasks(void (*run)(void *arg, int n), void *arg, int count)
+{
+    struct _tasks_t tasks;
+    pthread_t *threads;
+    int nthreads, started, i;
+
+    nthreads = app.jobs > 0 ? app.jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > count)
+        nthreads = count;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    threads = malloc(nthreads * sizeof(pthread_t));
+    if (!threads)
     {
-        struct symbol_t *s;
-        struct llist_t *loop;
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
 
-        symbols_mkloop(&ctx->symbols, &loop);
-        while ((s = symbols_next(&loop)))
-        {
-            if (strcmp(find->sname, s->name) == 0)
-            {
-                if (sext)
-                {
-                    debug_emsgf("Symbol redefined", "\"%s\"" NL, find->sname);
-                    app_close(APP_EXITCODE_ERROR);
-                }
-                sext = s;
-            }
-        }
+    tasks.next   = 0;
+    tasks.count  = count;
+    tasks.failed = -1;
+    tasks.run    = run;
+    tasks.arg   = arg;
+    pthread_mutex_init(&tasks.lock, NULL);
+
+    for (started = 0; started < nthreads - 1; started++)
+    {
+        if (pthread_create(&threads[started], NULL, _tasks_thread, &tasks) != 0)
+            break;
     }
+    _tasks_thread(&tasks);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
 
-    find->symbol = sext;
+    pthread_mutex_destroy(&tasks.lock);
+    free(threads);
+
+    return tasks.failed;
 }
 
+/*
+ * Input file given in command line, loaded by thread.
+ */
+struct _load_result_t {
+    enum {
+        LOAD_FAILED = 0,
+        LOAD_FILE,
+        LOAD_ARCHIVE,
+    } type;
+    void *p; /* file data or archive */
+};
 
 /*
- *
+ * Load n-th input file. Loading of file only touches own file data, so files
+ * are loaded independently of each other. Failure is left in result, it is
+ * reported by main thread.
  */
-static char *_mkname(char *f, char *s)
+static void _load_task(void *arg, int n)
 {
-    static char namebuf[TOKEN_STRING_MAX * 2];
+    struct _load_result_t *result;
+    char *path;
 
-    *namebuf = 0;
+    path   = app.infiles[n];
+    result = &((struct _load_result_t *)arg)[n];
 
-    strcat(namebuf, f);
-    strcat(namebuf, ":");
-    strcat(namebuf, s);
+    if (l0_archive_probe(path))
+    {
+        result->p = _create_archive(path);
+        if (result->p)
+            result->type = LOAD_ARCHIVE;
+        return;
+    }
 
-    return namebuf;
+    {
+        struct linker_file_data_t *fd;
+
+        fd = _create_file(_basename(path));
+        if (!fd)
+            return;
+        /* file data is released by main thread if task is interrupted */
+        result->p = fd;
+        if (l0_load(path, &fd->map, &fd->symbols, &fd->sections, &fd->relocations) < 0)
+            return;
+        if (_rgroups_build(fd) < 0)
+            return;
+        if (app.stream && _stream_names(fd) < 0)
+            return;
+
+        result->type = LOAD_FILE;
+    }
 }
 
 /*
- *
+ * Load input files given in command line on threads. Loaded files are merged
+ * in order of command line, so result of link does not depend on order in
+ * which threads finished.
  */
-static void _add_relocation(struct linker_context_t *ctx, struct linker_file_data_t *fd, struct symbol_t *s, char *rsname)
+static void _load_files(struct linker_context_t *ctx)
 {
-    struct llist_t *loop;
-    struct relocation_t *r;
+    struct _load_result_t *results;
+    int failed, i;
 
-    relocations_mkloop(&fd->relocations, &loop);
-    while ((r = relocations_next(&loop)))
+    results = calloc(app.innum, sizeof(struct _load_result_t));
+    if (!results)
     {
-        struct section_t *section;
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
 
-        if (strcmp(r->symbol, s->name) != 0)
-            continue;
+    /* failed task is left with failed result */
+    _run_tasks(_load_task, results, app.innum);
 
-        section = section_find(&ctx->result.sections, r->section);
-        if (!section)
-        {
-            /* NOTREACHED */
-            debug_emsg("Section not found for relocation");
-            app_close(APP_EXITCODE_ERROR);
-        }
+    /* merge */
+    failed = -1;
+    for (i = 0; i < app.innum; i++)
+    {
+        struct _load_result_t *result = &results[i];
+        struct llist_t *head;
 
-        if (r->length != s->width)
+        head = NULL;
+        switch (result->type)
         {
-            /* NOTREACHED */
-            debug_emsgf("Relocation mismatch symbol width", "\"%s\""NEW_LINE, s->name);
-            app_close(APP_EXITCODE_ERROR);
+            case LOAD_FILE:
+                head = llist_add(ctx->flist, result->p, _destroy_file_data, result->p);
+                if (head)
+                    ctx->flist = head;
+                else
+                    _destroy_file_data(result->p);
+                break;
+            case LOAD_ARCHIVE:
+                head = llist_add(ctx->alist, result->p, _destroy_archive, result->p);
+                if (head)
+                    ctx->alist = head;
+                else
+                    _destroy_archive(result->p);
+                break;
+            default:
+                _destroy_file_data(result->p);
+                break;
         }
+        if (!head && failed < 0)
+            failed = i;
+    }
+    free(results);
 
-        relocations_add(&ctx->result.relocations,
-                section->name,                  /* section name to patch */
-                rsname,  /* symbol from witch value should retereived */
-                r->offset + section->offset,    /* offset of relocation */
-                r->length,                      /* */
-                r->adjust,
-                r->type
-        );
+    if (failed >= 0)
+    {
+        debug_emsgf("Failed to load file", "\"%s\"" NL, app.infiles[failed]);
+        app_close(APP_EXITCODE_ERROR);
     }
 
+    {
+        struct llist_t *floop;
+
+        for (floop = ctx->flist; floop; floop = floop->next)
+            _exports_add_file(ctx, floop->p);
+    }
 }
 
 /*
- *
+ * Member is named "<archive>(<member>)". Object of member references mapping
+ * of archive.
  */
-static void _add_symbols(struct linker_context_t *ctx, struct linker_file_data_t *fd)
+static void _load_member(struct linker_context_t *ctx, struct linker_archive_t *la, int n)
 {
-    struct symbol_t *s;
-    struct symbol_t *sext;
-    struct llist_t *loop;
-
-    symbols_mkloop(&fd->symbols, &loop);
-    while ((s = symbols_next(&loop)))
-    {
-        if (s->type == SYMBOL_TYPE_EXTERN)
-        {
-            struct _symbol_find_info_t find;
-
-            find.sname    = s->name;
-            find.fexclude = fd->fname;
-            find.symbol   = NULL;
-            find.ffound   = NULL;
-
-            _symbol_find_extern(ctx, &find);
-            sext = find.symbol;
-
-            if (sext && find.ffound)
-            {
-                /*
-                 * Extern symbol was found in file.
-                 */
-                _add_relocation(ctx, fd, s, _mkname(find.ffound, s->name));
-            } else {
-                if (sext)
-                {
-                    /*
-                     * Extern symbol was found in linker context.
-                     */
-                    struct symbol_t *ns;
-
-                    if (!symbol_find(&ctx->result.symbols, s->name))
-                    {
-                        ns = symbols_add(&ctx->result.symbols, s->name);
-                        symbol_set_const(ns, find.symbol->val64);
-                        ns->width = s->width;
-                    }
-                } else {
-                    /*
-                     * Not found, add as extern symbol. Check in future in linker context (after linker script pass).
-                     */
-                    struct symbol_t *ns;
-
-                    if (!symbol_find(&ctx->result.symbols, s->name))
-                    {
-                        ns = symbols_add(&ctx->result.symbols, s->name);
-                        ns->type  = SYMBOL_TYPE_EXTERN;
-                        ns->width = s->width;
-                    }
-                }
-                _add_relocation(ctx, fd, s, s->name);
-            }
-        } else {
-            struct symbol_t *ns;
-            struct section_t *rs;
-
-            if (!s->section)
-            {
-                /* NOTREACHED */
-                debug_emsgf("Symbol has not section", "\"%s\"" NL, s->name);
-                app_close(APP_EXITCODE_ERROR);
-            }
+    struct linker_file_data_t *fd;
+    char fname[PATH_MAX * 2 + 3];
+    char *mname;
+    void *data;
+    size_t length;
 
-            rs = section_find(&ctx->result.sections, s->section);
-            if (!rs)
-            {
-                /* NOTREACHED */
-                debug_emsgf("Section not found", "\"%s\"" NL, s->section);
-                app_close(APP_EXITCODE_ERROR);
-            }
+    mname = l0_archive_member(&la->ar, n, &data, &length);
+    snprintf(fname, sizeof(fname), "%s(%s)", la->fname, mname);
 
-            ns = symbols_add(&ctx->result.symbols, _mkname(fd->fname, s->name));
-            ns->type   = SYMBOL_TYPE_LABEL;
-            ns->width  = s->width;
-            ns->offset = s->offset + rs->offset;
-            ns->exp    = s->exp; /* not used, just for debug */
-            symbol_set_section(ns, s->section);
+    la->loaded[n] = 1;
 
-            _add_relocation(ctx, fd, s, _mkname(fd->fname, s->name));
-        }
+    fd = _add_file(ctx, fname);
+    if (l0_load_mem(data, length, &fd->symbols, &fd->sections, &fd->relocations) < 0)
+    {
+        debug_emsgf("Failed to load archive member", "\"%s\"" NL, fname);
+        app_close(APP_EXITCODE_ERROR);
     }
+    if (_rgroups_build(fd) < 0 || (app.stream && _stream_names(fd) < 0))
+    {
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
+    _exports_add_file(ctx, fd);
 }
 
 /*
- *
+ * Load members of archives which export symbols referenced by loaded files and
+ * not defined by them. Loaded members are appended to list of files, so their
+ * references are resolved within same loop, until nothing new is needed.
+ * Archives are searched in order they were given.
  */
-static void _glue_sections(struct linker_context_t *ctx)
+static void _load_members(struct linker_context_t *ctx)
 {
-    struct llist_t *floop;
+    struct llist_t *floop, *aloop;
+
+    if (!ctx->alist)
+        return;
 
     for (floop = ctx->flist; floop; floop = floop->next)
     {
         struct linker_file_data_t *fd = floop->p;
+        struct symbol_t *s;
+        struct llist_t *loop;
 
-        /* loop thru sections of file */
+        symbols_mkloop(&fd->symbols, &loop);
+        while ((s = symbols_next(&loop)))
         {
-            struct llist_t *loop;
-            struct section_t *rsection;
-            struct section_t *section;
+            if (s->type != SYMBOL_TYPE_EXTERN)
+                continue;
+            if (symbol_find(&ctx->symbols, s->name) || _symbol_exported(ctx, s->name))
+                continue;
 
-            sections_mkloop(&fd->sections, &loop);
-            while ((section = sections_next(&loop)))
+            for (aloop = ctx->alist; aloop; aloop = aloop->next)
             {
-                rsection = section_select(&ctx->result.sections, section->name);
-
-                if (!rsection->noload)
-                    rsection->noload = section->noload;
-                if (rsection->noload != section->noload)
-                {
-                    debug_emsgf("NOLOAD attribute of section mismatch", "\"%s\"" NL, section->name);
-                    app_close(APP_EXITCODE_ERROR);
-                }
+                struct linker_archive_t *la = aloop->p;
+                int n;
 
-                section_pushdata(rsection, section->data, section->length);
+                n = l0_archive_find(&la->ar, s->name);
+                if (n < 0)
+                    continue;
+                if (!la->loaded[n])
+                    _load_member(ctx, la, n);
+                break;
             }
-
-            /* fix, rename symbols */
-            _add_symbols(ctx, fd);
-
-            /* add section offset */
-            sections_mkloop(&ctx->result.sections, &loop);
-            while ((section = sections_next(&loop)))
-                section->offset += section->length;
         }
     }
 }
 
 /*
- *
+ * RETURN
+ *     1 if symbol exported by any of loaded files, 0 otherwise
  */
-static uint64_t _mkpatch(uint64_t value, int width)
+static int _symbol_exported(struct linker_context_t *ctx, char *name)
 {
-    switch (width)
-    {
-        case 1: return host_tole32(value);
-        case 2: return host_tobe16(value);
-        case 3: return host_tobe24(value);
-        default:
-            /* NOTREACHED */
-            debug_emsg("Invalid width");
-            app_close(APP_EXITCODE_ERROR);
-            return 0;
-    }
+    return _exports_find(ctx, name) ? 1 : 0;
 }
 
-#if 0
 /*
- *
+ * RETURN
+ *     hash of symbol name
  */
-static int64_t _mkdif(int64_t val1, int64_t val2)
+static uint32_t _name_hash(char *name)
 {
-    if (val2 > val1)
-        return val2 - val1;
-    else
-        return val1 - val2;
+    uint32_t h;
+
+    h = 5381;
+    while (*name)
+        h = h * 33 + (unsigned char)*name++;
+
+    return h;
 }
 
 /*
- *
+ * Double size of exports hash.
  */
-static int64_t _maxnum(int width)
+static void _exports_grow(struct linker_context_t *ctx)
 {
-    if (width == 1)
-        return 0xff;
-    if (width == 2)
-        return 0xffff;
-    if (width == 3)
-        return 0xffffff;
+    struct linker_export_t *table, *e;
+    uint32_t size, i, n;
 
-    /* NOTREACHED */
-    debug_emsg("Invalid width");
-    app_close(APP_EXITCODE_ERROR);
-    return 0;
+    size  = ctx->exports.size ? ctx->exports.size * 2 : LINKER_EXPORTS_HASH_SIZE;
+    table = calloc(size, sizeof(struct linker_export_t));
+    if (!table)
+    {
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
+
+    for (i = 0; i < ctx->exports.size; i++)
+    {
+        e = &ctx->exports.table[i];
+        if (!e->symbol)
+            continue;
+
+        for (n = _name_hash(e->symbol->name) & (size - 1); table[n].symbol; n = (n + 1) & (size - 1))
+            ;
+        table[n] = *e;
+    }
+
+    if (ctx->exports.table)
+        free(ctx->exports.table);
+    ctx->exports.table = table;
+    ctx->exports.size  = size;
 }
-#endif
 
 /*
- *
+ * Add symbols exported by file to hash. Symbol exported by more than one
+ * file is an error.
  */
-static int64_t _smaxnum(int width)
+static void _exports_add_file(struct linker_context_t *ctx, struct linker_file_data_t *fd)
 {
-    if (width == 1)
-        return 0x7F;
+    struct symbol_t *s;
+    struct llist_t *loop;
+    uint32_t n;
 
-    /* NOTREACHED */
-    debug_emsg("Invalid width");
-    app_close(APP_EXITCODE_ERROR);
-    return 0;
+    symbols_mkloop(&fd->symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        if (!s->exp || s->type != SYMBOL_TYPE_LABEL)
+            continue;
+
+        /* keep hash at most half full */
+        if ((ctx->exports.count + 1) * 2 > ctx->exports.size)
+            _exports_grow(ctx);
+
+        n = _name_hash(s->name) & (ctx->exports.size - 1);
+        for (; ctx->exports.table[n].symbol; n = (n + 1) & (ctx->exports.size - 1))
+        {
+            if (strcmp(ctx->exports.table[n].symbol->name, s->name) == 0)
+            {
+                debug_emsgf("Symbol redefined", "\"%s\"" NL, s->name);
+                app_close(APP_EXITCODE_ERROR);
+            }
+        }
+
+        ctx->exports.table[n].symbol = s;
+        ctx->exports.table[n].fd     = fd;
+        ctx->exports.count++;
+    }
 }
 
 /*
- *
+ * RETURN
+ *     entry of exported symbol, NULL if symbol not exported by any file
  */
-static int64_t _sminnum(int width)
+static struct linker_export_t *_exports_find(struct linker_context_t *ctx, char *name)
 {
-    if (width == 1)
-        return -128;
+    struct linker_export_t *e;
+    uint32_t n;
+
+    if (!ctx->exports.size)
+        return NULL;
+
+    n = _name_hash(name) & (ctx->exports.size - 1);
+    for (; (e = &ctx->exports.table[n])->symbol; n = (n + 1) & (ctx->exports.size - 1))
+    {
+        if (strcmp(e->symbol->name, name) == 0)
+            return e;
+    }
+
+    return NULL;
+}
+
+/*
+ * Group relocations of file by symbol they reference, so each symbol visits
+ * only its own fixups. Groups keep relocations in order of file.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _rgroups_build(struct linker_file_data_t *fd)
+{
+    struct linker_reloc_group_t *g;
+    struct relocation_t *r;
+    struct llist_t *loop;
+    uint32_t count, size, n;
+    struct relocation_t **list;
+
+    count = 0;
+    relocations_mkloop(&fd->relocations, &loop);
+    while ((r = relocations_next(&loop)))
+        count++;
+    if (!count)
+        return 0;
+
+    /* keep hash at most half full */
+    for (size = 16; size < count * 2; size *= 2)
+        ;
+    fd->rgroups.table = calloc(size, sizeof(struct linker_reloc_group_t));
+    fd->rgroups.list  = malloc(count * sizeof(struct relocation_t *));
+    if (!fd->rgroups.table || !fd->rgroups.list)
+        return -1;
+    fd->rgroups.size = size;
+
+    /* count relocations of each group */
+    relocations_mkloop(&fd->relocations, &loop);
+    while ((r = relocations_next(&loop)))
+    {
+        n = _name_hash(r->symbol) & (size - 1);
+        for (; (g = &fd->rgroups.table[n])->symbol; n = (n + 1) & (size - 1))
+        {
+            if (strcmp(g->symbol, r->symbol) == 0)
+                break;
+        }
+        g->symbol = r->symbol;
+        g->count++;
+    }
+
+    /* give each group its part of list */
+    list = fd->rgroups.list;
+    for (n = 0; n < size; n++)
+    {
+        g = &fd->rgroups.table[n];
+        if (!g->symbol)
+            continue;
+        g->first = list;
+        list += g->count;
+        g->count = 0;
+    }
+
+    relocations_mkloop(&fd->relocations, &loop);
+    while ((r = relocations_next(&loop)))
+    {
+        n = _name_hash(r->symbol) & (size - 1);
+        for (; strcmp((g = &fd->rgroups.table[n])->symbol, r->symbol) != 0; n = (n + 1) & (size - 1))
+            ;
+        g->first[g->count++] = r;
+    }
+
+    return 0;
+}
+
+/*
+ * RETURN
+ *     group of relocations which reference symbol, NULL if there is none
+ */
+static struct linker_reloc_group_t *_rgroups_find(struct linker_file_data_t *fd, char *name)
+{
+    struct linker_reloc_group_t *g;
+    uint32_t n;
+
+    if (!fd->rgroups.size)
+        return NULL;
+
+    n = _name_hash(name) & (fd->rgroups.size - 1);
+    for (; (g = &fd->rgroups.table[n])->symbol; n = (n + 1) & (fd->rgroups.size - 1))
+    {
+        if (strcmp(g->symbol, name) == 0)
+            return g;
+    }
+
+    return NULL;
+}
+
+/*
+ * RETURN
+ *     file name without directory
+ */
+static char *_basename(char *path)
+{
+    char *ch;
+
+    ch = path + strlen(path);
+    while (ch > path)
+    {
+        if (ch[-1] == '/' || ch[-1] == '\\')
+            break;
+        ch--;
+    }
+
+    return ch;
+}
+
+/*
+ * With garbage collection, input section "name.suffix" is glued into output
+ * section "name", so code of each function may be placed in own section and
+ * dropped independently. Otherwise sections keep their names.
+ *
+ * RETURN
+ *     name of output section for input section
+ */
+static char *_section_output_name(char *name, char *buf, size_t size)
+{
+    char *dot;
+
+    if (!app.gcsections)
+        return name;
+
+    dot = strchr(name, '.');
+    if (!dot || dot == name || (size_t)(dot - name) >= size)
+        return name;
+
+    memcpy(buf, name, dot - name);
+    buf[dot - name] = 0;
+
+    return buf;
+}
+
+/*
+ *
+ */
+static void _print_symbols(struct symbols_t *symbols)
+{
+    struct llist_t *loop;
+    struct symbol_t *s;
+
+    printf(NL);
+    printf("-------------" NL);
+    printf("-- Symbols --" NL);
+    printf("-------------" NL);
+
+    symbols_mkloop(symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        if (s->type == SYMBOL_TYPE_NONE)
+            continue;
+        switch (s->type)
+        {
+            case SYMBOL_TYPE_CONST:  printf("CONST"); break;
+            case SYMBOL_TYPE_EXTERN: printf("EXTERN"); break;
+            case SYMBOL_TYPE_LABEL:  printf("LABEL"); break;
+            default:                 printf("-----");
+        }
+        printf(", width %u", s->width);
+        printf(", export %u", s->exp);
+        printf(", value 0x%06llX (%lld)", (long long int)s->val64, (long long int)s->val64);
+        printf(" \"%s\"", _symbol_name(s));
+        if (s->section)
+            printf(", section \"%s\"", s->section);
+
+        printf(NL);
+
+        /* print attributes */
+        {
+            struct symbol_attr_t *a;
+            struct llist_t *loop;
+
+            symbol_attr_mkloop(s, &loop);
+            while ((a = symbol_attr_next(&loop)))
+                printf("\tattr \"%s\" = \"%s\"" NL, a->name, a->value ? a->value : "NULL");
+        }
+    }
+}
+
+/*
+ *
+ */
+static void _print_relocations(struct relocations_t *relocations)
+{
+    struct relocation_t *r;
+    struct llist_t *loop;
+
+    printf(NL);
+    printf("-----------------" NL);
+    printf("-- Relocations --" NL);
+    printf("-----------------" NL);
+
+    relocations_mkloop(relocations, &loop);
+    while ((r = relocations_next(&loop)))
+    {
+        printf("%s", r->type == RELOCATION_TYPE_ABOSULTE ? "ABS" : "REL");
+        printf(", offset: 0x%06X", r->offset);
+        printf(", length: 0x%02X", r->length);
+        printf(", section: \"%s\"", r->section);
+        printf(", symbol: \"%s\"", r->target ? _symbol_name(_relocation_symbol(r)) : r->symbol);
+        if (r->type == RELOCATION_TYPE_ABOSULTE)
+            printf(", adjust: --");
+        else
+            printf(", adjust: %d", r->adjust);
+        printf(NL);
+    }
+}
+
+/*
+ *
+ */
+static void _print_sections(struct sections_t *sections)
+{
+    struct llist_t *loop;
+    struct section_t *s;
+
+    printf(NL);
+    printf("--------------" NL);
+    printf("-- Sections --" NL);
+    printf("--------------" NL);
+
+    sections_mkloop(sections, &loop);
+    while ((s = sections_next(&loop)))
+    {
+        printf(NL);
+        printf("Section \"%s\" %s%s%s%s" NL, s->name, s->noload ? "NOLOAD" : "",
+                s->discard ? " DISCARDED" : "", s->fold ? " FOLDED" : "", s->strmap ? " MERGED" : "");
+        if (!s->noload)
+            printf("    LMA    0x%06X" NL, s->lma);
+        printf("    VMA    0x%06X" NL, s->vma);
+        printf("    size   0x%06X" NL, s->length);
+        if (!s->noload && app.printmapdata)
+            debug_buf((uint8_t*)s->data, s->length);
+    }
+}
+
+/*
+ *
+ */
+static void _print_map(struct linker_context_t *ctx)
+{
+    struct llist_t *floop;
+
+    printf(NL);
+    printf("############" NL);
+    printf("## Input  ##" NL);
+    printf("############" NL);
+
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+
+        printf(NL);
+        printf("*****************************" NL);
+        printf("** %s " NL, fd->fname);
+        printf("*****************************" NL);
+
+        _print_symbols(&fd->symbols);
+        _print_relocations(&fd->relocations);
+        _print_sections(&fd->sections);
+
+        printf(NL);
+    }
+
+    printf(NL);
+    printf("############" NL);
+    printf("## Output ##" NL);
+    printf("############" NL);
+
+    _print_symbols(&ctx->result.symbols);
+    _print_relocations(&ctx->result.relocations);
+    _print_sections(&ctx->result.sections);
+}
+
+struct _symbol_find_info_t {
+    char *sname;                         /* symbol to find */
+    struct linker_file_data_t *fexclude; /* exclude file from search */
+
+    struct linker_file_data_t *ffound;   /* file in which symbol was found, NULL if symbol was found on linker context */
+    struct symbol_t *symbol;             /* pointer to found symbol */
+};
+
+/*
+ *
+ */
+void _symbol_find_extern(struct linker_context_t *ctx, struct _symbol_find_info_t *find)
+{
+    struct linker_export_t *e;
+    struct symbol_t *sext;
+
+    /* find symbol in files */
+    sext = NULL;
+    e = _exports_find(ctx, find->sname);
+    if (e && e->fd != find->fexclude)
+    {
+        sext = e->symbol;
+        find->ffound = e->fd;
+    }
+
+    /* find symbol in linker context */
+    {
+        struct symbol_t *s;
+
+        s = symbol_find(&ctx->symbols, find->sname);
+        if (s)
+        {
+            if (sext)
+            {
+                debug_emsgf("Symbol redefined", "\"%s\"" NL, find->sname);
+                app_close(APP_EXITCODE_ERROR);
+            }
+            sext = s;
+        }
+    }
+
+    find->symbol = sext;
+}
+
+/*
+ * RETURN
+ *     symbol of result which is not label of file, NULL if not found
+ */
+static struct symbol_t *_result_find_global(struct linker_context_t *ctx, char *name)
+{
+    struct llist_t *loop;
+    struct symbol_t *s;
+
+    symbols_mkloop(&ctx->result.symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        if (!s->file && strcmp(s->name, name) == 0)
+            return s;
+    }
+
+    return NULL;
+}
+
+/*
+ * RETURN
+ *     symbol of result relocation references
+ */
+static struct symbol_t *_relocation_symbol(struct relocation_t *r)
+{
+    if (r->target->result)
+        return r->target->result;
+    return r->target;
+}
+
+/*
+ * RETURN
+ *     name of symbol for map and diagnostics, label of file is prefixed with
+ *     name of file ("file:symbol")
+ */
+static char *_symbol_name(struct symbol_t *s)
+{
+    static char namebuf[PATH_MAX * 2 + TOKEN_STRING_MAX + 4];
+
+    if (!s->file)
+        return s->name;
+
+    snprintf(namebuf, sizeof(namebuf), "%s:%s", s->file, s->name);
+
+    return namebuf;
+}
+
+/*
+ * RETURN
+ *     offset in output section of data at "offset" of input section
+ */
+static uint32_t _section_offset(struct section_t *section, uint32_t offset)
+{
+    uint32_t lo, hi;
+
+    if (!section->strmap)
+        return section->offset + offset;
+
+    /* last string starting before offset */
+    lo = 0;
+    hi = section->nstrmap;
+    while (hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (section->strmap[mid * 2] <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return section->strmap[lo * 2 + 1] + offset - section->strmap[lo * 2];
+}
+
+/*
+ * Add relocations of file which reference symbol "s" to result. Relocations
+ * of result refer to "target", either symbol of result or input label of
+ * other file.
+ */
+static void _add_relocation(struct linker_context_t *ctx, struct linker_file_data_t *fd, struct symbol_t *s, struct symbol_t *target)
+{
+    struct linker_reloc_group_t *g;
+    struct relocation_t *r, *nr;
+    uint32_t i;
+
+    g = _rgroups_find(fd, s->name);
+    if (!g)
+        return;
+
+    for (i = 0; i < g->count; i++)
+    {
+        struct section_t *section;
+
+        r = g->first[i];
+        section = section_find(&fd->sections, r->section);
+        if (!section)
+        {
+            /* NOTREACHED */
+            debug_emsg("Section not found for relocation");
+            app_close(APP_EXITCODE_ERROR);
+        }
+        if (section->discard || section->fold)
+            continue;
+
+        /* fixup of relaxed instruction is shorter than symbol */
+        if (r->length != s->width && !(r->relax.kind != RELOCATION_RELAX_NONE && r->length == 1))
+        {
+            /* NOTREACHED */
+            debug_emsgf("Relocation mismatch symbol width", "\"%s\""NEW_LINE, s->name);
+            app_close(APP_EXITCODE_ERROR);
+        }
+
+        nr = relocations_add_ref(&ctx->result.relocations,
+                section->output->name,          /* section name to patch */
+                target->name,                   /* symbol from witch value should retereived */
+                r->offset + section->offset,    /* offset of relocation */
+                r->length,                      /* */
+                r->adjust,
+                r->type
+        );
+        nr->target = target;
+        nr->relax  = r->relax;
+    }
+
+}
+
+/*
+ * RETURN
+ *     1 if relocation of file which references symbol is in section not
+ *     discarded, 0 otherwise
+ */
+static int _symbol_referenced(struct linker_file_data_t *fd, struct symbol_t *s)
+{
+    struct linker_reloc_group_t *g;
+    struct section_t *section;
+    uint32_t i;
+
+    g = _rgroups_find(fd, s->name);
+    if (!g)
+        return 0;
+
+    for (i = 0; i < g->count; i++)
+    {
+        section = section_find(&fd->sections, g->first[i]->section);
+        if (section && !section->discard)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ *
+ */
+static void _add_symbols(struct linker_context_t *ctx, struct linker_file_data_t *fd)
+{
+    struct symbol_t *s;
+    struct symbol_t *sext;
+    struct llist_t *loop;
+
+    symbols_mkloop(&fd->symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        if (s->type == SYMBOL_TYPE_EXTERN)
+        {
+            struct _symbol_find_info_t find;
+
+            /* do not resolve symbol needed only by discarded sections */
+            if (app.gcsections && !_symbol_referenced(fd, s))
+                continue;
+
+            find.sname    = s->name;
+            find.fexclude = fd;
+            find.symbol   = NULL;
+            find.ffound   = NULL;
+
+            _symbol_find_extern(ctx, &find);
+            sext = find.symbol;
+
+            if (sext && find.ffound)
+            {
+                /*
+                 * Extern symbol was found in file.
+                 */
+                _add_relocation(ctx, fd, s, sext);
+            } else {
+                struct symbol_t *ns;
+
+                ns = _result_find_global(ctx, s->name);
+                if (sext)
+                {
+                    /*
+                     * Extern symbol was found in linker context.
+                     */
+                    if (!ns)
+                    {
+                        ns = symbols_add_ref(&ctx->result.symbols, s->name, NULL);
+                        symbol_set_const(ns, find.symbol->val64);
+                        ns->width = s->width;
+                    }
+                } else {
+                    /*
+                     * Not found, add as extern symbol. Check in future in linker context (after linker script pass).
+                     */
+                    if (!ns)
+                    {
+                        ns = symbols_add_ref(&ctx->result.symbols, s->name, NULL);
+                        ns->type  = SYMBOL_TYPE_EXTERN;
+                        ns->width = s->width;
+                    }
+                }
+                _add_relocation(ctx, fd, s, ns);
+            }
+        } else {
+            struct symbol_t *ns;
+            struct section_t *rs;
+
+            if (!s->section)
+            {
+                /* NOTREACHED */
+                debug_emsgf("Symbol has not section", "\"%s\"" NL, s->name);
+                app_close(APP_EXITCODE_ERROR);
+            }
+
+            rs = section_find(&fd->sections, s->section);
+            if (!rs)
+            {
+                /* NOTREACHED */
+                debug_emsgf("Section not found", "\"%s\"" NL, s->section);
+                app_close(APP_EXITCODE_ERROR);
+            }
+            if (rs->discard)
+                continue;
+
+            ns = symbols_add_ref(&ctx->result.symbols, s->name, rs->output->name);
+            ns->type   = SYMBOL_TYPE_LABEL;
+            ns->width  = s->width;
+            ns->offset = _section_offset(rs, s->offset);
+            ns->exp    = s->exp; /* not used, just for debug */
+            ns->file   = fd->fname;
+            s->result  = ns;
+
+            _add_relocation(ctx, fd, s, ns);
+        }
+    }
+}
+
+/*
+ * Reference of input section to other input section by relocation.
+ */
+struct _gc_edge_t {
+    struct section_t *from;
+    struct section_t *to;
+};
+
+struct _gc_t {
+    struct _gc_edge_t *edges;
+    uint32_t nedges;
+    uint32_t aedges;
+
+    struct section_t **stack; /* sections reached, which references not followed yet */
+    uint32_t nstack;
+    uint32_t astack;
+};
+
+/*
+ *
+ */
+static int _gc_edge_cmp(const void *p1, const void *p2)
+{
+    const struct _gc_edge_t *e1 = p1;
+    const struct _gc_edge_t *e2 = p2;
+
+    if ((uintptr_t)e1->from < (uintptr_t)e2->from)
+        return -1;
+    if ((uintptr_t)e1->from > (uintptr_t)e2->from)
+        return 1;
+    return 0;
+}
+
+/*
+ *
+ */
+static void _gc_edge_add(struct _gc_t *gc, struct section_t *from, struct section_t *to)
+{
+    if (from == to)
+        return;
+
+    if (gc->nedges == gc->aedges)
+    {
+        struct _gc_edge_t *edges;
+
+        gc->aedges = gc->aedges ? gc->aedges * 2 : 64;
+        edges = realloc(gc->edges, gc->aedges * sizeof(struct _gc_edge_t));
+        if (!edges)
+        {
+            debug_emsg("Can not allocate memory");
+            app_close(APP_EXITCODE_ERROR);
+        }
+        gc->edges = edges;
+    }
+
+    gc->edges[gc->nedges].from = from;
+    gc->edges[gc->nedges].to   = to;
+    gc->nedges++;
+}
+
+/*
+ * Mark section as reached.
+ */
+static void _gc_mark(struct _gc_t *gc, struct section_t *section)
+{
+    if (!section->discard)
+        return;
+    section->discard = 0;
+
+    if (gc->nstack == gc->astack)
+    {
+        struct section_t **stack;
+
+        gc->astack = gc->astack ? gc->astack * 2 : 64;
+        stack = realloc(gc->stack, gc->astack * sizeof(struct section_t *));
+        if (!stack)
+        {
+            debug_emsg("Can not allocate memory");
+            app_close(APP_EXITCODE_ERROR);
+        }
+        gc->stack = stack;
+    }
+
+    gc->stack[gc->nstack++] = section;
+}
+
+/*
+ * RETURN
+ *     input section in which exported symbol is defined, NULL if symbol is
+ *     not label of file
+ */
+static struct section_t *_gc_export_section(struct linker_export_t *e)
+{
+    if (!e->symbol->section)
+        return NULL;
+    return section_find(&e->fd->sections, e->symbol->section);
+}
+
+/*
+ * Discard input sections which can not be reached by relocations from roots:
+ * section "vectors" and sections and symbols given by ".keep" directive of
+ * script.
+ */
+static void _gc_sections(struct linker_context_t *ctx)
+{
+    struct _gc_t gc;
+    struct llist_t *floop;
+    struct llist_t *loop;
+    struct section_t *section;
+    struct symbol_t *s;
+
+    gc.edges  = NULL;
+    gc.nedges = 0;
+    gc.aedges = 0;
+    gc.stack  = NULL;
+    gc.nstack = 0;
+    gc.astack = 0;
+
+    /* references between sections */
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+            section->discard = 1;
+
+        symbols_mkloop(&fd->symbols, &loop);
+        while ((s = symbols_next(&loop)))
+        {
+            struct linker_reloc_group_t *g;
+            struct section_t *to;
+            uint32_t i;
+
+            if (s->type == SYMBOL_TYPE_EXTERN)
+            {
+                struct linker_export_t *e;
+
+                e = _exports_find(ctx, s->name);
+                if (!e || e->fd == fd)
+                    continue;
+                to = _gc_export_section(e);
+            } else {
+                if (!s->section)
+                    continue;
+                to = section_find(&fd->sections, s->section);
+            }
+            if (!to)
+                continue;
+
+            g = _rgroups_find(fd, s->name);
+            if (!g)
+                continue;
+            for (i = 0; i < g->count; i++)
+            {
+                struct section_t *from;
+
+                from = section_find(&fd->sections, g->first[i]->section);
+                if (from)
+                    _gc_edge_add(&gc, from, to);
+            }
+        }
+    }
+    if (gc.nedges)
+        qsort(gc.edges, gc.nedges, sizeof(struct _gc_edge_t), _gc_edge_cmp);
+
+    /* roots */
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+        {
+            char name[TOKEN_STRING_MAX];
+            char *oname;
+            struct llist_t *kloop;
+
+            oname = _section_output_name(section->name, name, sizeof(name));
+            if (strcmp(oname, "vectors") == 0)
+            {
+                _gc_mark(&gc, section);
+                continue;
+            }
+
+            for (kloop = ctx->keeps; kloop; kloop = kloop->next)
+            {
+                struct linker_keep_t *k = kloop->p;
+
+                if (k->symbol)
+                    continue;
+                if (strcmp(k->name, section->name) == 0 || strcmp(k->name, oname) == 0)
+                {
+                    _gc_mark(&gc, section);
+                    break;
+                }
+            }
+        }
+    }
+    for (loop = ctx->keeps; loop; loop = loop->next)
+    {
+        struct linker_keep_t *k = loop->p;
+        struct linker_export_t *e;
+
+        if (!k->symbol)
+            continue;
+
+        e = _exports_find(ctx, k->name);
+        if (!e)
+        {
+            debug_emsgf("Symbol of \".keep\" directive not exported", "\"%s\"" NL, k->name);
+            app_close(APP_EXITCODE_ERROR);
+        }
+        if ((section = _gc_export_section(e)))
+            _gc_mark(&gc, section);
+    }
+
+    /* follow references of reached sections */
+    while (gc.nstack)
+    {
+        struct _gc_edge_t key;
+        struct _gc_edge_t *e;
+        uint32_t lo, hi;
+
+        section = gc.stack[--gc.nstack];
+
+        /* first edge from section */
+        key.from = section;
+        lo = 0;
+        hi = gc.nedges;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+
+            if (_gc_edge_cmp(&gc.edges[mid], &key) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (e = &gc.edges[lo]; e < &gc.edges[gc.nedges] && e->from == section; e++)
+            _gc_mark(&gc, e->to);
+    }
+
+    if (gc.edges)
+        free(gc.edges);
+    if (gc.stack)
+        free(gc.stack);
+}
+
+/*
+ * RETURN
+ *     ".fold" entry of output section which input sections may be folded,
+ *     NULL if they may not. Without ".fold" directives "text" is folded.
+ */
+static struct linker_fold_t *_fold_find(struct linker_context_t *ctx, char *name)
+{
+    static struct linker_fold_t text = {"text", 0};
+    struct llist_t *loop;
+
+    if (!ctx->folds)
+        return strcmp(name, text.name) == 0 ? &text : NULL;
+
+    for (loop = ctx->folds; loop; loop = loop->next)
+    {
+        struct linker_fold_t *f = loop->p;
+
+        if (strcmp(f->name, name) == 0)
+            return f;
+    }
+
+    return NULL;
+}
+
+/*
+ * RETURN
+ *     1 if input section is merged by strings: it belongs to ".fold"
+ *     section with STRINGS, consists of zero-terminated strings and has no
+ *     relocations, 0 otherwise
+ */
+static int _fold_strings(struct linker_context_t *ctx, struct linker_file_data_t *fd, struct section_t *section)
+{
+    struct linker_fold_t *f;
+    struct llist_t *loop;
+    struct relocation_t *r;
+    char name[TOKEN_STRING_MAX];
+
+    f = _fold_find(ctx, _section_output_name(section->name, name, sizeof(name)));
+    if (!f || !f->strings || section->noload || !section->length)
+        return 0;
+    if (l0_section_check(section) < 0)
+    {
+        debug_emsgf("Failed to load file", "\"%s\"" NL, fd->fname);
+        app_close(APP_EXITCODE_ERROR);
+    }
+    if (section->data[section->length - 1] != 0)
+        return 0;
+
+    relocations_mkloop(&fd->relocations, &loop);
+    while ((r = relocations_next(&loop)))
+    {
+        if (strcmp(r->section, section->name) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Strings glued into output section, open addressing.
+ */
+struct _strtab_t {
+    struct section_t *output;
+    uint32_t *table; /* offset of string in output plus 1, 0 if entry is empty */
+    uint32_t size;   /* power of 2 */
+    uint32_t count;
+};
+
+/*
+ *
+ */
+static void _destroy_strtab(void *p)
+{
+    struct _strtab_t *st = p;
+
+    if (st->table)
+        free(st->table);
+    free(st);
+}
+
+/*
+ *
+ */
+static void _strtab_insert(struct _strtab_t *st, uint32_t offset)
+{
+    uint32_t n;
+
+    n = _name_hash(section_data(st->output, offset)) & (st->size - 1);
+    while (st->table[n])
+        n = (n + 1) & (st->size - 1);
+    st->table[n] = offset + 1;
+    st->count++;
+}
+
+/*
+ * Glue strings of input section into output section, each string which is
+ * already there is shared.
+ */
+static void _glue_strings(struct llist_t **strtabs, struct section_t *rsection, struct section_t *section)
+{
+    struct _strtab_t *st;
+    struct llist_t *loop;
+    uint32_t n, offset;
+
+    st = NULL;
+    for (loop = *strtabs; loop; loop = loop->next)
+    {
+        st = loop->p;
+        if (st->output == rsection)
+            break;
+    }
+    if (!loop)
+    {
+        struct llist_t *head;
+
+        st = malloc(sizeof(struct _strtab_t));
+        if (!st)
+            goto error;
+        st->output = rsection;
+        st->size   = 256;
+        st->count  = 0;
+        st->table  = calloc(st->size, sizeof(uint32_t));
+        if (!st->table)
+        {
+            free(st);
+            goto error;
+        }
+        head = llist_add(*strtabs, st, _destroy_strtab, st);
+        if (!head)
+        {
+            _destroy_strtab(st);
+            goto error;
+        }
+        *strtabs = head;
+    }
+
+    section->nstrmap = 0;
+    for (offset = 0; offset < section->length; offset++)
+    {
+        if (!section->data[offset])
+            section->nstrmap++;
+    }
+    section->strmap = malloc(section->nstrmap * 2 * sizeof(uint32_t));
+    if (!section->strmap)
+        goto error;
+
+    for (offset = 0, n = 0; offset < section->length; n++)
+    {
+        char *str = &section->data[offset];
+        uint32_t length = strlen(str) + 1;
+        uint32_t e;
+
+        e = _name_hash(str) & (st->size - 1);
+        for (; st->table[e]; e = (e + 1) & (st->size - 1))
+        {
+            if (strcmp(section_data(rsection, st->table[e] - 1), str) == 0)
+                break;
+        }
+
+        section->strmap[n * 2] = offset;
+        if (st->table[e])
+        {
+            section->strmap[n * 2 + 1] = st->table[e] - 1;
+        } else {
+            section->strmap[n * 2 + 1] = rsection->length;
+            section_pushdata(rsection, str, length);
+
+            /* keep hash at most half full */
+            if ((st->count + 1) * 2 > st->size)
+            {
+                uint32_t *table = st->table;
+                uint32_t size = st->size;
+                uint32_t i;
+
+                st->size *= 2;
+                st->count = 0;
+                st->table = calloc(st->size, sizeof(uint32_t));
+                if (!st->table)
+                {
+                    st->table = table;
+                    st->size  = size;
+                    goto error;
+                }
+                for (i = 0; i < size; i++)
+                {
+                    if (table[i])
+                        _strtab_insert(st, table[i] - 1);
+                }
+                free(table);
+            }
+            _strtab_insert(st, section->strmap[n * 2 + 1]);
+        }
+
+        offset += length;
+    }
+
+    return;
+error:
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * Relocation of input section as compared by folding: what it references,
+ * not name of symbol.
+ */
+struct _fold_reloc_t {
+    uint32_t item;   /* input section of relocation */
+    uint32_t offset;
+    uint32_t length;
+    int32_t adjust;
+    int type;
+
+    struct section_t *section; /* input section of label referenced, NULL if other */
+    int self;                  /* label referenced is in same section */
+    int64_t value;             /* offset of label in section */
+    char *name;                /* name of symbol of linker */
+};
+
+/*
+ * Input section which may be folded.
+ */
+struct _fold_item_t {
+    struct section_t *section;
+    char oname[TOKEN_STRING_MAX]; /* name of output section */
+    uint64_t hash;
+    struct _fold_reloc_t *relocs; /* sorted by offset */
+    uint32_t nrelocs;
+};
+
+/*
+ *
+ */
+static int _fold_reloc_cmp(const void *p1, const void *p2)
+{
+    const struct _fold_reloc_t *r1 = p1;
+    const struct _fold_reloc_t *r2 = p2;
+
+    if (r1->item != r2->item)
+        return r1->item < r2->item ? -1 : 1;
+    if (r1->offset != r2->offset)
+        return r1->offset < r2->offset ? -1 : 1;
+    return 0;
+}
+
+/*
+ * RETURN
+ *     section which is kept instead of section given
+ */
+static struct section_t *_fold_target(struct section_t *section)
+{
+    while (section && section->fold)
+        section = section->fold;
+    return section;
+}
+
+/*
+ *
+ */
+static uint64_t _fold_hash(struct _fold_item_t *item)
+{
+    uint64_t hash;
+    uint32_t i;
+
+    hash = state_hash(STATE_HASH_INIT, item->oname, strlen(item->oname) + 1);
+    hash = state_hash(hash, &item->section->length, sizeof(item->section->length));
+    hash = state_hash(hash, item->section->data, item->section->length);
+    for (i = 0; i < item->nrelocs; i++)
+    {
+        struct _fold_reloc_t *r = &item->relocs[i];
+        struct section_t *target;
+
+        target = _fold_target(r->section);
+        hash = state_hash(hash, &r->offset, sizeof(r->offset));
+        hash = state_hash(hash, &r->length, sizeof(r->length));
+        hash = state_hash(hash, &r->adjust, sizeof(r->adjust));
+        hash = state_hash(hash, &r->type, sizeof(r->type));
+        hash = state_hash(hash, &r->self, sizeof(r->self));
+        hash = state_hash(hash, &target, sizeof(target));
+        hash = state_hash(hash, &r->value, sizeof(r->value));
+        if (r->name)
+            hash = state_hash(hash, r->name, strlen(r->name));
+    }
+
+    return hash;
+}
+
+/*
+ * RETURN
+ *     1 if sections are identical, 0 otherwise
+ */
+static int _fold_equal(struct _fold_item_t *i1, struct _fold_item_t *i2)
+{
+    uint32_t i;
+
+    if (i1->hash != i2->hash || i1->nrelocs != i2->nrelocs ||
+            i1->section->length != i2->section->length ||
+            strcmp(i1->oname, i2->oname) != 0 ||
+            memcmp(i1->section->data, i2->section->data, i1->section->length) != 0)
+        return 0;
+
+    for (i = 0; i < i1->nrelocs; i++)
+    {
+        struct _fold_reloc_t *r1 = &i1->relocs[i];
+        struct _fold_reloc_t *r2 = &i2->relocs[i];
+
+        if (r1->offset != r2->offset || r1->length != r2->length ||
+                r1->adjust != r2->adjust || r1->type != r2->type ||
+                r1->self != r2->self || r1->value != r2->value ||
+                _fold_target(r1->section) != _fold_target(r2->section))
+            return 0;
+        if ((r1->name || r2->name) && (!r1->name || !r2->name || strcmp(r1->name, r2->name) != 0))
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Position of input section in order of folding.
+ */
+struct _fold_order_t {
+    uint64_t hash;
+    uint32_t n; /* index of section, in order of gluing */
+};
+
+/*
+ *
+ */
+static int _fold_order_cmp(const void *p1, const void *p2)
+{
+    const struct _fold_order_t *o1 = p1;
+    const struct _fold_order_t *o2 = p2;
+
+    if (o1->hash != o2->hash)
+        return o1->hash < o2->hash ? -1 : 1;
+    if (o1->n != o2->n)
+        return o1->n < o2->n ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Fold input sections with same data, which relocations reference same
+ * labels. Section is folded into first identical section in order of
+ * gluing, so labels of it are moved there and data of it is dropped.
+ * Passes are repeated while sections are folded, since sections which
+ * reference sections folded may become identical.
+ */
+static void _fold_sections(struct linker_context_t *ctx)
+{
+    struct _fold_item_t *items;
+    struct _fold_reloc_t *relocs;
+    struct _fold_order_t *order;
+    uint32_t nitems, aitems, nrelocs, arelocs, i, j;
+    struct llist_t *floop;
+    int folded;
+
+    items   = NULL;
+    nitems  = 0;
+    aitems  = 0;
+    relocs  = NULL;
+    nrelocs = 0;
+    arelocs = 0;
+
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+        struct llist_t *loop;
+        struct section_t *section;
+        struct symbol_t *s;
+        char name[TOKEN_STRING_MAX];
+        uint32_t first;
+
+        /* input sections which may be folded */
+        first = nitems;
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+        {
+            struct _fold_item_t *item;
+
+            if (section->discard || section->noload || !section->length)
+                continue;
+            if (_fold_strings(ctx, fd, section))
+                continue;
+
+            if (nitems == aitems)
+            {
+                aitems = aitems ? aitems * 2 : 64;
+                item = realloc(items, aitems * sizeof(struct _fold_item_t));
+                if (!item)
+                    goto error;
+                items = item;
+            }
+            item = &items[nitems];
+            snprintf(item->oname, sizeof(item->oname), "%s",
+                    _section_output_name(section->name, name, sizeof(name)));
+            if (!_fold_find(ctx, item->oname))
+                continue;
+            if (l0_section_check(section) < 0)
+            {
+                debug_emsgf("Failed to load file", "\"%s\"" NL, fd->fname);
+                app_close(APP_EXITCODE_ERROR);
+            }
+            item->section = section;
+            item->relocs  = NULL;
+            item->nrelocs = 0;
+            nitems++;
+        }
+        if (first == nitems)
+            continue;
+
+        /* relocations of them, with labels referenced */
+        symbols_mkloop(&fd->symbols, &loop);
+        while ((s = symbols_next(&loop)))
+        {
+            struct linker_reloc_group_t *g;
+            struct section_t *target;
+            int64_t value;
+            char *name;
+
+            g = _rgroups_find(fd, s->name);
+            if (!g)
+                continue;
+
+            target = NULL;
+            value  = 0;
+            name   = NULL;
+            if (s->type == SYMBOL_TYPE_EXTERN)
+            {
+                struct linker_export_t *e;
+
+                e = _exports_find(ctx, s->name);
+                if (!e || e->fd == fd)
+                    name = s->name;
+                else if (e->symbol->type == SYMBOL_TYPE_LABEL)
+                    target = section_find(&e->fd->sections, e->symbol->section);
+                value = e ? e->symbol->val64 : 0;
+            } else {
+                if (s->type == SYMBOL_TYPE_LABEL)
+                    target = section_find(&fd->sections, s->section);
+                value = s->val64;
+            }
+
+            for (i = 0; i < g->count; i++)
+            {
+                struct relocation_t *r = g->first[i];
+                struct _fold_reloc_t *fr;
+
+                for (j = first; j < nitems; j++)
+                {
+                    if (strcmp(items[j].section->name, r->section) == 0)
+                        break;
+                }
+                if (j == nitems)
+                    continue;
+
+                if (nrelocs == arelocs)
+                {
+                    arelocs = arelocs ? arelocs * 2 : 256;
+                    fr = realloc(relocs, arelocs * sizeof(struct _fold_reloc_t));
+                    if (!fr)
+                        goto error;
+                    relocs = fr;
+                }
+                fr = &relocs[nrelocs++];
+                fr->item    = j;
+                fr->offset  = r->offset;
+                fr->length  = r->length;
+                fr->adjust  = r->adjust;
+                fr->type    = r->type;
+                fr->self    = target == items[j].section;
+                fr->section = fr->self ? NULL : target;
+                fr->value   = value;
+                fr->name    = name;
+            }
+        }
+    }
+
+    if (nitems < 2)
+        goto done;
+
+    /* give each section its relocations */
+    if (nrelocs)
+        qsort(relocs, nrelocs, sizeof(struct _fold_reloc_t), _fold_reloc_cmp);
+    for (i = 0; i < nrelocs; i++)
+    {
+        struct _fold_item_t *item = &items[relocs[i].item];
+
+        if (!item->nrelocs)
+            item->relocs = &relocs[i];
+        item->nrelocs++;
+    }
+
+    order = malloc(nitems * sizeof(struct _fold_order_t));
+    if (!order)
+        goto error;
+
+    do {
+        folded = 0;
+
+        for (i = 0; i < nitems; i++)
+        {
+            if (!items[i].section->fold)
+                items[i].hash = _fold_hash(&items[i]);
+            order[i].hash = items[i].hash;
+            order[i].n    = i;
+        }
+        qsort(order, nitems, sizeof(struct _fold_order_t), _fold_order_cmp);
+
+        /* sections with same hash follow each other, in order of gluing */
+        for (i = 0; i < nitems; i = j)
+        {
+            uint32_t k;
+
+            for (j = i + 1; j < nitems && order[j].hash == order[i].hash; j++)
+                ;
+
+            for (k = i; k < j; k++)
+            {
+                struct _fold_item_t *keep = &items[order[k].n];
+                uint32_t m;
+
+                if (keep->section->fold)
+                    continue;
+                for (m = k + 1; m < j; m++)
+                {
+                    struct _fold_item_t *item = &items[order[m].n];
+
+                    if (!item->section->fold && _fold_equal(keep, item))
+                    {
+                        item->section->fold = keep->section;
+                        folded = 1;
+                    }
+                }
+            }
+        }
+    } while (folded);
+
+    free(order);
+done:
+    if (items)
+        free(items);
+    if (relocs)
+        free(relocs);
+    return;
+error:
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ *
+ */
+static void _glue_sections(struct linker_context_t *ctx)
+{
+    struct llist_t *floop;
+    struct llist_t *strtabs;
+
+    strtabs = NULL;
+
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+
+        /* loop thru sections of file */
+        {
+            struct llist_t *loop;
+            struct section_t *rsection;
+            struct section_t *section;
+
+            sections_mkloop(&fd->sections, &loop);
+            while ((section = sections_next(&loop)))
+            {
+                char name[TOKEN_STRING_MAX];
+
+                /* output section is created even if all of its input is discarded */
+                rsection = section_select(&ctx->result.sections,
+                        _section_output_name(section->name, name, sizeof(name)));
+
+                if (!rsection->noload)
+                    rsection->noload = section->noload;
+                if (rsection->noload != section->noload)
+                {
+                    debug_emsgf("NOLOAD attribute of section mismatch", "\"%s\"" NL, section->name);
+                    app_close(APP_EXITCODE_ERROR);
+                }
+                if (section->discard)
+                    continue;
+
+                section->output = rsection;
+                if (section->fold)
+                {
+                    /* data is shared with identical section glued before */
+                    section->offset = section->fold->offset;
+                    continue;
+                }
+
+                /* data of section is first used here */
+                if (l0_section_check(section) < 0)
+                {
+                    debug_emsgf("Failed to load file", "\"%s\"" NL, fd->fname);
+                    app_close(APP_EXITCODE_ERROR);
+                }
+                section->offset = rsection->length;
+                if (app.icf && _fold_strings(ctx, fd, section))
+                    _glue_strings(&strtabs, rsection, section);
+                else if (app.stream)
+                    section_pushdata(rsection, section->data, section->length);
+                else
+                    section_reserve(rsection, section->length); /* copied by _image_build() */
+            }
+
+            /* fix, rename symbols */
+            _add_symbols(ctx, fd);
+        }
+
+        if (app.stream)
+            _stream_release(fd);
+    }
+
+    llist_destroy(strtabs);
+
+    /* members of archives are glued, mapping of archives is not needed */
+    if (app.stream)
+    {
+        llist_destroy(ctx->alist);
+        ctx->alist = NULL;
+    }
+}
+
+/*
+ *
+ */
+static int _stream_name_cmp(const void *p1, const void *p2)
+{
+    const char *n1 = **(char ** const *)p1;
+    const char *n2 = **(char ** const *)p2;
+
+    if (n1 != n2)
+        return n1 < n2 ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Copy names of symbols and sections of file, which point into mapping of
+ * file, to own buffer of file. Names are shared by symbols and sections
+ * (string table of object), so each one is copied once. Relocations keep
+ * pointing into mapping, they are released with it.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _stream_names(struct linker_file_data_t *fd)
+{
+    struct llist_t *loop;
+    struct symbol_t *s;
+    struct section_t *section;
+    char ***slots;
+    char *prev;
+    uint32_t n, i;
+    size_t size;
+
+    n = 0;
+    symbols_mkloop(&fd->symbols, &loop);
+    while ((s = symbols_next(&loop)))
+        n += s->ref ? (s->section ? 2 : 1) : 0;
+    sections_mkloop(&fd->sections, &loop);
+    while ((section = sections_next(&loop)))
+        n += section->ref ? 1 : 0;
+    if (!n)
+        return 0;
+
+    slots = malloc(n * sizeof(char **));
+    if (!slots)
+        return -1;
+    n = 0;
+    symbols_mkloop(&fd->symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        if (!s->ref)
+            continue;
+        slots[n++] = &s->name;
+        if (s->section)
+            slots[n++] = &s->section;
+    }
+    sections_mkloop(&fd->sections, &loop);
+    while ((section = sections_next(&loop)))
+    {
+        if (section->ref)
+            slots[n++] = &section->name;
+    }
+    qsort(slots, n, sizeof(char **), _stream_name_cmp);
+
+    size = 0;
+    for (i = 0, prev = NULL; i < n; prev = *slots[i], i++)
+    {
+        if (*slots[i] != prev)
+            size += strlen(*slots[i]) + 1;
+    }
+    fd->strings = malloc(size);
+    if (!fd->strings)
+    {
+        free(slots);
+        return -1;
+    }
+
+    /* slots of same name follow each other, each one is moved after copy */
+    size = 0;
+    for (i = 0, prev = NULL; i < n; i++)
+    {
+        if (*slots[i] == prev)
+        {
+            *slots[i] = *slots[i - 1];
+            continue;
+        }
+        prev = *slots[i];
+        strcpy(&fd->strings[size], prev);
+        *slots[i] = &fd->strings[size];
+        size += strlen(prev) + 1;
+    }
+    free(slots);
+
+    return 0;
+}
+
+/*
+ * Release data of file glued to output. Relocations are added to result
+ * already and data of sections is pushed to output sections, so only symbols
+ * and sections without data are kept, for symbols of files glued later
+ * resolved to them and for map.
+ */
+static void _stream_release(struct linker_file_data_t *fd)
+{
+    struct llist_t *loop;
+    struct section_t *section;
+
+    relocations_destroy(&fd->relocations);
+    relocations_init(&fd->relocations);
+    if (fd->rgroups.table)
+        free(fd->rgroups.table);
+    if (fd->rgroups.list)
+        free(fd->rgroups.list);
+    fd->rgroups.table = NULL;
+    fd->rgroups.list  = NULL;
+    fd->rgroups.size  = 0;
+
+    sections_mkloop(&fd->sections, &loop);
+    while ((section = sections_next(&loop)))
+    {
+        if (!section->ref && section->data)
+            free(section->data);
+        section->data    = NULL;
+        section->alength = 0;
+    }
+
+    l0_unmap(&fd->map);
+}
+
+/*
+ * Instruction relaxed to short form, in coordinates of input section before
+ * it is shrunk.
+ */
+struct _relax_site_t {
+    struct section_t *section;
+    uint32_t at;    /* offset of instruction */
+    uint8_t length; /* length of long form */
+    uint8_t saved;  /* bytes saved by short form */
+    struct relocation_t *r;
+};
+
+/*
+ *
+ */
+static int _relax_site_cmp(const void *p1, const void *p2)
+{
+    const struct _relax_site_t *s1 = p1;
+    const struct _relax_site_t *s2 = p2;
+
+    if (s1->section != s2->section)
+        return (uintptr_t)s1->section < (uintptr_t)s2->section ? -1 : 1;
+    if (s1->at != s2->at)
+        return s1->at < s2->at ? -1 : 1;
+    return 0;
+}
+
+/*
+ * RETURN
+ *     first of sites of input section, NULL if section has none; "count" is
+ *     number of them
+ */
+static struct _relax_site_t *_relax_sites(struct _relax_site_t *sites, uint32_t nsites,
+        struct section_t *section, uint32_t *count)
+{
+    uint32_t lo, hi, n;
+
+    lo = 0;
+    hi = nsites;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if ((uintptr_t)sites[mid].section < (uintptr_t)section)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (n = lo; n < nsites && sites[n].section == section; n++)
+        ;
+
+    *count = n - lo;
+    return n > lo ? &sites[lo] : NULL;
+}
+
+/*
+ * RETURN
+ *     offset in shrunk section of offset in section given, instructions
+ *     which end at or before it are shrunk
+ */
+static uint32_t _relax_shift(struct _relax_site_t *sites, uint32_t count, uint32_t offset)
+{
+    uint32_t i, shift;
+
+    shift = 0;
+    for (i = 0; i < count && sites[i].at + sites[i].length <= offset; i++)
+        shift += sites[i].saved;
+
+    return offset - shift;
+}
+
+/*
+ * RETURN
+ *     0 and address or value of symbol file references in "value", -1 if it
+ *     is not known
+ */
+static int _relax_value(struct linker_context_t *ctx, struct linker_file_data_t *fd,
+        struct symbol_t *s, int64_t *value)
+{
+    struct section_t *output;
+
+    if (s->type == SYMBOL_TYPE_EXTERN)
+    {
+        struct _symbol_find_info_t find;
+
+        find.sname    = s->name;
+        find.fexclude = fd;
+        find.symbol   = NULL;
+        find.ffound   = NULL;
+        _symbol_find_extern(ctx, &find);
+        if (!find.symbol)
+            return -1;
+        if (!find.ffound)
+        {
+            *value = find.symbol->val64;
+            return 0;
+        }
+        s = find.symbol;
+    }
+
+    if (s->type != SYMBOL_TYPE_LABEL || !s->result)
+        return -1;
+    output = section_find(&ctx->result.sections, s->result->section);
+    if (!output)
+        return -1;
+
+    *value = output->vma + s->result->offset;
+    return 0;
+}
+
+/*
+ * Find instructions which operand fits short form on current layout.
+ *
+ * RETURN
+ *     number of sites found, "sites" is allocated array of them
+ */
+static uint32_t _relax_find(struct linker_context_t *ctx, struct _relax_site_t **sites)
+{
+    struct _relax_site_t *list;
+    uint32_t count, alloc;
+    struct llist_t *floop;
+
+    list  = NULL;
+    count = 0;
+    alloc = 0;
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+        struct section_t *section;
+        struct llist_t *loop;
+        struct symbol_t *s;
+        char *sname;
+
+        section = NULL;
+        sname   = NULL;
+        symbols_mkloop(&fd->symbols, &loop);
+        while ((s = symbols_next(&loop)))
+        {
+            struct linker_reloc_group_t *g;
+            int64_t value;
+            uint32_t i;
+
+            g = _rgroups_find(fd, s->name);
+            if (!g || _relax_value(ctx, fd, s, &value) < 0)
+                continue;
+
+            for (i = 0; i < g->count; i++)
+            {
+                struct relocation_t *r = g->first[i];
+                struct _relax_site_t *site;
+                int64_t at;
+                uint8_t length;
+
+                if (r->relax.kind == RELOCATION_RELAX_NONE || r->length != 2)
+                    continue;
+
+                /* names of sections of file are shared by its relocations */
+                if (r->section != sname)
+                {
+                    sname   = r->section;
+                    section = section_find(&fd->sections, sname);
+                }
+                /* sections which identical ones are folded into are shrunk along with them */
+                if (!section || !section->output || section->fold || section->strmap || section->noload)
+                    continue;
+
+                at     = section->output->vma + section->offset + r->offset - r->relax.head;
+                length = (r->relax.prebyte ? 1 : 0) + 2;
+                if (r->relax.kind == RELOCATION_RELAX_SHORT)
+                {
+                    if (value < 0 || value > 0xFF)
+                        continue;
+                } else {
+                    /* jump of short form, targets in same section only get closer by shrinking */
+                    if (value - (at + length) < -128 || value - (at + length) > 127)
+                        continue;
+                }
+
+                if (count == alloc)
+                {
+                    alloc = alloc ? alloc * 2 : 64;
+                    site = realloc(list, alloc * sizeof(struct _relax_site_t));
+                    if (!site)
+                        goto error;
+                    list = site;
+                }
+                site = &list[count++];
+                site->section = section;
+                site->at      = r->offset - r->relax.head;
+                site->length  = r->relax.head + 2;
+                site->saved   = site->length - length;
+                site->r       = r;
+            }
+        }
+    }
+
+    if (count)
+        qsort(list, count, sizeof(struct _relax_site_t), _relax_site_cmp);
+
+    *sites = list;
+    return count;
+error:
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+    return 0;
+}
+
+/*
+ * Shrink instructions of sites. Data of input sections, offsets of
+ * relocations and labels of files are moved. Section folded into another one
+ * is shrunk same way, since it holds same instructions.
+ */
+static void _relax_shrink(struct linker_context_t *ctx, struct _relax_site_t *sites, uint32_t nsites)
+{
+    struct llist_t *floop;
+
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+        struct _relax_site_t *list;
+        struct section_t *section;
+        struct llist_t *loop;
+        struct relocation_t *r;
+        struct symbol_t *s;
+        uint32_t count;
+        char *sname;
+        int i;
+
+        /* data, from last instruction so offsets of ones before are kept */
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+        {
+            list = _relax_sites(sites, nsites, section->fold ? _fold_target(section) : section, &count);
+            if (!list)
+                continue;
+
+            if (l0_section_check(section) < 0)
+            {
+                debug_emsgf("Failed to load file", "\"%s\"" NL, fd->fname);
+                app_close(APP_EXITCODE_ERROR);
+            }
+            for (i = count - 1; i >= 0; i--)
+            {
+                struct relocation_t *sr = list[i].r;
+                uint8_t code[3] = {sr->relax.prebyte, sr->relax.opcode, 0};
+                uint32_t n = sr->relax.prebyte ? 0 : 1;
+
+                section_patch(section, list[i].at, &code[n], sizeof(code) - n);
+                section_cut(section, list[i].at + list[i].length - list[i].saved, list[i].saved);
+            }
+        }
+
+        /* relocations, fixup of instruction shrunk is moved into short form */
+        section = NULL;
+        sname   = NULL;
+        relocations_mkloop(&fd->relocations, &loop);
+        while ((r = relocations_next(&loop)))
+        {
+            if (r->section != sname)
+            {
+                sname   = r->section;
+                section = section_find(&fd->sections, sname);
+            }
+            if (!section)
+                continue;
+            list = _relax_sites(sites, nsites, section->fold ? _fold_target(section) : section, &count);
+            if (!list)
+                continue;
+
+            for (i = 0; i < count; i++)
+            {
+                if (list[i].at + list[i].r->relax.head == r->offset)
+                    break;
+            }
+            if (i < count && r->relax.kind != RELOCATION_RELAX_NONE && r->length == 2)
+            {
+                r->offset = _relax_shift(list, count, list[i].at) + (r->relax.prebyte ? 2 : 1);
+                r->length = 1;
+                if (r->relax.kind == RELOCATION_RELAX_RELATIVE)
+                {
+                    r->type   = RELOCATION_TYPE_RELATIVE;
+                    r->adjust = 1;
+                }
+            } else {
+                r->offset = _relax_shift(list, count, r->offset);
+            }
+        }
+
+        /* labels */
+        section = NULL;
+        sname   = NULL;
+        symbols_mkloop(&fd->symbols, &loop);
+        while ((s = symbols_next(&loop)))
+        {
+            if (s->type != SYMBOL_TYPE_LABEL || !s->section)
+                continue;
+            if (s->section != sname)
+            {
+                sname   = s->section;
+                section = section_find(&fd->sections, sname);
+            }
+            if (!section)
+                continue;
+            list = _relax_sites(sites, nsites, section->fold ? _fold_target(section) : section, &count);
+            if (list)
+                s->offset = _relax_shift(list, count, s->offset);
+        }
+    }
+}
+
+/*
+ * Drop layout, so sections are glued and placed again. Symbols of linker
+ * context are restored to ones given before script.
+ */
+static void _relax_reset(struct linker_context_t *ctx, struct symbols_t *defines)
+{
+    struct llist_t *floop, *loop;
+    struct symbol_t *s;
+
+    symbols_destroy(&ctx->result.symbols);
+    symbols_init(&ctx->result.symbols);
+    sections_destroy(&ctx->result.sections);
+    sections_init(&ctx->result.sections);
+    relocations_destroy(&ctx->result.relocations);
+    relocations_init(&ctx->result.relocations);
+    place_destroy(ctx);
+    place_init(ctx);
+
+    symbols_destroy(&ctx->symbols);
+    symbols_init(&ctx->symbols);
+    symbols_mkloop(defines, &loop);
+    while ((s = symbols_next(&loop)))
+        linker_add_symbol(ctx, s->name, s->val64);
+
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+        struct section_t *section;
+
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+        {
+            section->output = NULL;
+            section->offset = 0;
+            if (section->strmap)
+                free(section->strmap);
+            section->strmap  = NULL;
+            section->nstrmap = 0;
+        }
+    }
+}
+
+/*
+ * Lay out sections, then shrink instructions which operand fits short form
+ * on that layout and lay out again, until none more can be shrunk.
+ * Instructions are only shrunk, never grown back, so process ends. Jumps
+ * between sections which get too long by layout changed are reported when
+ * relocations are applied.
+ */
+static void _relax(struct linker_context_t *ctx)
+{
+    struct symbols_t defines;
+    struct _relax_site_t *sites;
+    struct llist_t *loop;
+    struct symbol_t *s;
+    uint32_t nsites;
+    int noprint;
+
+    /* symbols given before script, script defines its own on each pass */
+    symbols_init(&defines);
+    symbols_mkloop(&ctx->symbols, &loop);
+    while ((s = symbols_next(&loop)))
+        symbol_set_const(symbols_add(&defines, s->name), s->val64);
+
+    noprint = app.noprint;
+    app.noprint = 1;
+    while (1)
+    {
+        _glue_sections(ctx);
+        _lscript(ctx);
+        place_sections(ctx);
+
+        nsites = _relax_find(ctx, &sites);
+        if (!nsites)
+            break;
+        _relax_shrink(ctx, sites, nsites);
+        free(sites);
+
+        _relax_reset(ctx, &defines);
+    }
+    app.noprint = noprint;
+
+    /* script is run once more on final layout, for its ".print" */
+    if (!app.noprint)
+    {
+        _relax_reset(ctx, &defines);
+        _glue_sections(ctx);
+        _lscript(ctx);
+        place_sections(ctx);
+    }
+
+    symbols_destroy(&defines);
+}
+
+/*
+ *
+ */
+static uint64_t _mkpatch(uint64_t value, int width)
+{
+    switch (width)
+    {
+        case 1: return host_tole32(value);
+        case 2: return host_tobe16(value);
+        case 3: return host_tobe24(value);
+        default:
+            /* NOTREACHED */
+            debug_emsg("Invalid width");
+            app_close(APP_EXITCODE_ERROR);
+            return 0;
+    }
+}
+
+#if 0
+/*
+ *
+ */
+static int64_t _mkdif(int64_t val1, int64_t val2)
+{
+    if (val2 > val1)
+        return val2 - val1;
+    else
+        return val1 - val2;
+}
+
+/*
+ *
+ */
+static int64_t _maxnum(int width)
+{
+    if (width == 1)
+        return 0xff;
+    if (width == 2)
+        return 0xffff;
+    if (width == 3)
+        return 0xffffff;
+
+    /* NOTREACHED */
+    debug_emsg("Invalid width");
+    app_close(APP_EXITCODE_ERROR);
+    return 0;
+}
+#endif
+
+/*
+ *
+ */
+static int64_t _smaxnum(int width)
+{
+    if (width == 1)
+        return 0x7F;
+
+    /* NOTREACHED */
+    debug_emsg("Invalid width");
+    app_close(APP_EXITCODE_ERROR);
+    return 0;
+}
+
+/*
+ *
+ */
+static int64_t _sminnum(int width)
+{
+    if (width == 1)
+        return -128;
 
     /* NOTREACHED */
     debug_emsg("Invalid width");
@@ -697,272 +3025,1012 @@ static int64_t _sminnum(int width)
 
 
 /*
- *
+ * Patch section with value of symbol relocation references. If "report" is
+ * set, nothing is patched, reason of failure is printed instead.
+ *
+ * RETURN
+ *     0 on success, -1 if relocation can not be applied
+ */
+static int _patch_relocation(struct section_t *rsection, struct relocation_t *relocation, int report)
+{
+    struct symbol_t *symbol;
+    int64_t patch;
+
+    symbol = _relocation_symbol(relocation);
+
+    if (symbol->type == SYMBOL_TYPE_CONST || relocation->type == RELOCATION_TYPE_ABOSULTE)
+    {
+        patch = symbol->type == SYMBOL_TYPE_CONST ? symbol->val64 : symbol->offset;
+        if (relocation->relax.kind == RELOCATION_RELAX_SHORT && relocation->length == 1 &&
+                (patch < 0 || patch > 0xFF))
+        {
+            if (report)
+            {
+                debug_emsgf("Symbol does not fit relaxed instruction",
+                        "\"%s\", value 0x%06llX" NL, _symbol_name(symbol), (long long int)patch);
+            }
+            return -1;
+        }
+        patch = _mkpatch(patch, relocation->length);
+    } else {
+        int64_t jump;
+
+        jump = symbol->offset - (rsection->vma + relocation->offset + relocation->adjust);
+
+        if ((jump <  0 && jump < _sminnum(relocation->length)) ||
+            (jump >= 0 && jump > _smaxnum(relocation->length)))
+        {
+            if (report)
+            {
+                debug_emsgf("Symbol jump too long",
+                        "\"%s\", symbol VMA 0x%06llX, relocation vma 0x%06X, jump %lld" NL,
+                        _symbol_name(symbol), (long long int)symbol->offset, (rsection->vma + relocation->offset + relocation->adjust), (long long int)jump);
+            }
+            return -1;
+        }
+
+        patch = jump;
+        patch = _mkpatch(patch, relocation->length);
+    }
+
+    if (rsection->noload)
+        return 0;
+
+    if (relocation->offset + relocation->length > rsection->length)
+    {
+        if (report)
+        {
+            debug_emsg("Failed to patch section");
+            printf("offset %08X length %08X section length %08X" NL, relocation->offset, relocation->length, rsection->length);
+        }
+        return -1;
+    }
+
+    if (!report)
+        section_patch(rsection, relocation->offset, &patch, relocation->length);
+
+    return 0;
+}
+
+/*
+ * Relocations of result which patch same section.
+ */
+struct _patch_part_t {
+    struct section_t *section;
+    uint32_t first;  /* first relocation of part in list */
+    uint32_t count;
+
+    int64_t failed;  /* first relocation of part failed to apply, -1 if none */
+};
+
+struct _patch_t {
+    struct _patch_part_t *parts;
+    struct relocation_t **list; /* relocations grouped by part, in order of result */
+    uint32_t *order;            /* position of relocation in result */
+};
+
+/*
+ * Apply relocations of n-th part. Only section of part is written. Failure
+ * is left in part, it is reported by main thread.
+ */
+static void _patch_task(void *arg, int n)
+{
+    struct _patch_t *patch = arg;
+    struct _patch_part_t *part = &patch->parts[n];
+    uint32_t i;
+
+    for (i = part->first; i < part->first + part->count; i++)
+    {
+        if (_patch_relocation(part->section, patch->list[i], 0) < 0)
+        {
+            part->failed = i;
+            break;
+        }
+    }
+}
+
+/*
+ * Apply relocations of result. Relocations are partitioned by section they
+ * patch, parts are applied on threads. If some of relocations can not be
+ * applied, one which comes first in result is reported.
+ */
+static void _apply_relocations(struct linker_context_t *ctx)
+{
+    struct _patch_t patch;
+    struct llist_t *loop;
+    struct section_t *section;
+    struct relocation_t *relocation;
+    uint32_t nparts, count, i;
+    int64_t failed;
+    int aborted;
+
+    nparts = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((section = sections_next(&loop)))
+        nparts++;
+    count = 0;
+    relocations_mkloop(&ctx->result.relocations, &loop);
+    while ((relocation = relocations_next(&loop)))
+        count++;
+    if (!nparts || !count)
+        return;
+
+    patch.parts = calloc(nparts, sizeof(struct _patch_part_t));
+    patch.list  = malloc(count * sizeof(struct relocation_t *));
+    patch.order = malloc(count * sizeof(uint32_t));
+    if (!patch.parts || !patch.list || !patch.order)
+    {
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
+
+    i = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((section = sections_next(&loop)))
+    {
+        patch.parts[i].section = section;
+        patch.parts[i].failed  = -1;
+        i++;
+    }
+
+    /* count relocations of each part, then give each part its piece of list */
+    for (i = 0; i < 2; i++)
+    {
+        uint32_t n, p;
+
+        n = 0;
+        relocations_mkloop(&ctx->result.relocations, &loop);
+        while ((relocation = relocations_next(&loop)))
+        {
+            /* result relocations reference name of result section */
+            for (p = 0; p < nparts; p++)
+            {
+                if (relocation->section == patch.parts[p].section->name ||
+                        strcmp(relocation->section, patch.parts[p].section->name) == 0)
+                    break;
+            }
+            if (p == nparts)
+            {
+                /* NOTREACHED */
+                debug_emsg("Section not found for relocation");
+                app_close(APP_EXITCODE_ERROR);
+            }
+
+            if (i == 0)
+            {
+                patch.parts[p].count++;
+            } else {
+                patch.list[patch.parts[p].first + patch.parts[p].count]  = relocation;
+                patch.order[patch.parts[p].first + patch.parts[p].count] = n;
+                patch.parts[p].count++;
+            }
+            n++;
+        }
+
+        if (i == 0)
+        {
+            for (n = 0, p = 0; p < nparts; p++)
+            {
+                patch.parts[p].first = n;
+                n += patch.parts[p].count;
+                patch.parts[p].count = 0;
+            }
+        }
+    }
+
+    /* part which task was interrupted in (error is printed) fails link */
+    aborted = _run_tasks(_patch_task, &patch, nparts);
+
+    failed = -1;
+    for (i = 0; i < nparts; i++)
+    {
+        int64_t f = patch.parts[i].failed;
+
+        if (f >= 0 && (failed < 0 || patch.order[f] < patch.order[failed]))
+            failed = f;
+    }
+    if (failed >= 0)
+    {
+        for (i = 0; i < nparts; i++)
+        {
+            if (failed >= patch.parts[i].first && failed < patch.parts[i].first + patch.parts[i].count)
+                section = patch.parts[i].section;
+        }
+        relocation = patch.list[failed];
+    }
+
+    free(patch.parts);
+    free(patch.list);
+    free(patch.order);
+
+    if (aborted >= 0)
+        app_close(APP_EXITCODE_ERROR);
+    if (failed >= 0)
+    {
+        _patch_relocation(section, relocation, 1);
+        app_close(APP_EXITCODE_ERROR);
+    }
+}
+
+/*
+ *
+ */
+static int _image_section_cmp(const void *p1, const void *p2)
+{
+    const struct section_t *s1 = *(struct section_t * const *)p1;
+    const struct section_t *s2 = *(struct section_t * const *)p2;
+
+    if (s1->lma != s2->lma)
+        return s1->lma < s2->lma ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Make image of loadable output sections placed. Image is one buffer sized
+ * by layout, sections are in order of LMA, so contiguous sections are
+ * contiguous in image. Output sections hold only data made by linker
+ * (merged strings, ".fill") before, it is moved to image. Data of input
+ * sections is copied to image from files mapped, once. Output sections are
+ * patched in image after that.
+ */
+static void _image_build(struct linker_context_t *ctx)
+{
+    struct section_t **list;
+    struct section_t *section;
+    struct llist_t *loop;
+    struct llist_t *floop;
+    uint64_t size;
+    uint32_t n, i, pos, start, lma;
+
+    n    = 0;
+    size = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((section = sections_next(&loop)))
+    {
+        if (section->noload || !section->length)
+            continue;
+        size += section->length;
+        n++;
+    }
+    if (size > UINT32_MAX)
+        goto error;
+
+    list = malloc((n ? n : 1) * sizeof(struct section_t *));
+    ctx->image.data   = malloc(size ? size : 1);
+    ctx->image.chunks = memdata_create();
+    if (!list || !ctx->image.data || !ctx->image.chunks)
+        goto error;
+
+    n = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((section = sections_next(&loop)))
+    {
+        if (section->noload || !section->length)
+            continue;
+        list[n++] = section;
+    }
+    qsort(list, n, sizeof(struct section_t *), _image_section_cmp);
+
+    pos   = 0;
+    start = 0;
+    lma   = 0;
+    for (i = 0; i < n; i++)
+    {
+        section = list[i];
+        if (pos == start)
+            lma = section->lma;
+
+        /* data of linker is moved, space reserved for input sections is filled below */
+        section_attach(section, &ctx->image.data[pos]);
+        pos += section->length;
+
+        /* chunk ends where next section does not follow */
+        if (i + 1 < n && list[i + 1]->lma == section->lma + section->length)
+            continue;
+        if (memdata_add_ref(ctx->image.chunks, lma, &ctx->image.data[start], pos - start) < 0)
+            goto error;
+        start = pos;
+    }
+    free(list);
+
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+        {
+            /*
+             * Input sections not glued yet are patched to output by relink,
+             * data of sections released by streaming link is in output already.
+             */
+            if (!section->output || section->output->noload || !section->length ||
+                    section->discard || section->fold || section->strmap || !section->data)
+                continue;
+            memcpy(&section->output->data[section->offset], section->data, section->length);
+        }
+    }
+
+    return;
+error:
+    debug_emsg("Can not allocate memory for image");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * Output sections referencing image should be destroyed before.
+ */
+static void _image_destroy(struct linker_context_t *ctx)
+{
+    memdata_destroy(ctx->image.chunks);
+    ctx->image.chunks = NULL;
+    if (ctx->image.data)
+        free(ctx->image.data);
+    ctx->image.data = NULL;
+}
+
+/*
+ *
+ */
+static void _patch_sections(struct linker_context_t *ctx)
+{
+    /* check sections overlap */
+    {
+        struct llist_t *loop;
+        struct section_t *s;
+
+        sections_mkloop(&ctx->result.sections, &loop);
+        while ((s = sections_next(&loop)))
+        {
+            if ((s->vma + s->length) > 0x010000)
+            {
+                debug_wmsgf("Section cross 64kb - be care", "\"%s\"" NL, s->name);
+            }
+        }
+
+        place_check(ctx);
+    }
+
+    _image_build(ctx);
+
+    /* fix symbols */
+    {
+        struct llist_t *loop;
+        struct symbol_t *s;
+
+        symbols_mkloop(&ctx->result.symbols, &loop);
+        while ((s = symbols_next(&loop)))
+        {
+            struct section_t *section;
+
+            if (s->type != SYMBOL_TYPE_LABEL)
+                continue;
+
+            section = section_find(&ctx->result.sections, s->section);
+            if (!section)
+            {
+                /* NOTREACHED */
+                debug_emsgf("Section not found", "\"%s\"" NL, s->section);
+                app_close(APP_EXITCODE_ERROR);
+            }
+
+            s->offset += section->vma;
+        }
+    }
+
+    /* resolve symbols of linker context */
+    {
+        struct llist_t *loop;
+        struct symbol_t *s;
+
+        symbols_mkloop(&ctx->result.symbols, &loop);
+        while ((s = symbols_next(&loop)))
+        {
+            struct symbol_t *ns;
+
+            if (s->type != SYMBOL_TYPE_EXTERN)
+                continue;
+
+            ns = symbol_find(&ctx->symbols, s->name);
+            if (!ns)
+            {
+                debug_emsgf("Undefined reference to symbol", "\"%s\"" NL, s->name);
+                app_close(APP_EXITCODE_ERROR);
+            }
+
+            /* Change symbol in result symbols */
+            s->val64 = ns->val64;
+            s->type  = SYMBOL_TYPE_CONST;
+        }
+    }
+
+    _apply_relocations(ctx);
+}
+
+/*
+ *
+ */
+static void _lscript(struct linker_context_t *ctx)
+{
+    struct token_t *token;
+
+    token = token_new(&ctx->tokens);
+    token_prepare(token, app.lscript);
+
+    while (1)
+    {
+        token_drop(token);
+        if (lang_eof(token) == 0)
+            break;
+        if (lang_comment(token) == 0)
+            continue;
+        if (lang_const_symbol(ctx, token) == 0)
+            continue;
+        if (lang_directive(ctx, token) == 0)
+            continue;
+
+        debug_emsg("Unknown construction in script");
+        goto error;
+    }
+
+    goto noerror;
+error:
+    token_print_rollback(token);
+    debug_emsgf("Error in file", "%s" NL, app.lscript);
+noerror:
+    token_remove(&ctx->tokens, token);
+}
+
+/*
+ * Take ".keep" and ".fold" directives of script, other constructions are
+ * skipped here and taken by _lscript() after sections are glued.
+ */
+static void _lscript_prescan(struct linker_context_t *ctx)
+{
+    struct token_t *token;
+
+    token = token_new(&ctx->tokens);
+    token_prepare(token, app.lscript);
+
+    while (1)
+    {
+        token_drop(token);
+        if (lang_eof(token) == 0)
+            break;
+        if (lang_prescan(ctx, token) == 0)
+            continue;
+        if (token_get(token, TOKEN_TYPE_LINE, TOKEN_CURRENT))
+            continue;
+        break;
+    }
+
+    token_remove(&ctx->tokens, token);
+}
+
+
+/*
+ *
+ */
+static void _write_srec(struct linker_context_t *ctx, char *path)
+{
+    /* chunks of image are packed and sorted already */
+    if (!ctx->image.chunks || !ctx->image.chunks->rows)
+    {
+        debug_emsg("No output data");
+        goto error;
+    }
+
+#if 0
+    memdata_print(ctx->image.chunks);
+#endif
+
+    if (srec_write(path, ctx->image.chunks, *app.s19head ? app.s19head : NULL) < 0)
+        goto error;
+
+    return;
+error:
+    debug_emsgf("Failed to write file", SQ NL, path);
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * RETURN
+ *     path of state of incremental link, kept next to output
+ */
+static char *_state_path()
+{
+    static char path[PATH_MAX + 8];
+
+    snprintf(path, sizeof(path), "%s.state", app.outputfile);
+
+    return path;
+}
+
+/*
+ * RETURN
+ *     hash of linker script and options, state is valid only while they
+ *     are not changed
+ */
+static uint64_t _state_config()
+{
+    uint64_t hash, size, shash;
+    int i;
+
+    hash = STATE_HASH_INIT;
+    if (state_hash_file(app.lscript, &size, &shash) == 0)
+        hash = state_hash(hash, &shash, sizeof(shash));
+    for (i = 0; i < app.ndefines; i++)
+        hash = state_hash(hash, app.defines[i], strlen(app.defines[i]) + 1);
+    hash = state_hash(hash, app.s19head, strlen(app.s19head) + 1);
+
+    return hash;
+}
+
+/*
+ * Set names of symbols referenced by file.
+ */
+static void _state_externs(struct state_object_t *obj, struct linker_file_data_t *fd)
+{
+    struct llist_t *loop;
+    struct symbol_t *s;
+
+    llist_destroy(obj->externs);
+    obj->externs = NULL;
+
+    symbols_mkloop(&fd->symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        if (s->type == SYMBOL_TYPE_EXTERN)
+            state_extern_add(obj, s->name);
+    }
+}
+
+/*
+ * Save layout and resolved symbols of full link. Links with archives,
+ * garbage collection or folding of sections are not relinked incrementally,
+ * since set of linked objects and sections depends on all of them.
  */
-static void _patch_sections(struct linker_context_t *ctx)
+static void _state_write(struct linker_context_t *ctx)
 {
-    /* check sections overlap */
+    struct state_t *st = &ctx->state;
+    struct llist_t *floop;
+    struct llist_t *loop;
+    struct section_t *section;
+    struct symbol_t *s;
+    uint64_t size;
+    int i;
+
+    state_destroy(st);
+
+    if (ctx->alist || app.gcsections || app.icf || app.relax || app.stream)
     {
-        struct llist_t *loop;
-        struct section_t *s0;
+        unlink(_state_path());
+        return;
+    }
 
-        sections_mkloop(&ctx->result.sections, &loop);
-        while ((s0 = sections_next(&loop)))
-        {
-            struct llist_t *loop;
-            struct section_t *s1;
+    st->config = _state_config();
+    if (state_hash_file(app.outputfile, &size, &st->image) < 0)
+        return;
 
-            if ((s0->vma + s0->length) > 0x010000)
-            {
-                debug_wmsgf("Section cross 64kb - be care", "\"%s\"" NL, s0->name);
-            }
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((section = sections_next(&loop)))
+        state_output_add(st, section->name, section->lma, section->vma, section->length, section->noload);
 
-            sections_mkloop(&ctx->result.sections, &loop);
-            while ((s1 = sections_next(&loop)))
-            {
-                if (strcmp(s0->name, s1->name) == 0)
-                    continue;
+    for (floop = ctx->flist, i = 0; floop; floop = floop->next, i++)
+    {
+        struct linker_file_data_t *fd = floop->p;
+        struct state_object_t *obj;
 
-                /* LMA */
-                if (!s0->noload && !s1->noload)
-                {
-                    if (
-                        (s0->lma  < s1->lma && (s0->lma + s0->length) > s1->lma) ||
-                        (s0->lma >= s1->lma && (s1->lma + s1->length) > s0->lma))
-                    {
-                        debug_emsgf("LMA of sections overlaps", "\"%s\" \"%s\"" NL, s0->name, s1->name);
-                        app_close(APP_EXITCODE_ERROR);
-                        return;
-                    }
-                }
+        obj = state_object_add(st, app.infiles[i], fd->map.length,
+                state_hash(STATE_HASH_INIT, fd->map.addr, fd->map.length));
 
-                if (
-                    (s0->vma  < s1->vma && (s0->vma + s0->length) > s1->vma) ||
-                    (s0->vma >= s1->vma && (s1->vma + s1->length) > s0->vma))
-                {
-                    debug_emsgf("VMA of sections overlaps", "\"%s\" \"%s\"" NL, s0->name, s1->name);
-                    app_close(APP_EXITCODE_ERROR);
-                    return;
-                }
-            }
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+            state_section_add(obj, section->name, section->output->name, section->offset, section->length);
+
+        symbols_mkloop(&fd->symbols, &loop);
+        while ((s = symbols_next(&loop)))
+        {
+            if (s->type != SYMBOL_TYPE_LABEL || !s->exp)
+                continue;
+            state_symbol_add(st, s->name, i, 1, s->result->width, s->result->offset);
+            obj->nexports++;
         }
+
+        _state_externs(obj, fd);
     }
 
-    /* fix symbols */
+    /* symbols of linker referenced by files */
+    symbols_mkloop(&ctx->result.symbols, &loop);
+    while ((s = symbols_next(&loop)))
     {
-        struct llist_t *loop;
-        struct symbol_t *s;
+        if (!s->file && s->type == SYMBOL_TYPE_CONST)
+            state_symbol_add(st, s->name, -1, 0, s->width, s->val64);
+    }
+    state_symbols_sort(st);
 
-        symbols_mkloop(&ctx->result.symbols, &loop);
-        while ((s = symbols_next(&loop)))
-        {
-            struct section_t *section;
+    state_save(st, _state_path());
+}
 
-            if (s->type != SYMBOL_TYPE_LABEL)
-                continue;
+/*
+ * Object of incremental link.
+ */
+struct _relink_file_t {
+    struct state_object_t *obj;
+    struct linker_file_data_t *fd; /* NULL if object is not relinked */
+    int changed;                   /* content changed, dependent object otherwise */
+};
 
-            section = section_find(&ctx->result.sections, s->section);
-            if (!section)
-            {
-                /* NOTREACHED */
-                debug_emsgf("Section not found", "\"%s\"" NL, s->section);
-                app_close(APP_EXITCODE_ERROR);
-            }
+/*
+ * RETURN
+ *     0 on success, -1 if file can not be loaded
+ */
+static int _relink_load(struct linker_context_t *ctx, struct _relink_file_t *rf)
+{
+    struct linker_file_data_t *fd;
 
-            s->offset += section->vma;
-        }
+    if (l0_archive_probe(rf->obj->path))
+        return -1;
+
+    fd = _add_file(ctx, _basename(rf->obj->path));
+    if (l0_load(rf->obj->path, &fd->map, &fd->symbols, &fd->sections, &fd->relocations) < 0)
+        return -1;
+    if (_rgroups_build(fd) < 0)
+    {
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
     }
+    rf->fd = fd;
+
+    return 0;
+}
+
+/*
+ * Check that changed object fits layout of previous link, update addresses
+ * of symbols exported by it.
+ *
+ * RETURN
+ *     0 on success, -1 if full link is needed
+ */
+static int _relink_check(struct state_t *st, struct _relink_file_t *rf, int n)
+{
+    struct llist_t *loop;
+    struct section_t *section;
+    struct symbol_t *s;
+    int count;
 
-    /* apply relocations */
+    count = 0;
+    sections_mkloop(&rf->fd->sections, &loop);
+    while ((section = sections_next(&loop)))
     {
-        struct llist_t *loop;
-        struct relocation_t *relocation;
+        struct state_section_t *ss;
+        struct llist_t *oloop;
 
-        relocations_mkloop(&ctx->result.relocations, &loop);
-        while ((relocation = relocations_next(&loop)))
+        ss = state_section_find(rf->obj, section->name);
+        if (!ss || section->length > ss->length)
+            return -1;
+        for (oloop = st->outputs; oloop; oloop = oloop->next)
         {
-            struct symbol_t *symbol;
-            struct section_t *rsection, *ssection;
-            int64_t patch;
+            struct state_output_t *o = oloop->p;
 
-            symbol = symbol_find(&ctx->result.symbols, relocation->symbol);
-            if (!symbol)
+            if (strcmp(o->name, ss->output) == 0)
             {
-                /* NOTREACHED */
-                debug_emsg("NULL");
-                app_close(APP_EXITCODE_ERROR);
+                /* output section may be made NOLOAD by script */
+                if (section->noload && !o->noload)
+                    return -1;
+                break;
             }
+        }
+        if (!oloop || l0_section_check(section) < 0)
+            return -1;
+        count++;
+    }
+    if (count != llist_count(rf->obj->sections))
+        return -1;
 
-            if (symbol->type == SYMBOL_TYPE_EXTERN)
-            {
-                struct symbol_t *ns;
+    count = 0;
+    symbols_mkloop(&rf->fd->symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        struct state_symbol_t *ss;
 
-                ns = symbol_find(&ctx->symbols, relocation->symbol);
-                if (!ns)
-                {
-                    debug_emsgf("Undefined reference to symbol", "\"%s\"" NL, relocation->symbol);
-                    app_close(APP_EXITCODE_ERROR);
-                }
+        if (s->type == SYMBOL_TYPE_EXTERN)
+        {
+            ss = state_symbol_find(st, s->name);
+            if (!ss || ss->object == n)
+                return -1;
+        } else if (s->type == SYMBOL_TYPE_LABEL && s->exp) {
+            struct state_section_t *sec;
+            struct llist_t *oloop;
+            int64_t addr;
+
+            ss = state_symbol_find(st, s->name);
+            if (!ss || ss->object != n)
+                return -1;
+
+            sec = state_section_find(rf->obj, s->section);
+            if (!sec)
+                return -1;
+            addr = 0;
+            for (oloop = st->outputs; oloop; oloop = oloop->next)
+            {
+                struct state_output_t *o = oloop->p;
 
-                /* Change symbol in result symbols */
-                symbol->val64 = ns->val64;
-                symbol->type  = SYMBOL_TYPE_CONST;
+                if (strcmp(o->name, sec->output) == 0)
+                    addr = o->vma + sec->offset + s->offset;
             }
 
-            rsection = section_find(&ctx->result.sections, relocation->section);
-            if (!rsection)
+            if (ss->value != addr || ss->width != s->width)
             {
-                /* NOTREACHED */
-                debug_emsg("NULL");
-                app_close(APP_EXITCODE_ERROR);
+                ss->value   = addr;
+                ss->width   = s->width;
+                ss->changed = 1;
             }
+            count++;
+        }
+    }
+    if (count != rf->obj->nexports)
+        return -1;
 
-            if (symbol->type == SYMBOL_TYPE_CONST)
-            {
-                patch = _mkpatch(symbol->val64, symbol->width);
-                section_patch(rsection, relocation->offset, &patch, relocation->length);
-                continue;
-            }
+    return 0;
+}
 
-            ssection = section_find(&ctx->result.sections, symbol->section);
-            if (!ssection)
-            {
-                /* NOTREACHED */
-                debug_emsg("NULL");
-                app_close(APP_EXITCODE_ERROR);
-            }
+/*
+ * Make output sections of previous link from state and output file.
+ *
+ * RETURN
+ *     0 on success, -1 if output does not match state
+ */
+static int _relink_image(struct linker_context_t *ctx, struct state_t *st)
+{
+    struct memdata_t *md;
+    struct llist_t *loop;
+    int ret;
 
-            if (relocation->type == RELOCATION_TYPE_ABOSULTE)
-            {
-#if 0
-                if (_mkdif(relocation->offset + rsection->vma, symbol->offset) > _maxnum(relocation->length))
-                {
-                    debug_emsgf("Symbol jump too long",
-                            "\"%s\", symbol VMA 0x%06llX, relocation vma 0x%06X" NL,
-                            symbol->name, symbol->offset, relocation->offset + rsection->vma);
-                    app_close(APP_EXITCODE_ERROR);
-                }
-#endif
+    md = srec_read(app.outputfile, 0);
+    if (!md)
+        return -1;
 
-                patch = symbol->offset;
-                patch = _mkpatch(patch, symbol->width);
-            } else {
-                int64_t jump;
+    for (loop = st->outputs; loop; loop = loop->next)
+    {
+        struct state_output_t *o = loop->p;
+        struct section_t *section;
 
-                jump = symbol->offset - (rsection->vma + relocation->offset + relocation->adjust);
+        section = section_add(&ctx->result.sections, o->name);
+        section->noload = o->noload;
+        section->lma    = o->lma;
+        section->vma    = o->vma;
+        section->placed = 1;
+        section_reserve(section, o->length);
+    }
 
-                if ((jump <  0 && jump < _sminnum(relocation->length)) ||
-                    (jump >= 0 && jump > _smaxnum(relocation->length)))
-                {
-                    debug_emsgf("Symbol jump too long",
-                            "\"%s\", symbol VMA 0x%06llX, relocation vma 0x%06X, jump %lld" NL,
-                            symbol->name, (long long int)symbol->offset, (rsection->vma + relocation->offset + relocation->adjust), (long long int)jump);
-                    app_close(APP_EXITCODE_ERROR);
-                }
+    /* input sections are not glued, so image is filled by output file only */
+    _image_build(ctx);
 
-                patch = jump;
-                patch = _mkpatch(patch, symbol->width);
-            }
-            section_patch(rsection, relocation->offset, &patch, relocation->length);
+    ret = 0;
+    for (loop = st->outputs; loop; loop = loop->next)
+    {
+        struct state_output_t *o = loop->p;
+        struct section_t *section;
+        struct memdata_row_t *row;
+        struct llist_t *rloop;
+        uint32_t covered;
+
+        if (o->noload || !o->length)
+            continue;
+        section = section_find(&ctx->result.sections, o->name);
+
+        /* rows are packed, so they do not overlap */
+        covered = 0;
+        memdata_mkloop(md, &rloop);
+        while ((row = memdata_next(&rloop)))
+        {
+            uint32_t start, end;
+
+            start = row->offset > o->lma ? row->offset : o->lma;
+            end   = row->offset + row->length < o->lma + o->length ? row->offset + row->length : o->lma + o->length;
+            if (start >= end)
+                continue;
+            memcpy(&section->data[start - o->lma], &row->data[start - row->offset], end - start);
+            covered += end - start;
+        }
+
+        if (covered != o->length)
+        {
+            ret = -1;
+            break;
         }
     }
+
+    memdata_destroy(md);
+
+    return ret;
 }
 
 /*
- *
+ * Glue changed objects into space they had on previous link, patch
+ * relocations of them and of objects referencing symbols moved.
  */
-static void _lscript(struct linker_context_t *ctx)
+static void _relink_patch(struct linker_context_t *ctx, struct _relink_file_t *rf)
 {
-    struct token_t *token;
-
-    token = token_new(&ctx->tokens);
-    token_prepare(token, app.lscript);
+    struct linker_file_data_t *fd = rf->fd;
+    struct llist_t *loop;
+    struct section_t *section;
+    struct symbol_t *s;
 
-    while (1)
+    sections_mkloop(&fd->sections, &loop);
+    while ((section = sections_next(&loop)))
     {
-        token_drop(token);
-        if (lang_eof(token) == 0)
-            break;
-        if (lang_comment(token) == 0)
-            continue;
-        if (lang_const_symbol(ctx, token) == 0)
-            continue;
-        if (lang_directive(ctx, token) == 0)
+        struct state_section_t *ss;
+
+        ss = state_section_find(rf->obj, section->name);
+        section->output = section_find(&ctx->result.sections, ss->output);
+        section->offset = ss->offset;
+        if (!section->output)
+        {
+            /* NOTREACHED */
+            debug_emsgf("Section not found", "\"%s\"" NL, ss->output);
+            app_close(APP_EXITCODE_ERROR);
+        }
+
+        if (!rf->changed || section->output->noload)
             continue;
 
-        debug_emsg("Unknown construction in script");
-        goto error;
+        /* rest of space of section shrunk is filled as erased flash */
+        section_patch(section->output, ss->offset, section->data, section->length);
+        memset(&section->output->data[ss->offset + section->length], 0xFF, ss->length - section->length);
     }
 
-    goto noerror;
-error:
-    token_print_rollback(token);
-    debug_emsgf("Error in file", "%s" NL, app.lscript);
-noerror:
-    token_remove(&ctx->tokens, token);
-}
+    symbols_mkloop(&fd->symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        struct symbol_t *ns;
+
+        if (s->type == SYMBOL_TYPE_EXTERN)
+        {
+            struct state_symbol_t *ss;
+
+            ss = state_symbol_find(&ctx->state, s->name);
+            ns = symbols_add_ref(&ctx->result.symbols, s->name, NULL);
+            ns->type  = ss->label ? SYMBOL_TYPE_LABEL : SYMBOL_TYPE_CONST;
+            ns->width = ss->width;
+            ns->val64 = ss->value;
+        } else {
+            section = section_find(&fd->sections, s->section);
+            if (!section)
+            {
+                /* NOTREACHED */
+                debug_emsgf("Section not found", "\"%s\"" NL, s->section);
+                app_close(APP_EXITCODE_ERROR);
+            }
+
+            ns = symbols_add_ref(&ctx->result.symbols, s->name, section->output->name);
+            ns->type   = SYMBOL_TYPE_LABEL;
+            ns->width  = s->width;
+            ns->offset = section->output->vma + section->offset + s->offset;
+            ns->file   = fd->fname;
+            s->result  = ns;
+        }
 
+        _add_relocation(ctx, fd, s, ns);
+    }
+}
 
 /*
+ * Relink objects changed since previous link, if layout of it is not
+ * changed: script and options are same, each section of changed object
+ * fits into space it had and set of exported symbols is same. Objects
+ * referencing symbols which addresses changed are patched too.
  *
+ * RETURN
+ *     0 if output is up to date, -1 if full link is needed
  */
-static void _write_srec(struct linker_context_t *ctx, char *path)
+static int _relink(struct linker_context_t *ctx)
 {
+    struct state_t *st = &ctx->state;
+    struct _relink_file_t *rf;
     struct llist_t *loop;
-    struct section_t *section;
-    struct memdata_t *md;
-    int havedata;
-
-    md = memdata_create();
-    if (!md)
+    uint64_t size, hash;
+    int i, n, nchanged;
+
+    rf = NULL;
+
+    if (!*app.outputfile || app.printmap || *app.mapjson || app.gcsections || app.icf || app.relax || app.stream)
+        return -1;
+    if (state_load(st, _state_path()) < 0)
+        return -1;
+    if (st->config != _state_config() || llist_count(st->objects) != app.innum)
+        goto full;
+    if (state_hash_file(app.outputfile, &size, &hash) < 0 || hash != st->image)
+        goto full;
+
+    rf = calloc(app.innum ? app.innum : 1, sizeof(struct _relink_file_t));
+    if (!rf)
+        goto full;
+
+    /* load objects changed */
+    nchanged = 0;
+    for (loop = st->objects, n = 0; loop; loop = loop->next, n++)
     {
-        debug_emsg("Failed to allocate memdata");
-        goto error;
+        rf[n].obj = loop->p;
+        if (strcmp(rf[n].obj->path, app.infiles[n]) != 0)
+            goto full;
+        if (state_hash_file(rf[n].obj->path, &size, &hash) < 0)
+            goto full;
+        if (size == rf[n].obj->size && hash == rf[n].obj->hash)
+            continue;
+
+        if (_relink_load(ctx, &rf[n]) < 0)
+            goto full;
+        rf[n].changed = 1;
+        if (_relink_check(st, &rf[n], n) < 0)
+            goto full;
+        nchanged++;
     }
 
-    havedata = 0;
+    if (!nchanged)
+    {
+        free(rf);
+        return 0;
+    }
 
-    /* make memdata from sections */
-    sections_mkloop(&ctx->result.sections, &loop);
-    while ((section = sections_next(&loop)))
+    /* load objects referencing symbols changed */
+    for (i = 0; i < n; i++)
     {
-        if (section->noload || !section->length)
+        if (rf[i].fd)
             continue;
-
-        havedata = 1;
-
-        if (memdata_add(md, section->lma, (uint8_t *)section->data, section->length) < 0)
+        for (loop = rf[i].obj->externs; loop; loop = loop->next)
         {
-            debug_emsg("Faile to add memory data");
-            goto error;
+            struct state_symbol_t *ss;
+
+            ss = state_symbol_find(st, loop->p);
+            if (ss && ss->changed)
+                break;
         }
+        if (loop && _relink_load(ctx, &rf[i]) < 0)
+            goto full;
     }
 
-    if (!havedata)
-    {
-        debug_emsg("No output data");
-        goto error;
-    }
+    if (_relink_image(ctx, st) < 0)
+        goto full;
 
-    if (memdata_pack(&md) < 0)
+    for (i = 0; i < n; i++)
     {
-        debug_emsg("Faile to pack memory data");
-        goto error;
+        if (!rf[i].fd)
+            continue;
+        _relink_patch(ctx, &rf[i]);
+
+        if (rf[i].changed)
+        {
+            rf[i].obj->size = rf[i].fd->map.length;
+            rf[i].obj->hash = state_hash(STATE_HASH_INIT, rf[i].fd->map.addr, rf[i].fd->map.length);
+            _state_externs(rf[i].obj, rf[i].fd);
+        }
     }
+    free(rf);
 
-#if 0
-    memdata_print(md);
-#endif
+    _apply_relocations(ctx);
+    _write_srec(ctx, app.outputfile);
 
-    if (srec_write(path, md, *app.s19head ? app.s19head : NULL) < 0)
-        goto error;
+    for (i = 0; i < (int)st->symbols.count; i++)
+        st->symbols.list[i].changed = 0;
+    if (state_hash_file(app.outputfile, &size, &st->image) == 0)
+        state_save(st, _state_path());
 
-    memdata_destroy(md);
-    return;
-error:
-    debug_emsgf("Failed to write file", SQ NL, path);
-    if (md)
-        memdata_destroy(md);
-    app_close(APP_EXITCODE_ERROR);
-}
+    return 0;
+full:
+    if (rf)
+        free(rf);
+    state_destroy(st);
+    llist_destroy(ctx->flist);
+    ctx->flist = NULL;
+    sections_destroy(&ctx->result.sections);
+    sections_init(&ctx->result.sections);
+    symbols_destroy(&ctx->result.symbols);
+    symbols_init(&ctx->result.symbols);
+    relocations_destroy(&ctx->result.relocations);
+    relocations_init(&ctx->result.relocations);
+    _image_destroy(ctx);
 
+    return -1;
+}
@@ -33,6 +33,19 @@
 #include <symbol.h>
 #include <section.h>
 #include <relocation.h>
+#include <l0.h>
+#include <memdata.h>
+/* */
+#include "state.h"
+
+/*
+ * Relocations of file which reference same symbol.
+ */
+struct linker_reloc_group_t {
+    char *symbol; /* NULL if entry is empty */
+    struct relocation_t **first;
+    uint32_t count;
+};
 
 struct linker_file_data_t {
     char *fname;
@@ -40,10 +53,86 @@ struct linker_file_data_t {
     struct symbols_t symbols;
     struct sections_t sections;
     struct relocations_t relocations;
+
+    /* relocations grouped by symbol, open addressing */
+    struct {
+        struct linker_reloc_group_t *table;
+        struct relocation_t **list; /* relocations of all groups, in order of file */
+        uint32_t size;              /* power of 2 */
+    } rgroups;
+
+    struct l0_map_t map; /* mapping of file, referenced by lists above */
+    char *strings;       /* names of symbols and sections copied from mapping, streaming link */
+};
+
+/*
+ * Archive, members of it are loaded only if they export symbol needed.
+ */
+struct linker_archive_t {
+    char *fname;
+    struct l0_archive_t ar;
+    uint8_t *loaded; /* flags of members already loaded */
+};
+
+/*
+ * Entry of hash of symbols exported by loaded files.
+ */
+struct linker_export_t {
+    struct symbol_t *symbol; /* NULL if entry is empty */
+    struct linker_file_data_t *fd;
+};
+
+/*
+ * Memory region of linker script, sections are placed into it automatically.
+ */
+struct linker_region_t {
+    char *name;
+    uint32_t start;
+    uint32_t length;
+    int noload; /* volatile memory, holds only VMA of sections */
+};
+
+/*
+ * Section which address should be found in region.
+ */
+struct linker_place_t {
+    struct section_t *section;
+    struct linker_region_t *lregion; /* region of LMA, NULL if LMA given or not needed */
+    struct linker_region_t *vregion; /* region of VMA, NULL if VMA given */
+};
+
+/*
+ * Root of garbage collection of sections, given by ".keep" directive.
+ */
+struct linker_keep_t {
+    char *name;
+    int symbol; /* name of exported symbol, section name otherwise */
+};
+
+/*
+ * Output section which identical input sections are folded in, given by
+ * ".fold" directive.
+ */
+struct linker_fold_t {
+    char *name;
+    int strings; /* input sections hold strings, merged by string */
 };
 
 struct linker_context_t {
     struct llist_t *flist;
+    struct llist_t *alist; /* archives */
+
+    struct llist_t *regions;
+    struct llist_t *places; /* sections placed into regions */
+    struct llist_t *keeps;
+    struct llist_t *folds;
+
+    /* exported symbols of all files, open addressing */
+    struct {
+        struct linker_export_t *table;
+        uint32_t size;  /* power of 2 */
+        uint32_t count;
+    } exports;
 
     struct symbols_t symbols;
 
@@ -53,14 +142,25 @@ struct linker_context_t {
         struct relocations_t relocations;
     } result;
 
+    /* loadable data of output sections, which reference it */
+    struct {
+        uint8_t *data;
+        struct memdata_t *chunks; /* contiguous memory, rows reference data */
+    } image;
+
     struct tokens_t tokens;
+
+    struct state_t state; /* state of incremental link */
 };
 
 void linker_init();
 void linker_run();
+void linker_run_variants();
 void linker_destroy();
 
 struct symbol_t * linker_add_symbol(struct linker_context_t *ctx, char *name, int64_t value);
+void linker_keep_add(struct linker_context_t *ctx, char *name, int symbol);
+void linker_fold_add(struct linker_context_t *ctx, char *name, int strings);
 
 extern struct linker_context_t lcontext;
 
@@ -33,14 +33,20 @@
 #include <debug.h>
 #include <lang_util.h>
 #include <version.h>
+#include <watch.h>
 #include "app.h"
 #include "linker.h"
 
 struct app_context_t app;
+__thread jmp_buf *app_taskjmp;
 
 static void app_init(int argc, char** argv);
 static void app_run();
 static void _get_options(int argc, char** argv);
+static void _define(char *def, int replace);
+static void _variant_add(char *spec);
+static void _apply_defines();
+static void _watch();
 static void _print_head();
 static void _print_help(int argc, char **argv);
 
@@ -50,7 +56,10 @@ static void _print_help(int argc, char **argv);
 int main(int argc, char** argv)
 {
     app_init(argc, argv);
-    app_run();
+    if (app.watch)
+        _watch();
+    else
+        app_run();
     app_close(APP_EXITCODE_OK);
     return 0;
 }
@@ -103,10 +112,22 @@ static void app_init(int argc, char** argv)
     *app.lscript     = 0;
     *app.outputfile  = 0;
     *app.s19head     = 0;
+    *app.mapjson     = 0;
+    app.ndefines     = 0;
+    app.nvariants    = 0;
+    app.gcsections   = 0;
+    app.icf          = 0;
+    app.relax        = 0;
+    app.incremental  = 0;
+    app.stream       = 0;
+    app.jobs         = 0;
+    app.watch        = 0;
+    app.watchjmp     = NULL;
 
     linker_init();
 
     _get_options(argc, argv);
+    _apply_defines();
 }
 
 /*
@@ -114,7 +135,52 @@ static void app_init(int argc, char** argv)
  */
 static void app_run()
 {
-    linker_run();
+    if (app.nvariants)
+        linker_run_variants();
+    else
+        linker_run();
+}
+
+/*
+ * Link, then relink each time linker script or any input file changed.
+ * Errors of linking does not terminate program, instead app_close()
+ * returns here to wait for next change.
+ */
+static void _watch()
+{
+    struct watch_t w;
+    jmp_buf env;
+    int i;
+
+    watch_init(&w);
+    if (*app.lscript)
+        watch_add(&w, app.lscript);
+    for (i = 0; i < app.nvariants; i++)
+        watch_add(&w, app.variants[i].lscript);
+    for (i = 0; i < app.innum; i++)
+        watch_add(&w, app.infiles[i]);
+
+    while (1)
+    {
+        if (setjmp(env) == 0)
+        {
+            app.watchjmp = &env;
+            app_run();
+            if (*app.outputfile)
+                debug_imsgf("Output updated", "%s" NL, app.outputfile);
+            for (i = 0; i < app.nvariants; i++)
+                debug_imsgf("Output updated", "%s" NL, app.variants[i].outputfile);
+        }
+        app.watchjmp = NULL;
+
+        linker_destroy();
+        linker_init();
+        _apply_defines();
+
+        debug_imsg("Waiting for changes");
+        fflush(stdout);
+        watch_wait(&w);
+    }
 }
 
 /*
@@ -122,7 +188,13 @@ static void app_run()
  */
 void app_close(int code)
 {
-    linker_destroy();;
+    /* failed task returns to its thread, error is reported after join */
+    if (app_taskjmp && code != APP_EXITCODE_SIGTERM)
+        longjmp(*app_taskjmp, 1);
+    if (app.watchjmp && code != APP_EXITCODE_SIGTERM)
+        longjmp(*app.watchjmp, 1);
+
+    linker_destroy();
     exit(code);
 }
 
@@ -150,10 +222,26 @@ static void _print_help(int argc, char **argv)
     printf("    -p, --noprint      suppress \".print\" directive" NL);
     printf("    -M                 output map" NL);
     printf("    -MD                output data in map" NL);
+    printf("    --map-json=<path>  write map in JSON format" NL);
     printf("    -D<symbol>=<value> define symbol passed to linker script" NL);
     printf("    --script=<path>    linker script" NL);
     printf("    --output=<path>    output file (S19 format)" NL);
+    printf("    --variant=<script>,<output>[,<symbol>=<value>...]" NL);
+    printf("                       link variant with own script, output and symbols, may" NL);
+    printf("                       be given more than once instead of script and output," NL);
+    printf("                       input files are loaded once for all variants, symbol" NL);
+    printf("                       of variant replaces one given with \"-D\"" NL);
     printf("    --s19head=<value>  value for S0 record of S19" NL);
+    printf("    --jobs=<n>         number of threads loading input files and applying" NL);
+    printf("                       relocations, and of variants linked at once (number" NL);
+    printf("                       of processors if not set)" NL);
+    printf("    --gc-sections      drop sections not referenced from \"vectors\" or \".keep\"," NL);
+    printf("                       input section \"name.suffix\" is glued into \"name\"" NL);
+    printf("    --icf              fold identical sections of \"text\" or \".fold\" sections" NL);
+    printf("    --relax            shrink instructions to short forms when addresses fit them" NL);
+    printf("    --incremental      keep state of link next to output, relink only changed objects" NL);
+    printf("    --stream           release input files after gluing, keep only their symbols" NL);
+    printf("    -w, --watch        stay resident and relink on change of input files" NL);
 
     printf(NL);
 }
@@ -164,7 +252,6 @@ static void _print_help(int argc, char **argv)
 static void _get_options(int argc, char** argv)
 {
     int i;
-    char symbol[TOKEN_STRING_MAX * 2 + 1];
 
     if (argc <= 1)
     {
@@ -184,39 +271,36 @@ static void _get_options(int argc, char** argv)
 
         } else if (sscanf(argv[i], "--s19head=%s", app.s19head)) {
 
+        } else if (sscanf(argv[i], "--jobs=%d", &app.jobs)) {
+
+        } else if (sscanf(argv[i], "--map-json=%s", app.mapjson)) {
+
+        } else if (strncmp(argv[i], "--variant=", 10) == 0) {
+            _variant_add(&argv[i][10]);
+
         } else if (strcmp(argv[i], "-M") == 0) {
             app.printmap = 1;
         } else if (strcmp(argv[i], "-MD") == 0) {
             app.printmapdata = 1;
-        } else if (sscanf(argv[i], "-D%s", symbol)) {
-            char *ch;
-            int64_t value;
-
-            ch = symbol;
-            while (*ch)
-            {
-                if (*ch == '=')
-                {
-                    *ch = 0;
-                    ch++;
-                    break;
-                }
-                ch++;
-            }
-            if (!*ch)
+        } else if (strncmp(argv[i], "-D", 2) == 0 && argv[i][2]) {
+            if (app.ndefines >= DEFINES_MAX)
             {
-                debug_emsg("No value followed \"-D\"" NL);
-                app_close(APP_EXITCODE_ERROR);
-            }
-
-            if (lang_util_str2num(ch, &value) < 0)
-                app_close(APP_EXITCODE_ERROR);
-
-            if (!linker_add_symbol(&lcontext, symbol, value))
-            {
-                debug_emsgf("Failed to add symbol", "\"%s\"" NL, symbol);
+                debug_emsg("Too much symbols defined");
                 app_close(APP_EXITCODE_ERROR);
             }
+            app.defines[app.ndefines++] = &argv[i][2];
+        } else if (strcmp("--gc-sections", argv[i]) == 0) {
+            app.gcsections = 1;
+        } else if (strcmp("--icf", argv[i]) == 0) {
+            app.icf = 1;
+        } else if (strcmp("--relax", argv[i]) == 0) {
+            app.relax = 1;
+        } else if (strcmp("--incremental", argv[i]) == 0) {
+            app.incremental = 1;
+        } else if (strcmp("--stream", argv[i]) == 0) {
+            app.stream = 1;
+        } else if (strcmp("-w", argv[i]) == 0 || strcmp("--watch", argv[i]) == 0) {
+            app.watch = 1;
         } else if (strcmp("-p", argv[i]) == 0 || strcmp("--noprint", argv[i]) == 0) {
             app.noprint = 1;
         } else {
@@ -231,10 +315,139 @@ static void _get_options(int argc, char** argv)
         debug_emsg("No input files was specified" NL);
         app_close(APP_EXITCODE_ERROR);
     }
-    if (!*app.lscript)
+    if (app.nvariants)
     {
+        /* each variant writes its own output, variants are not relinked */
+        if (*app.lscript || *app.outputfile || *app.mapjson || app.incremental)
+        {
+            debug_emsg("Options \"--script\", \"--output\", \"--map-json\" and \"--incremental\" can not be used with \"--variant\"" NL);
+            app_close(APP_EXITCODE_ERROR);
+        }
+    } else if (!*app.lscript) {
         debug_emsg("No linker script was specified" NL);
         app_close(APP_EXITCODE_ERROR);
     }
+    /* relaxation glues input files more than once, map prints their data */
+    if (app.stream && (app.relax || app.printmap))
+    {
+        debug_emsg("Option \"--stream\" can not be used with \"--relax\" or \"-M\"" NL);
+        app_close(APP_EXITCODE_ERROR);
+    }
+}
+
+
+/*
+ * Define symbol from "<symbol>=<value>" string. If "replace" is set, value
+ * of symbol already defined is replaced.
+ */
+static void _define(char *def, int replace)
+{
+    char symbol[TOKEN_STRING_MAX * 2 + 1];
+    struct symbol_t *s;
+    char *ch;
+    int64_t value;
+
+    strncpy(symbol, def, sizeof(symbol) - 1);
+    symbol[sizeof(symbol) - 1] = 0;
+
+    ch = symbol;
+    while (*ch)
+    {
+        if (*ch == '=')
+        {
+            *ch = 0;
+            ch++;
+            break;
+        }
+        ch++;
+    }
+    if (!*ch)
+    {
+        debug_emsg("No value followed \"-D\"" NL);
+        app_close(APP_EXITCODE_ERROR);
+    }
+
+    if (lang_util_str2num(ch, &value) < 0)
+        app_close(APP_EXITCODE_ERROR);
+
+    if (replace && (s = symbol_find(&lcontext.symbols, symbol)))
+    {
+        symbol_set_const(s, value);
+        return;
+    }
+    if (!linker_add_symbol(&lcontext, symbol, value))
+    {
+        debug_emsgf("Failed to add symbol", "\"%s\"" NL, symbol);
+        app_close(APP_EXITCODE_ERROR);
+    }
 }
 
+/*
+ * Add variant of link from "<script>,<output>[,<symbol>=<value>...]" string.
+ */
+static void _variant_add(char *spec)
+{
+    struct app_variant_t *v;
+    char *field;
+    int n;
+
+    if (app.nvariants >= VARIANTS_MAX)
+    {
+        debug_emsg("Too much variants" NL);
+        app_close(APP_EXITCODE_ERROR);
+    }
+    v = &app.variants[app.nvariants];
+
+    if (strlen(spec) >= sizeof(v->spec))
+        goto error;
+    strcpy(v->spec, spec);
+
+    v->lscript    = NULL;
+    v->outputfile = NULL;
+    v->ndefines   = 0;
+    for (n = 0, field = strtok(v->spec, ","); field; n++, field = strtok(NULL, ","))
+    {
+        if (n == 0)
+            v->lscript = field;
+        else if (n == 1)
+            v->outputfile = field;
+        else if (v->ndefines < DEFINES_MAX && strchr(field, '='))
+            v->defines[v->ndefines++] = field;
+        else
+            goto error;
+    }
+    if (!v->outputfile || strlen(v->lscript) >= PATH_MAX || strlen(v->outputfile) >= PATH_MAX)
+        goto error;
+
+    app.nvariants++;
+    return;
+error:
+    debug_emsgf("Invalid variant", "\"%s\"" NL, spec);
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ * Make n-th variant current. Its symbols are defined in addition to ones
+ * given with "-D", symbol given with both takes value of variant.
+ */
+void app_variant(int n)
+{
+    struct app_variant_t *v = &app.variants[n];
+    int i;
+
+    strcpy(app.lscript, v->lscript);
+    strcpy(app.outputfile, v->outputfile);
+    for (i = 0; i < v->ndefines; i++)
+        _define(v->defines[i], 1);
+}
+
+/*
+ * Define symbols given in command line.
+ */
+static void _apply_defines()
+{
+    int i;
+
+    for (i = 0; i < app.ndefines; i++)
+        _define(app.defines[i], 0);
+}
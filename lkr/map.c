@@ -0,0 +1,364 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+/* */
+#include <debug.h>
+#include "app.h"
+#include "map.h"
+
+/*
+ * Label or input section placed in output section.
+ */
+struct _item_t {
+    uint32_t sn;    /* order of output section in result */
+    int64_t start;  /* address */
+    int64_t end;    /* end of input section */
+    uint32_t n;     /* order in result, to keep sort stable */
+    struct symbol_t *symbol;
+};
+
+struct _items_t {
+    struct _item_t *item;
+    uint32_t count;
+    uint32_t size;
+};
+
+static void _item_add(struct _items_t *items, uint32_t sn, int64_t start, int64_t end, struct symbol_t *symbol);
+static int _item_cmp(const void *p1, const void *p2);
+static int _section_n(struct section_t **sections, uint32_t nsections, char *name);
+static void _json_string(FILE *f, char *s);
+
+/*
+ * Write map for tools: output sections, symbols with addresses and sizes,
+ * and sections of each input file. Size of label is distance to next label
+ * at higher address of same output section, or to end of input section it
+ * belongs to.
+ */
+void map_write_json(struct linker_context_t *ctx, char *path)
+{
+    FILE *f;
+    struct llist_t *loop;
+    struct llist_t *floop;
+    struct section_t **sections;
+    struct section_t *section;
+    struct symbol_t *s;
+    struct _items_t labels;
+    struct _items_t ranges;
+    uint32_t nsections, i, j;
+    int first, sn;
+
+    f = NULL;
+    sections = NULL;
+    labels.item = NULL;
+    labels.count = labels.size = 0;
+    ranges.item = NULL;
+    ranges.count = ranges.size = 0;
+
+    /* sections of output */
+    nsections = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((section = sections_next(&loop)))
+        nsections++;
+    sections = malloc((nsections ? nsections : 1) * sizeof(struct section_t *));
+    if (!sections)
+        goto nomem;
+    nsections = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((section = sections_next(&loop)))
+        sections[nsections++] = section;
+
+    /* input sections and labels, sorted by output section and address */
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+        {
+            int64_t start;
+
+            /* strings of merged section are scattered over output section */
+            if (!section->output || section->strmap ||
+                    (sn = _section_n(sections, nsections, section->output->name)) < 0)
+                continue;
+            start = section->output->vma + section->offset;
+            _item_add(&ranges, sn, start, start + section->length, NULL);
+        }
+    }
+    sn = -1;
+    symbols_mkloop(&ctx->result.symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        if (s->type != SYMBOL_TYPE_LABEL)
+            continue;
+
+        /* labels of same section mostly follow each other */
+        if (sn < 0 || strcmp(sections[sn]->name, s->section) != 0)
+            sn = _section_n(sections, nsections, s->section);
+        if (sn < 0)
+            continue;
+
+        _item_add(&labels, sn, s->offset, sections[sn]->vma + sections[sn]->length, s);
+    }
+    if (ranges.count)
+        qsort(ranges.item, ranges.count, sizeof(struct _item_t), _item_cmp);
+    if (labels.count)
+        qsort(labels.item, labels.count, sizeof(struct _item_t), _item_cmp);
+
+    /* labels end at next label or end of input section */
+    for (i = 0, j = 0; i < labels.count; i++)
+    {
+        struct _item_t *l = &labels.item[i];
+        uint32_t k;
+
+        for (k = i + 1; k < labels.count && labels.item[k].sn == l->sn; k++)
+        {
+            if (labels.item[k].start > l->start)
+            {
+                l->end = labels.item[k].start;
+                break;
+            }
+        }
+
+        /* labels and ranges are sorted same way */
+        while (j < ranges.count && (ranges.item[j].sn < l->sn ||
+                    (ranges.item[j].sn == l->sn && ranges.item[j].end <= l->start)))
+            j++;
+        if (j < ranges.count && ranges.item[j].sn == l->sn &&
+                ranges.item[j].start <= l->start && ranges.item[j].end < l->end)
+            l->end = ranges.item[j].end;
+    }
+
+    f = fopen(path, "w");
+    if (!f)
+    {
+        debug_emsgf("Failed to open file", "\"%s\": %s" NL, path, strerror(errno));
+        goto error;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"output\": ");
+    _json_string(f, app.outputfile);
+    fprintf(f, ",\n");
+
+    fprintf(f, "  \"sections\": [");
+    for (i = 0; i < nsections; i++)
+    {
+        section = sections[i];
+
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        _json_string(f, section->name);
+        fprintf(f, ", \"lma\": %u, \"vma\": %u, \"size\": %u, \"noload\": %s}",
+                section->lma, section->vma, section->length, section->noload ? "true" : "false");
+    }
+    fprintf(f, "\n  ],\n");
+
+    fprintf(f, "  \"symbols\": [");
+    for (i = 0; i < labels.count; i++)
+    {
+        struct _item_t *l = &labels.item[i];
+
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        _json_string(f, l->symbol->name);
+        fprintf(f, ", \"type\": \"label\", \"file\": ");
+        if (l->symbol->file)
+            _json_string(f, l->symbol->file);
+        else
+            fprintf(f, "null");
+        fprintf(f, ", \"section\": ");
+        _json_string(f, sections[l->sn]->name);
+        fprintf(f, ", \"address\": %lld, \"size\": %lld}",
+                (long long)l->start, (long long)(l->end > l->start ? l->end - l->start : 0));
+    }
+    first = !labels.count;
+    symbols_mkloop(&ctx->result.symbols, &loop);
+    while ((s = symbols_next(&loop)))
+    {
+        if (s->type != SYMBOL_TYPE_CONST)
+            continue;
+
+        fprintf(f, "%s\n    {\"name\": ", first ? "" : ",");
+        _json_string(f, s->name);
+        fprintf(f, ", \"type\": \"const\", \"value\": %lld}", (long long)s->val64);
+        first = 0;
+    }
+    fprintf(f, "\n  ],\n");
+
+    /* contribution of input files */
+    fprintf(f, "  \"objects\": [");
+    for (floop = ctx->flist; floop; floop = floop->next)
+    {
+        struct linker_file_data_t *fd = floop->p;
+
+        fprintf(f, "%s\n    {\"file\": ", floop == ctx->flist ? "" : ",");
+        _json_string(f, fd->fname);
+        fprintf(f, ", \"sections\": [");
+
+        first = 1;
+        sections_mkloop(&fd->sections, &loop);
+        while ((section = sections_next(&loop)))
+        {
+            fprintf(f, "%s\n      {\"name\": ", first ? "" : ",");
+            _json_string(f, section->name);
+            if (section->output)
+            {
+                fprintf(f, ", \"output\": ");
+                _json_string(f, section->output->name);
+                fprintf(f, ", \"offset\": %u, \"vma\": %u, \"size\": %u, \"discarded\": false",
+                        section->offset, section->output->vma + section->offset, section->length);
+                if (section->fold)
+                {
+                    fprintf(f, ", \"folded\": ");
+                    _json_string(f, section->fold->name);
+                }
+                if (section->strmap)
+                    fprintf(f, ", \"merged\": true");
+                fprintf(f, "}");
+            } else {
+                fprintf(f, ", \"output\": null, \"size\": %u, \"discarded\": true}", section->length);
+            }
+            first = 0;
+        }
+        fprintf(f, "%s]}", first ? "" : "\n    ");
+    }
+    fprintf(f, "\n  ]\n");
+    fprintf(f, "}\n");
+
+    if (fclose(f) != 0)
+    {
+        f = NULL;
+        debug_emsgf("Failed to write file", "\"%s\"" NL, path);
+        goto error;
+    }
+
+    free(sections);
+    if (labels.item)
+        free(labels.item);
+    if (ranges.item)
+        free(ranges.item);
+    return;
+nomem:
+    debug_emsg("Can not allocate memory");
+error:
+    if (f)
+        fclose(f);
+    if (sections)
+        free(sections);
+    if (labels.item)
+        free(labels.item);
+    if (ranges.item)
+        free(ranges.item);
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ *
+ */
+static void _item_add(struct _items_t *items, uint32_t sn, int64_t start, int64_t end, struct symbol_t *symbol)
+{
+    struct _item_t *item;
+
+    if (items->count == items->size)
+    {
+        uint32_t size;
+
+        size = items->size ? items->size * 2 : 256;
+        item = realloc(items->item, size * sizeof(struct _item_t));
+        if (!item)
+        {
+            debug_emsg("Can not allocate memory");
+            app_close(APP_EXITCODE_ERROR);
+        }
+        items->item = item;
+        items->size = size;
+    }
+
+    item = &items->item[items->count];
+    item->sn     = sn;
+    item->start  = start;
+    item->end    = end;
+    item->n      = items->count;
+    item->symbol = symbol;
+    items->count++;
+}
+
+/*
+ *
+ */
+static int _item_cmp(const void *p1, const void *p2)
+{
+    const struct _item_t *i1 = p1;
+    const struct _item_t *i2 = p2;
+
+    if (i1->sn != i2->sn)
+        return i1->sn < i2->sn ? -1 : 1;
+    if (i1->start != i2->start)
+        return i1->start < i2->start ? -1 : 1;
+    if (i1->n != i2->n)
+        return i1->n < i2->n ? -1 : 1;
+    return 0;
+}
+
+/*
+ * RETURN
+ *     order of output section, -1 if not found
+ */
+static int _section_n(struct section_t **sections, uint32_t nsections, char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < nsections; i++)
+    {
+        if (sections[i]->name == name || strcmp(sections[i]->name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+ *
+ */
+static void _json_string(FILE *f, char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04X", (unsigned char)*s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
@@ -0,0 +1,636 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#include <stdlib.h>
+#include <string.h>
+/* */
+#include <debug.h>
+#include <stm8chip.h>
+#include "app.h"
+#include "place.h"
+
+#define PLACE_ADDRESS_MAX   0x01000000 /* 24-bit address space */
+
+/*
+ * Free range of region.
+ */
+struct _hole_t {
+    uint32_t start;
+    uint32_t end;
+};
+
+struct _holes_t {
+    struct _hole_t *hole; /* sorted by address */
+    int count;
+    int size;
+};
+
+/*
+ * Section to place automatically.
+ */
+struct _job_t {
+    struct section_t *section;
+    struct linker_region_t *lregion;
+    struct linker_region_t *vregion;
+    int n; /* order of request */
+};
+
+/*
+ * Address range occupied by section.
+ */
+struct _range_t {
+    uint64_t start;
+    uint64_t end;
+    struct section_t *section;
+    int n; /* order of section */
+};
+
+/*
+ *
+ */
+static void _destroy_region(void *p)
+{
+    struct linker_region_t *r;
+
+    if (!p)
+        return;
+
+    r = p;
+    if (r->name)
+        free(r->name);
+    free(r);
+}
+
+/*
+ *
+ */
+static void _destroy_place(void *p)
+{
+    if (p)
+        free(p);
+}
+
+/*
+ *
+ */
+void place_init(struct linker_context_t *ctx)
+{
+    ctx->regions = NULL;
+    ctx->places  = NULL;
+}
+
+/*
+ *
+ */
+void place_destroy(struct linker_context_t *ctx)
+{
+    llist_destroy(ctx->places);
+    llist_destroy(ctx->regions);
+    ctx->places  = NULL;
+    ctx->regions = NULL;
+}
+
+/*
+ * Declare memory region.
+ *
+ * RETURN
+ *     added region, NULL on error
+ */
+struct linker_region_t *place_region_add(struct linker_context_t *ctx, char *name, int64_t start, int64_t length, int noload)
+{
+    struct llist_t *head;
+    struct linker_region_t *r;
+
+    if (place_region_find(ctx, name))
+    {
+        debug_emsgf("Region redefined", "\"%s\"" NL, name);
+        return NULL;
+    }
+    if (start < 0 || length <= 0 || start + length > PLACE_ADDRESS_MAX)
+    {
+        debug_emsgf("Invalid region", "\"%s\"" NL, name);
+        return NULL;
+    }
+
+    r = calloc(1, sizeof(struct linker_region_t));
+    if (!r)
+        goto error;
+    r->name = malloc(strlen(name) + 1);
+    if (!r->name)
+        goto error;
+    strcpy(r->name, name);
+    r->start  = start;
+    r->length = length;
+    r->noload = noload;
+
+    head = llist_add(ctx->regions, r, _destroy_region, r);
+    if (!head)
+        goto error;
+    ctx->regions = head;
+
+    return r;
+error:
+    _destroy_region(r);
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+    return NULL;
+}
+
+/*
+ * RETURN
+ *     region, NULL if not found
+ */
+struct linker_region_t *place_region_find(struct linker_context_t *ctx, char *name)
+{
+    struct llist_t *loop;
+
+    for (loop = ctx->regions; loop; loop = loop->next)
+    {
+        struct linker_region_t *r = loop->p;
+
+        if (strcmp(r->name, name) == 0)
+            return r;
+    }
+
+    return NULL;
+}
+
+/*
+ * Declare regions "flash", "ram", "eeprom" and "options" of chip. RAM is
+ * declared as NOLOAD region.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int place_chip(struct linker_context_t *ctx, char *name)
+{
+    struct stm8chip_t *chip;
+
+    for (chip = stm8chips; *chip->name; chip++)
+    {
+        if (strcmp(chip->name, name) == 0)
+            break;
+    }
+    if (!*chip->name)
+    {
+        debug_emsgf("Unknown chip", "\"%s\"" NL, name);
+        return -1;
+    }
+
+    if (!place_region_add(ctx, "flash",   chip->flash.offset,   chip->flash.length,   0) ||
+        !place_region_add(ctx, "ram",     chip->ram.offset,     chip->ram.length,     1) ||
+        !place_region_add(ctx, "eeprom",  chip->eeprom.offset,  chip->eeprom.length,  0) ||
+        !place_region_add(ctx, "options", chip->options.offset, chip->options.length, 0))
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Request placement of section into regions, address is found by
+ * place_sections().
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int place_request(struct linker_context_t *ctx, struct section_t *s,
+        struct linker_region_t *lregion, struct linker_region_t *vregion)
+{
+    struct llist_t *head;
+    struct linker_place_t *p;
+
+    if (lregion && lregion->noload)
+    {
+        debug_emsgf("NOLOAD region can not hold LMA", "\"%s\"" NL, lregion->name);
+        return -1;
+    }
+
+    p = malloc(sizeof(struct linker_place_t));
+    if (!p)
+        goto error;
+    p->section = s;
+    p->lregion = lregion;
+    p->vregion = vregion;
+
+    head = llist_add(ctx->places, p, _destroy_place, p);
+    if (!head)
+        goto error;
+    ctx->places = head;
+
+    return 0;
+error:
+    _destroy_place(p);
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+    return -1;
+}
+
+/*
+ * Insert free range at position n.
+ */
+static void _holes_insert(struct _holes_t *holes, int n, uint32_t start, uint32_t end)
+{
+    if (holes->count == holes->size)
+    {
+        struct _hole_t *hole;
+        int size;
+
+        size = holes->size ? holes->size * 2 : 8;
+        hole = realloc(holes->hole, size * sizeof(struct _hole_t));
+        if (!hole)
+        {
+            debug_emsg("Can not allocate memory");
+            app_close(APP_EXITCODE_ERROR);
+        }
+        holes->hole = hole;
+        holes->size = size;
+    }
+
+    memmove(&holes->hole[n + 1], &holes->hole[n], (holes->count - n) * sizeof(struct _hole_t));
+    holes->hole[n].start = start;
+    holes->hole[n].end   = end;
+    holes->count++;
+}
+
+/*
+ * Remove range [start, end) from free ranges.
+ */
+static void _holes_take(struct _holes_t *holes, uint64_t start, uint64_t end)
+{
+    int i;
+
+    if (start >= end)
+        return;
+
+    for (i = 0; i < holes->count; i++)
+    {
+        struct _hole_t *h = &holes->hole[i];
+
+        if (end <= h->start || start >= h->end)
+            continue;
+
+        if (start > h->start && end < h->end)
+        {
+            _holes_insert(holes, i + 1, end, holes->hole[i].end);
+            holes->hole[i].end = start;
+            return;
+        } else if (start > h->start) {
+            h->end = start;
+        } else if (end < h->end) {
+            h->start = end;
+        } else {
+            memmove(&holes->hole[i], &holes->hole[i + 1], (holes->count - i - 1) * sizeof(struct _hole_t));
+            holes->count--;
+            i--;
+        }
+    }
+}
+
+/*
+ * Find aligned address for range of length in free ranges, best fit.
+ *
+ * RETURN
+ *     0 on success, -1 if there is no room
+ */
+static int _holes_alloc(struct _holes_t *holes, uint32_t length, uint32_t align, uint32_t *addr)
+{
+    uint64_t start, best, bwaste;
+    int i, found;
+
+    found  = 0;
+    best   = 0;
+    bwaste = 0;
+    for (i = 0; i < holes->count; i++)
+    {
+        struct _hole_t *h = &holes->hole[i];
+        uint64_t waste;
+
+        start = ((uint64_t)h->start + align - 1) / align * align;
+        if (start + length > h->end)
+            continue;
+
+        /* padding before aligned start stays free */
+        waste = h->end - start - length;
+        if (!found || waste < bwaste)
+        {
+            found  = 1;
+            best   = start;
+            bwaste = waste;
+        }
+    }
+    if (!found)
+        return -1;
+
+    _holes_take(holes, best, best + length);
+    *addr = best;
+
+    return 0;
+}
+
+/*
+ * RETURN
+ *     request of placement of section, NULL if section placed by address
+ */
+static struct linker_place_t *_place_find(struct linker_context_t *ctx, struct section_t *s)
+{
+    struct llist_t *loop;
+
+    for (loop = ctx->places; loop; loop = loop->next)
+    {
+        struct linker_place_t *p = loop->p;
+
+        if (p->section == s)
+            return p;
+    }
+
+    return NULL;
+}
+
+/*
+ *
+ */
+static int _job_cmp(const void *a, const void *b)
+{
+    const struct _job_t *j0 = a, *j1 = b;
+
+    if (j0->section->length != j1->section->length)
+        return j0->section->length > j1->section->length ? -1 : 1;
+    return j0->n - j1->n;
+}
+
+/*
+ * Place sections which are requested to be placed into regions and, if
+ * regions are declared, sections not placed by linker script. Section not
+ * placed by script goes to first declared region of its kind (NOLOAD or
+ * not).
+ *
+ * Free ranges of regions are those not occupied by sections placed by
+ * address. Sections are placed from largest one, each to free range which
+ * is left with least room (best fit).
+ */
+void place_sections(struct linker_context_t *ctx)
+{
+    struct linker_region_t **regions, *lregion, *vregion;
+    struct _holes_t *holes;
+    struct _job_t *jobs;
+    struct llist_t *loop;
+    struct section_t *s;
+    int nregions, nsections, njobs, i;
+
+    if (!ctx->regions)
+        return;
+
+    nregions = 0;
+    for (loop = ctx->regions; loop; loop = loop->next)
+        nregions++;
+    nsections = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((s = sections_next(&loop)))
+        nsections++;
+
+    regions = malloc(nregions * sizeof(struct linker_region_t *));
+    holes   = calloc(nregions, sizeof(struct _holes_t));
+    jobs    = malloc((nsections ? nsections : 1) * sizeof(struct _job_t));
+    if (!regions || !holes || !jobs)
+    {
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
+
+    lregion = vregion = NULL;
+    for (i = 0, loop = ctx->regions; loop; loop = loop->next, i++)
+    {
+        regions[i] = loop->p;
+        _holes_insert(&holes[i], 0, regions[i]->start, regions[i]->start + regions[i]->length);
+
+        /* default regions */
+        if (!regions[i]->noload && !lregion)
+            lregion = regions[i];
+        if (regions[i]->noload && !vregion)
+            vregion = regions[i];
+    }
+
+    /* collect sections to place, take ranges of sections placed by address */
+    njobs = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((s = sections_next(&loop)))
+    {
+        struct linker_place_t *p;
+        struct _job_t *job;
+
+        p = s->placed ? _place_find(ctx, s) : NULL;
+        if (s->placed && !p)
+        {
+            for (i = 0; i < nregions; i++)
+            {
+                if (!s->noload)
+                    _holes_take(&holes[i], s->lma, (uint64_t)s->lma + s->length);
+                _holes_take(&holes[i], s->vma, (uint64_t)s->vma + s->length);
+            }
+            continue;
+        }
+
+        job = &jobs[njobs];
+        job->section = s;
+        job->n       = njobs;
+        if (p)
+        {
+            job->lregion = p->lregion;
+            job->vregion = p->vregion;
+
+            /* side placed by address */
+            for (i = 0; i < nregions; i++)
+            {
+                if (!p->lregion && !s->noload)
+                    _holes_take(&holes[i], s->lma, (uint64_t)s->lma + s->length);
+                if (!p->vregion)
+                    _holes_take(&holes[i], s->vma, (uint64_t)s->vma + s->length);
+            }
+        } else {
+            job->lregion = s->noload ? NULL : lregion;
+            job->vregion = s->noload ? vregion : lregion;
+            if (!job->vregion)
+            {
+                debug_emsgf("No region for section", "\"%s\"" NL, s->name);
+                app_close(APP_EXITCODE_ERROR);
+            }
+        }
+        njobs++;
+    }
+
+    qsort(jobs, njobs, sizeof(struct _job_t), _job_cmp);
+
+    for (i = 0; i < njobs; i++)
+    {
+        struct _job_t *job = &jobs[i];
+        struct linker_region_t *r;
+        uint32_t addr;
+        int n, k;
+
+        s    = job->section;
+        addr = 0;
+        for (k = 0; k < 2; k++)
+        {
+            r = k == 0 ? job->lregion : job->vregion;
+            if (!r || (k == 0 && s->noload))
+                continue;
+            /* same region for LMA and VMA, section is not moved */
+            if (k == 1 && r == job->lregion && !s->noload)
+            {
+                s->vma = s->lma;
+                continue;
+            }
+
+            for (n = 0; regions[n] != r; n++)
+                ;
+            if (_holes_alloc(&holes[n], s->length, s->align, &addr) < 0)
+            {
+                debug_emsgf("Section does not fit to region", "\"%s\" \"%s\"" NL, s->name, r->name);
+                app_close(APP_EXITCODE_ERROR);
+            }
+            if (k == 0)
+                s->lma = addr;
+            else
+                s->vma = addr;
+        }
+        s->placed = 1;
+    }
+
+    for (i = 0; i < nregions; i++)
+    {
+        if (holes[i].hole)
+            free(holes[i].hole);
+    }
+    free(holes);
+    free(regions);
+    free(jobs);
+}
+
+/*
+ *
+ */
+static int _range_cmp(const void *a, const void *b)
+{
+    const struct _range_t *r0 = a, *r1 = b;
+
+    if (r0->start != r1->start)
+        return r0->start < r1->start ? -1 : 1;
+    if (r0->end != r1->end)
+        return r0->end > r1->end ? -1 : 1;
+    return r0->n - r1->n;
+}
+
+/*
+ * Sort ranges by address, range overlaps others if it starts before end of
+ * ranges preceding it.
+ *
+ * RETURN
+ *     0 if ranges do not overlap, -1 otherwise
+ */
+static int _check_ranges(struct _range_t *ranges, int count, char *msg)
+{
+    struct _range_t *last;
+    int i;
+
+    qsort(ranges, count, sizeof(struct _range_t), _range_cmp);
+
+    last = NULL;
+    for (i = 0; i < count; i++)
+    {
+        if (last && ranges[i].start < last->end)
+        {
+            debug_emsgf(msg, "\"%s\" \"%s\"" NL, last->section->name, ranges[i].section->name);
+            return -1;
+        }
+        if (!last || ranges[i].end > last->end)
+            last = &ranges[i];
+    }
+
+    return 0;
+}
+
+/*
+ * Check that sections do not overlap, neither by LMA nor by VMA. Empty
+ * sections are not checked.
+ */
+void place_check(struct linker_context_t *ctx)
+{
+    struct _range_t *lranges, *vranges;
+    struct llist_t *loop;
+    struct section_t *s;
+    int nl, nv, n;
+
+    n = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((s = sections_next(&loop)))
+        n++;
+    if (!n)
+        return;
+
+    lranges = malloc(n * sizeof(struct _range_t));
+    vranges = malloc(n * sizeof(struct _range_t));
+    if (!lranges || !vranges)
+    {
+        debug_emsg("Can not allocate memory");
+        app_close(APP_EXITCODE_ERROR);
+    }
+
+    nl = nv = n = 0;
+    sections_mkloop(&ctx->result.sections, &loop);
+    while ((s = sections_next(&loop)))
+    {
+        n++;
+        if (!s->length)
+            continue;
+
+        if (!s->noload)
+        {
+            lranges[nl].start   = s->lma;
+            lranges[nl].end     = (uint64_t)s->lma + s->length;
+            lranges[nl].section = s;
+            lranges[nl].n       = n;
+            nl++;
+        }
+        vranges[nv].start   = s->vma;
+        vranges[nv].end     = (uint64_t)s->vma + s->length;
+        vranges[nv].section = s;
+        vranges[nv].n       = n;
+        nv++;
+    }
+
+    n = 0;
+    if (_check_ranges(lranges, nl, "LMA of sections overlaps") < 0 ||
+        _check_ranges(vranges, nv, "VMA of sections overlaps") < 0)
+        n = -1;
+
+    free(lranges);
+    free(vranges);
+
+    if (n < 0)
+        app_close(APP_EXITCODE_ERROR);
+}
+
@@ -0,0 +1,620 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+/* */
+#include <debug.h>
+#include "app.h"
+#include "state.h"
+
+#define STATE_MAGIC     "stm8mu_lkr state 1"
+#define STATE_LINE_MAX  (PATH_MAX + TOKEN_STRING_MAX * 2 + 128)
+#define STATE_FIELDS    8
+
+static void _destroy_object(void *p);
+static void _destroy_section(void *p);
+static void _destroy_output(void *p);
+static char *_strdup(char *s);
+static int _fields(char *line, char **field);
+static int _number(char *s, uint64_t *value);
+static int _name_valid(char *s);
+
+/*
+ *
+ */
+void state_init(struct state_t *st)
+{
+    st->config  = 0;
+    st->image   = 0;
+    st->objects = NULL;
+    st->outputs = NULL;
+    st->symbols.list  = NULL;
+    st->symbols.count = 0;
+    st->symbols.size  = 0;
+}
+
+/*
+ *
+ */
+void state_destroy(struct state_t *st)
+{
+    uint32_t i;
+
+    llist_destroy(st->objects);
+    llist_destroy(st->outputs);
+    for (i = 0; i < st->symbols.count; i++)
+        free(st->symbols.list[i].name);
+    if (st->symbols.list)
+        free(st->symbols.list);
+    state_init(st);
+}
+
+/*
+ * Load state saved by state_save().
+ *
+ * RETURN
+ *     0 on success, -1 if there is no state or it is not valid
+ */
+int state_load(struct state_t *st, char *path)
+{
+    FILE *f;
+    char *line;
+    char *field[STATE_FIELDS];
+    struct state_object_t *obj;
+    uint64_t v[4];
+    int n;
+
+    line = NULL;
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+
+    line = malloc(STATE_LINE_MAX);
+    if (!line)
+        goto error;
+
+    if (!fgets(line, STATE_LINE_MAX, f) || _fields(line, field) != 1 || strcmp(field[0], STATE_MAGIC) != 0)
+        goto error;
+
+    obj = NULL;
+    while (fgets(line, STATE_LINE_MAX, f))
+    {
+        n = _fields(line, field);
+        if (n < 2)
+            goto error;
+
+        if (strcmp(field[0], "config") == 0 && n == 3) {
+            if (_number(field[1], &st->config) < 0 || _number(field[2], &st->image) < 0)
+                goto error;
+        } else if (strcmp(field[0], "output") == 0 && n == 6) {
+            if (_number(field[2], &v[0]) < 0 || _number(field[3], &v[1]) < 0 ||
+                _number(field[4], &v[2]) < 0 || _number(field[5], &v[3]) < 0)
+                goto error;
+            state_output_add(st, field[1], v[0], v[1], v[2], v[3]);
+        } else if (strcmp(field[0], "symbol") == 0 && n == 6) {
+            if (_number(field[2], &v[0]) < 0 || _number(field[3], &v[1]) < 0 ||
+                _number(field[4], &v[2]) < 0 || _number(field[5], &v[3]) < 0)
+                goto error;
+            state_symbol_add(st, field[1], (int)v[0] - 1, v[1], v[2], v[3]);
+        } else if (strcmp(field[0], "object") == 0 && n == 5) {
+            if (_number(field[2], &v[0]) < 0 || _number(field[3], &v[1]) < 0 ||
+                _number(field[4], &v[2]) < 0)
+                goto error;
+            obj = state_object_add(st, field[1], v[0], v[1]);
+            obj->nexports = v[2];
+        } else if (strcmp(field[0], "section") == 0 && n == 5 && obj) {
+            if (_number(field[3], &v[0]) < 0 || _number(field[4], &v[1]) < 0)
+                goto error;
+            state_section_add(obj, field[1], field[2], v[0], v[1]);
+        } else if (strcmp(field[0], "extern") == 0 && n == 2 && obj) {
+            state_extern_add(obj, field[1]);
+        } else {
+            goto error;
+        }
+    }
+    if (ferror(f))
+        goto error;
+
+    state_symbols_sort(st);
+
+    free(line);
+    fclose(f);
+    return 0;
+error:
+    debug_wmsgf("Link state is not valid, ignored", "\"%s\"" NL, path);
+    if (line)
+        free(line);
+    fclose(f);
+    state_destroy(st);
+    return -1;
+}
+
+/*
+ * Save state, file is replaced only when it is written completely.
+ *
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int state_save(struct state_t *st, char *path)
+{
+    char tpath[PATH_MAX + 8];
+    FILE *f;
+    struct llist_t *loop, *sloop;
+    uint32_t i;
+
+    snprintf(tpath, sizeof(tpath), "%s.tmp", path);
+
+    f = fopen(tpath, "w");
+    if (!f)
+    {
+        debug_emsgf("Failed to open file", "\"%s\": %s" NL, tpath, strerror(errno));
+        return -1;
+    }
+
+    fprintf(f, STATE_MAGIC "\n");
+    fprintf(f, "config\t0x%016llX\t0x%016llX\n", (unsigned long long)st->config, (unsigned long long)st->image);
+
+    for (loop = st->outputs; loop; loop = loop->next)
+    {
+        struct state_output_t *o = loop->p;
+
+        if (!_name_valid(o->name))
+            goto error;
+        fprintf(f, "output\t%s\t0x%06X\t0x%06X\t0x%06X\t%d\n", o->name, o->lma, o->vma, o->length, o->noload);
+    }
+
+    for (i = 0; i < st->symbols.count; i++)
+    {
+        struct state_symbol_t *s = &st->symbols.list[i];
+
+        if (!_name_valid(s->name))
+            goto error;
+        fprintf(f, "symbol\t%s\t%d\t%d\t%u\t0x%llX\n", s->name, s->object + 1, s->label, s->width,
+                (unsigned long long)s->value);
+    }
+
+    for (loop = st->objects; loop; loop = loop->next)
+    {
+        struct state_object_t *obj = loop->p;
+
+        if (!_name_valid(obj->path))
+            goto error;
+        fprintf(f, "object\t%s\t%llu\t0x%016llX\t%d\n", obj->path,
+                (unsigned long long)obj->size, (unsigned long long)obj->hash, obj->nexports);
+
+        for (sloop = obj->sections; sloop; sloop = sloop->next)
+        {
+            struct state_section_t *s = sloop->p;
+
+            if (!_name_valid(s->name) || !_name_valid(s->output))
+                goto error;
+            fprintf(f, "section\t%s\t%s\t0x%06X\t0x%06X\n", s->name, s->output, s->offset, s->length);
+        }
+        for (sloop = obj->externs; sloop; sloop = sloop->next)
+        {
+            if (!_name_valid(sloop->p))
+                goto error;
+            fprintf(f, "extern\t%s\n", (char *)sloop->p);
+        }
+    }
+
+    if (fclose(f) != 0)
+    {
+        f = NULL;
+        goto error;
+    }
+    f = NULL;
+
+    if (rename(tpath, path) < 0)
+        goto error;
+
+    return 0;
+error:
+    if (f)
+        fclose(f);
+    unlink(tpath);
+    debug_wmsgf("Failed to save link state", "\"%s\"" NL, path);
+    return -1;
+}
+
+/*
+ *
+ */
+struct state_object_t *state_object_add(struct state_t *st, char *path, uint64_t size, uint64_t hash)
+{
+    struct state_object_t *obj;
+    struct llist_t *head;
+
+    obj = malloc(sizeof(struct state_object_t));
+    if (!obj)
+        goto error;
+    obj->sections = NULL;
+    obj->externs  = NULL;
+    obj->nexports = 0;
+    obj->size     = size;
+    obj->hash     = hash;
+    obj->path     = _strdup(path);
+    if (!obj->path)
+        goto error;
+
+    head = llist_add(st->objects, obj, _destroy_object, obj);
+    if (!head)
+        goto error;
+    st->objects = head;
+
+    return obj;
+error:
+    _destroy_object(obj);
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+    return NULL;
+}
+
+/*
+ *
+ */
+void state_section_add(struct state_object_t *obj, char *name, char *output, uint32_t offset, uint32_t length)
+{
+    struct state_section_t *s;
+    struct llist_t *head;
+
+    s = malloc(sizeof(struct state_section_t));
+    if (!s)
+        goto error;
+    s->offset = offset;
+    s->length = length;
+    s->name   = _strdup(name);
+    s->output = _strdup(output);
+    if (!s->name || !s->output)
+        goto error;
+
+    head = llist_add(obj->sections, s, _destroy_section, s);
+    if (!head)
+        goto error;
+    obj->sections = head;
+
+    return;
+error:
+    _destroy_section(s);
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ *
+ */
+struct state_section_t *state_section_find(struct state_object_t *obj, char *name)
+{
+    struct llist_t *loop;
+
+    for (loop = obj->sections; loop; loop = loop->next)
+    {
+        struct state_section_t *s = loop->p;
+
+        if (strcmp(s->name, name) == 0)
+            return s;
+    }
+
+    return NULL;
+}
+
+/*
+ *
+ */
+void state_extern_add(struct state_object_t *obj, char *name)
+{
+    struct llist_t *head;
+    char *s;
+
+    s = _strdup(name);
+    if (!s)
+        goto error;
+
+    head = llist_add(obj->externs, s, free, s);
+    if (!head)
+        goto error;
+    obj->externs = head;
+
+    return;
+error:
+    if (s)
+        free(s);
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ *
+ */
+void state_output_add(struct state_t *st, char *name, uint32_t lma, uint32_t vma, uint32_t length, int noload)
+{
+    struct state_output_t *o;
+    struct llist_t *head;
+
+    o = malloc(sizeof(struct state_output_t));
+    if (!o)
+        goto error;
+    o->lma    = lma;
+    o->vma    = vma;
+    o->length = length;
+    o->noload = noload;
+    o->name   = _strdup(name);
+    if (!o->name)
+        goto error;
+
+    head = llist_add(st->outputs, o, _destroy_output, o);
+    if (!head)
+        goto error;
+    st->outputs = head;
+
+    return;
+error:
+    _destroy_output(o);
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ *
+ */
+void state_symbol_add(struct state_t *st, char *name, int object, int label, uint8_t width, int64_t value)
+{
+    struct state_symbol_t *s;
+
+    if (st->symbols.count == st->symbols.size)
+    {
+        struct state_symbol_t *list;
+        uint32_t size;
+
+        size = st->symbols.size ? st->symbols.size * 2 : 64;
+        list = realloc(st->symbols.list, size * sizeof(struct state_symbol_t));
+        if (!list)
+            goto error;
+        st->symbols.list = list;
+        st->symbols.size = size;
+    }
+
+    s = &st->symbols.list[st->symbols.count];
+    s->name = _strdup(name);
+    if (!s->name)
+        goto error;
+    s->object  = object;
+    s->label   = label;
+    s->width   = width;
+    s->value   = value;
+    s->changed = 0;
+    st->symbols.count++;
+
+    return;
+error:
+    debug_emsg("Can not allocate memory");
+    app_close(APP_EXITCODE_ERROR);
+}
+
+/*
+ *
+ */
+static int _symbol_cmp(const void *p1, const void *p2)
+{
+    const struct state_symbol_t *s1 = p1;
+    const struct state_symbol_t *s2 = p2;
+
+    return strcmp(s1->name, s2->name);
+}
+
+/*
+ * Sort symbols to find them with state_symbol_find().
+ */
+void state_symbols_sort(struct state_t *st)
+{
+    if (st->symbols.count)
+        qsort(st->symbols.list, st->symbols.count, sizeof(struct state_symbol_t), _symbol_cmp);
+}
+
+/*
+ *
+ */
+struct state_symbol_t *state_symbol_find(struct state_t *st, char *name)
+{
+    struct state_symbol_t key;
+
+    if (!st->symbols.count)
+        return NULL;
+
+    key.name = name;
+    return bsearch(&key, st->symbols.list, st->symbols.count, sizeof(struct state_symbol_t), _symbol_cmp);
+}
+
+/*
+ * FNV-1a hash.
+ */
+uint64_t state_hash(uint64_t hash, void *data, size_t length)
+{
+    uint8_t *p = data;
+
+    while (length--)
+    {
+        hash ^= *p++;
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+/*
+ * RETURN
+ *     0 on success, -1 on error
+ */
+int state_hash_file(char *path, uint64_t *size, uint64_t *hash)
+{
+    uint8_t buf[64 * 1024];
+    ssize_t n;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    *size = 0;
+    *hash = STATE_HASH_INIT;
+    while ((n = read(fd, buf, sizeof(buf))) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            return -1;
+        }
+        *hash = state_hash(*hash, buf, n);
+        *size += n;
+    }
+    close(fd);
+
+    return 0;
+}
+
+/*
+ *
+ */
+static void _destroy_object(void *p)
+{
+    struct state_object_t *obj = p;
+
+    if (!obj)
+        return;
+    llist_destroy(obj->sections);
+    llist_destroy(obj->externs);
+    if (obj->path)
+        free(obj->path);
+    free(obj);
+}
+
+/*
+ *
+ */
+static void _destroy_section(void *p)
+{
+    struct state_section_t *s = p;
+
+    if (!s)
+        return;
+    if (s->name)
+        free(s->name);
+    if (s->output)
+        free(s->output);
+    free(s);
+}
+
+/*
+ *
+ */
+static void _destroy_output(void *p)
+{
+    struct state_output_t *o = p;
+
+    if (!o)
+        return;
+    if (o->name)
+        free(o->name);
+    free(o);
+}
+
+/*
+ *
+ */
+static char *_strdup(char *s)
+{
+    char *d;
+
+    d = malloc(strlen(s) + 1);
+    if (d)
+        strcpy(d, s);
+    return d;
+}
+
+/*
+ * Split line to fields separated by tabulation.
+ *
+ * RETURN
+ *     number of fields, -1 on error
+ */
+static int _fields(char *line, char **field)
+{
+    char *nl;
+    int n;
+
+    nl = strchr(line, '\n');
+    if (!nl)
+        return -1;
+    *nl = 0;
+
+    n = 0;
+    field[n++] = line;
+    while ((line = strchr(line, '\t')))
+    {
+        if (n == STATE_FIELDS)
+            return -1;
+        *line++ = 0;
+        field[n++] = line;
+    }
+
+    return n;
+}
+
+/*
+ * RETURN
+ *     0 on success, -1 on error
+ */
+static int _number(char *s, uint64_t *value)
+{
+    char *end;
+
+    if (!*s)
+        return -1;
+    errno = 0;
+    *value = strtoull(s, &end, 0);
+    if (errno || *end)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * RETURN
+ *     1 if name may be saved to state, 0 otherwise
+ */
+static int _name_valid(char *s)
+{
+    return !strchr(s, '\t') && !strchr(s, '\n');
+}
+
@@ -0,0 +1,116 @@
+/*
+ *     Set of utilities for programming STM8 microcontrollers.
+ *
+ * Copyright (c) 2015-2021, Dmitry Kobylin
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#ifndef _STATE_H
+#define _STATE_H
+
+/* */
+#include <types.h>
+#include <llist.h>
+
+/*
+ * State of previous link kept next to output, used to relink only objects
+ * changed since.
+ */
+
+/*
+ * Input section of object and space reserved for it in output section.
+ */
+struct state_section_t {
+    char *name;
+    char *output;    /* name of output section */
+    uint32_t offset; /* offset in output section */
+    uint32_t length; /* space reserved, section may shrink but not grow */
+};
+
+struct state_object_t {
+    char *path;
+    uint64_t size;
+    uint64_t hash;  /* hash of content of file */
+    int nexports;   /* number of symbols exported by object */
+    struct llist_t *sections;
+    struct llist_t *externs; /* names of symbols referenced by object */
+};
+
+/*
+ * Output section.
+ */
+struct state_output_t {
+    char *name;
+    uint32_t lma;
+    uint32_t vma;
+    uint32_t length;
+    int noload;
+};
+
+/*
+ * Resolved symbol, exported by object or given to linker.
+ */
+struct state_symbol_t {
+    char *name;
+    int object;    /* index of object exported symbol, -1 if symbol of linker */
+    int label;     /* value is address, constant otherwise */
+    uint8_t width;
+    int64_t value;
+    int changed;   /* value changed by relink */
+};
+
+struct state_t {
+    uint64_t config; /* hash of linker script and options */
+    uint64_t image;  /* hash of output file */
+
+    struct llist_t *objects;
+    struct llist_t *outputs;
+
+    struct {
+        struct state_symbol_t *list; /* sorted by name after state_symbols_sort() */
+        uint32_t count;
+        uint32_t size;
+    } symbols;
+};
+
+void state_init(struct state_t *st);
+void state_destroy(struct state_t *st);
+int state_load(struct state_t *st, char *path);
+int state_save(struct state_t *st, char *path);
+
+struct state_object_t *state_object_add(struct state_t *st, char *path, uint64_t size, uint64_t hash);
+void state_section_add(struct state_object_t *obj, char *name, char *output, uint32_t offset, uint32_t length);
+struct state_section_t *state_section_find(struct state_object_t *obj, char *name);
+void state_extern_add(struct state_object_t *obj, char *name);
+void state_output_add(struct state_t *st, char *name, uint32_t lma, uint32_t vma, uint32_t length, int noload);
+void state_symbol_add(struct state_t *st, char *name, int object, int label, uint8_t width, int64_t value);
+void state_symbols_sort(struct state_t *st);
+struct state_symbol_t *state_symbol_find(struct state_t *st, char *name);
+
+uint64_t state_hash(uint64_t hash, void *data, size_t length);
+int state_hash_file(char *path, uint64_t *size, uint64_t *hash);
+
+#define STATE_HASH_INIT     0xCBF29CE484222325ULL
+
+#endif
+
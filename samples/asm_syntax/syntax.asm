@@ -154,6 +154,49 @@ This string will not printed, because 0 character escaped
     .fill $80 $12         ; fill with number
     .fill $80 {$A0 | $0B} ; fill with value of expression
 
+;
+; Test of .table directive.
+; Expression evaluated for each INDEX from 0 to count - 1.
+; Following data/instructions will be placed in "table_section" section.
+;
+.section "table_section"
+.dbendian "big"
+    .table d8,  8, {INDEX * INDEX}              ; output: 00 01 04 09 10 19 24 31
+    .table d16, {4}, {$100 << INDEX}            ; output: 01 00 02 00 04 00 08 00
+    .table d8   4    {(INDEX * 255) / 3}        ; commas are optional
+
+;
+; Test of macro and repeat blocks.
+; Parameters of macro are replaced by arguments of invocation, names
+; inside strings, chars and comments are not replaced.
+; Every expansion is scope of it's own local labels, so they are unique.
+; Following data/instructions will be placed in "macro_section" section.
+;
+.macro set_word reg, value                  ; define macro with two parameters
+    ldw reg, #value
+.endm
+
+.macro pause count                          ; macro may contain repeat block
+    .rept count
+        nop
+    .endr
+.endm
+
+.macro wait_bit addr, bit                   ; macro with local label
+?wait:
+    btjf addr, #bit, ?wait
+.endm
+
+.section "macro_section"
+    set_word X, $1234                       ; output: AE 12 34
+    set_word Y, {DEF1 + 1}                  ; output: 90 AE 00 02
+    pause 3                                 ; output: 9D 9D 9D
+    wait_bit $5230, 7                       ; output: 72 0F 52 30 FB
+    wait_bit $5230, 7                       ; output: 72 0F 52 30 FB
+    .rept {2}
+        .d8 $55, $AA                        ; output: 55 AA 55 AA
+    .endr
+
 ;
 ; Following data/instructions will be placed in "dataX" section.
 ;